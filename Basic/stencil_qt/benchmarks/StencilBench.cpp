@@ -0,0 +1,153 @@
+/**
+ * @file StencilBench.cpp
+ * @brief Per-stage timings of the Qt StencilGenerator over synthetic images
+ *
+ * Prints one JSON object per stage and size (format shared with the
+ * command-line library's stencil_bench, see bench_support.hpp).
+ *
+ * Usage: StencilBench [--sizes 1,4,16,50,100] [--min-seconds 0.5] [--out results.jsonl]
+ */
+
+#include "StencilGenerator.hpp"
+#include "SharedImage.hpp"
+#include "bench_support.hpp"
+#include "edge_preserving_filter.hpp"
+#include <QCoreApplication>
+#include <fstream>
+#include <iostream>
+
+namespace bench = stencil::bench;
+
+/**
+ * @brief Benchmark every stage at one image size
+ * @param out Output stream for the JSON lines
+ * @param megapixels Synthetic image size
+ * @param options Timing options
+ */
+static void runSize(std::ostream &out, double megapixels, const bench::RunOptions &options) {
+    const std::string suite = "qt";
+    cv::Mat image = bench::syntheticImage(megapixels);
+    const cv::Size size = image.size();
+    
+    StencilGenerator generator;
+    generator.loadImage(image);
+    
+    StencilParams params;
+    cv::Mat preprocessed = generator.preprocessImage(image, params);
+    
+    auto run = [&](const std::string &stage, auto &&fn) {
+        bench::writeRecord(out, bench::measure(suite, stage, size, fn, options));
+    };
+    
+    // Preprocess and every processing mode
+    run("preprocess", [&] { return generator.preprocessImage(image, params); });
+    run("mode_simple_threshold", [&] { return generator.applySimpleThreshold(preprocessed, params); });
+    run("mode_edge_detection", [&] { return generator.applyEdgeDetection(preprocessed, params); });
+    run("mode_adaptive_threshold", [&] { return generator.applyAdaptiveThreshold(preprocessed, params); });
+    run("mode_multi_layer", [&] { return generator.applyMultiLayer(preprocessed, params); });
+    run("mode_contour_polygon", [&] { return generator.applyContourPolygon(preprocessed, params); });
+    run("mode_detail_preserving", [&] { return generator.applyDetailPreserving(preprocessed, params); });
+    run("mode_local_threshold", [&] { return generator.applyLocalThreshold(preprocessed, params); });
+    
+    // Large blocks: the blur inside cv::adaptiveThreshold grows, running sums do not
+    StencilParams largeBlock = params;
+    largeBlock.adaptiveBlockSize = 301;
+    largeBlock.localBlockSize = 301;
+    run("mode_adaptive_threshold_b301", [&] { return generator.applyAdaptiveThreshold(preprocessed, largeBlock); });
+    run("mode_local_threshold_b301", [&] { return generator.applyLocalThreshold(preprocessed, largeBlock); });
+    
+    // Edge-preserving blur: exact filter against the grid, with the grid's
+    // error reported next to the timings
+    cv::Mat gray;
+    cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
+    for (int radius : {3, 6, 12}) {
+        const int d = radius * 2 + 1;
+        const std::string suffix = "_r" + std::to_string(radius);
+        run("bilateral_exact" + suffix, [&] {
+            cv::Mat filtered;
+            cv::bilateralFilter(gray, filtered, d, 75, 75);
+            return filtered;
+        });
+        run("bilateral_grid" + suffix, [&] {
+            cv::Mat filtered;
+            stencil::bilateralGrid(gray, filtered, d, 75, 75);
+            return filtered;
+        });
+        std::cerr << megapixels << " MP: bilateral grid r=" << radius << " PSNR "
+                  << stencil::bilateralGridPsnr(gray, d, 75, 75) << " dB" << std::endl;
+    }
+    
+    // Islands and bridging
+    cv::Mat stencilMat = generator.applySimpleThreshold(preprocessed, params);
+    stencil::IslandTable islands = generator.analyzeIslands(stencilMat);
+    
+    run("island_analysis", [&] { return generator.analyzeIslands(stencilMat); });
+    run("bridging", [&] { return generator.autoBridgeIslands(stencilMat, islands); });
+    
+    // Statistics: the old threshold-and-count passes against one accumulating read
+    run("statistics_count", [&] {
+        cv::Mat binary;
+        cv::threshold(stencilMat, binary, 127, 255, cv::THRESH_BINARY);
+        return cv::countNonZero(binary == 0) + cv::countNonZero(binary == 255);
+    });
+    run("statistics_accumulate", [&] {
+        stencil::PixelStats stats;
+        stencil::writeWithStats(stencilMat, stencilMat, false, stats);
+        return stats.black();
+    });
+    
+    // Mat <-> QImage conversion
+    QImage colorImage = StencilGenerator::cvMatToQImage(image);
+    
+    run("mat_to_qimage_rgb", [&] { return StencilGenerator::cvMatToQImage(image); });
+    run("mat_to_qimage_gray", [&] { return StencilGenerator::cvMatToQImage(stencilMat); });
+    run("qimage_to_mat_rgb", [&] { return StencilGenerator::qImageToCvMat(colorImage); });
+    
+    // Whole pipeline, as run by the worker pool
+    run("generate_stencil", [&] { return generator.generateStencil(params); });
+}
+
+/**
+ * @brief Entry point
+ * @param argc Argument count
+ * @param argv Arguments
+ * @return Exit code
+ */
+int main(int argc, char **argv) {
+    QCoreApplication app(argc, argv);
+    
+    std::vector<double> sizes = {1, 4, 16, 50, 100};
+    bench::RunOptions options;
+    std::string outPath;
+    
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--sizes") {
+            sizes = bench::parseSizes(argv[i + 1]);
+        } else if (arg == "--min-seconds") {
+            options.min_seconds = std::atof(argv[i + 1]);
+        } else if (arg == "--out") {
+            outPath = argv[i + 1];
+        } else {
+            std::cerr << "Unknown option " << arg << std::endl;
+            return 1;
+        }
+    }
+    
+    bench::installCountingMatAllocator();
+    
+    std::ofstream file;
+    if (!outPath.empty()) {
+        file.open(outPath);
+        if (!file.is_open()) {
+            std::cerr << "Cannot write " << outPath << std::endl;
+            return 1;
+        }
+    }
+    std::ostream &out = outPath.empty() ? std::cout : file;
+    
+    for (double megapixels : sizes) {
+        runSize(out, megapixels, options);
+    }
+    return 0;
+}
@@ -9,6 +9,35 @@
 #include <QFileDialog>
 #include <QMessageBox>
 #include <QDebug>
+#include <QPaintEvent>
+
+/**
+ * @brief Scroll area content that paints the visible part of its viewer
+ *
+ * The canvas is as large as the zoomed image but holds no pixels; each
+ * paint event asks the viewer to draw just the exposed rectangle.
+ */
+class ImageCanvas : public QWidget {
+public:
+    explicit ImageCanvas(ImageViewer *viewer)
+        : QWidget(viewer)
+        , viewer_(viewer) {
+        setAttribute(Qt::WA_OpaquePaintEvent);
+    }
+    
+protected:
+    void paintEvent(QPaintEvent *event) override {
+        // Draw the dirty rectangles one by one rather than their bounding
+        // box, so two small crosshair updates stay small
+        QPainter painter(this);
+        for (const QRect &rect : event->region()) {
+            viewer_->paintCanvas(painter, rect);
+        }
+    }
+    
+private:
+    ImageViewer *viewer_;
+};
 
 /**
  * @brief Constructor for ImageViewer
@@ -16,8 +45,9 @@
  */
 ImageViewer::ImageViewer(QWidget *parent)
     : QWidget(parent)
-    , imageLabel_(new QLabel(this))
+    , canvas_(new ImageCanvas(this))
     , scrollArea_(new QScrollArea(this))
+    , pyramid_(new TilePyramid(this))
     , zoomFactor_(1.0)
     , panOffset_(0, 0)
     , isPanning_(false)
@@ -26,6 +56,16 @@ ImageViewer::ImageViewer(QWidget *parent)
     , showCrosshair_(false)
     , backgroundColor_(Qt::darkGray)
     , gridColor_(QColor(80, 80, 80))
+    , gridSpacing_(50)
+    , gridBrushZoom_(0.0)
+    , crosshairVisible_(false)
+    , viewTransform_(nullptr)
+    , applyingTransform_(false)
+    , comparePyramid_(new TilePyramid(this))
+    , compareMode_(COMPARE_OFF)
+    , swipePosition_(0.5)
+    , onionOpacity_(0.5)
+    , isSwiping_(false)
     , rubberBand_(nullptr)
     , isSelecting_(false) {
     
@@ -45,20 +85,20 @@ ImageViewer::~ImageViewer() {
  * @brief Setup the user interface
  */
 void ImageViewer::setupUI() {
-    // Configure scroll area
+    // Configure scroll area; the canvas keeps the zoomed image size
     scrollArea_->setBackgroundRole(QPalette::Dark);
     scrollArea_->setAlignment(Qt::AlignCenter);
-    scrollArea_->setWidget(imageLabel_);
-    scrollArea_->setWidgetResizable(true);
-    
-    // Configure image label
-    imageLabel_->setBackgroundRole(QPalette::Base);
-    imageLabel_->setSizePolicy(QSizePolicy::Ignored, QSizePolicy::Ignored);
-    imageLabel_->setScaledContents(false);
-    imageLabel_->setAlignment(Qt::AlignCenter);
+    scrollArea_->setWidget(canvas_);
+    scrollArea_->setWidgetResizable(false);
+    canvas_->resize(0, 0);
     
     // Set up rubber band for selection
-    rubberBand_ = new QRubberBand(QRubberBand::Rectangle, imageLabel_);
+    rubberBand_ = new QRubberBand(QRubberBand::Rectangle, canvas_);
+    
+    // Hover moves drive the crosshair
+    setMouseTracking(true);
+    scrollArea_->viewport()->setMouseTracking(true);
+    canvas_->setMouseTracking(true);
     
     // Create main layout
     QVBoxLayout *mainLayout = new QVBoxLayout(this);
@@ -125,6 +165,10 @@ void ImageViewer::setupConnections() {
     
     // Connect zoom factor changes
     connect(this, &ImageViewer::zoomChanged, this, &ImageViewer::adjustScrollBars);
+    
+    // Repaint tiles as they finish loading
+    connect(pyramid_, &TilePyramid::tileReady, this, &ImageViewer::onTileReady);
+    connect(comparePyramid_, &TilePyramid::tileReady, this, &ImageViewer::onCompareTileReady);
 }
 
 /**
@@ -138,10 +182,84 @@ void ImageViewer::setImage(const QImage &image) {
     }
     
     currentImage_ = image;
-    currentPixmap_ = QPixmap::fromImage(image);
+    pyramid_->setImage(image);
     
-    updatePixmap();
-    updateView();
+    updateCanvas();
+    if (viewTransform_ && viewTransform_->isValid()) {
+        applyTransform(nullptr);
+    } else {
+        updateView();
+        publishTransform();
+    }
+}
+
+/**
+ * @brief Replace the image, repainting only what changed
+ * @param image New image
+ * @param changed Area that differs from the current image, in image pixels
+ *
+ * Meant for successive results of the same size: the zoom and scroll
+ * position are kept, the pyramid is patched instead of rebuilt, and tiles
+ * outside the changed area are neither re-uploaded nor repainted. Falls
+ * back to setImage() when the image cannot be patched. After
+ * refineImage() has shown a coarse version, the full-size image is the
+ * last refinement step instead.
+ */
+void ImageViewer::updateImage(const QImage &image, const QRegion &changed) {
+    if (!image.isNull() && image.size() == pyramid_->imageSize() && pyramid_->finestLevel() > 0) {
+        refineImage(image, image.size());
+        return;
+    }
+    
+    if (image.isNull() || image.size() != currentImage_.size() ||
+        !pyramid_->updateImage(image, changed)) {
+        setImage(image);
+        return;
+    }
+    
+    currentImage_ = image;
+    for (const QRect &rect : changed) {
+        canvas_->update(imageToCanvas(rect));
+    }
+}
+
+/**
+ * @brief Show a reduced version of an image, or a sharper one than before
+ * @param image Image at fullSize halved some number of times
+ * @param fullSize Size of the full image; zoom and coordinates refer to it
+ *
+ * Meant for results that arrive in steps of doubling resolution. The view
+ * keeps its geometry across the steps, and each step is drawn over the
+ * previous one tile by tile (the coarser tiles stand in until the sharper
+ * ones are cut), so the image sharpens without flashing. An image that is
+ * not a reduction of fullSize is shown with setImage().
+ */
+void ImageViewer::refineImage(const QImage &image, const QSize &fullSize) {
+    const int level = TilePyramid::levelOf(image.size(), fullSize);
+    if (image.isNull() || level < 0) {
+        setImage(image);
+        return;
+    }
+    
+    currentImage_ = image;
+    if (fullSize == pyramid_->imageSize() && pyramid_->refineImage(image, level)) {
+        canvas_->update();
+        return;
+    }
+    
+    // First step, or a step that does not refine what is shown
+    const bool sameSize = fullSize == pyramid_->imageSize();
+    pyramid_->setImage(image, level, fullSize);
+    updateCanvas();
+    if (sameSize) {
+        return;
+    }
+    if (viewTransform_ && viewTransform_->isValid()) {
+        applyTransform(nullptr);
+    } else {
+        updateView();
+        publishTransform();
+    }
 }
 
 /**
@@ -154,10 +272,10 @@ void ImageViewer::setPixmap(const QPixmap &pixmap) {
         return;
     }
     
-    currentPixmap_ = pixmap;
     currentImage_ = pixmap.toImage();
+    pyramid_->setImage(currentImage_);
     
-    updatePixmap();
+    updateCanvas();
     updateView();
 }
 
@@ -166,8 +284,8 @@ void ImageViewer::setPixmap(const QPixmap &pixmap) {
  */
 void ImageViewer::clear() {
     currentImage_ = QImage();
-    currentPixmap_ = QPixmap();
-    imageLabel_->clear();
+    pyramid_->clear();
+    canvas_->resize(0, 0);
     zoomFactor_ = 1.0;
     panOffset_ = QPoint(0, 0);
     
@@ -198,8 +316,8 @@ void ImageViewer::zoomFit() {
     
     int viewerWidth = scrollArea_->viewport()->width();
     int viewerHeight = scrollArea_->viewport()->height();
-    int imageWidth = currentImage_.width();
-    int imageHeight = currentImage_.height();
+    int imageWidth = pyramid_->imageSize().width();
+    int imageHeight = pyramid_->imageSize().height();
     
     if (viewerWidth <= 0 || viewerHeight <= 0 || imageWidth <= 0 || imageHeight <= 0) {
         return;
@@ -228,15 +346,18 @@ void ImageViewer::zoomOriginal() {
  * @param factor Zoom factor (1.0 = 100%)
  */
 void ImageViewer::setZoomFactor(double factor) {
-    factor = qMax(0.1, qMin(10.0, factor)); // Clamp between 10% and 1000%
+    // Clamp between 0.1% and 1000%; the pyramid keeps far zoom-outs cheap,
+    // so gigapixel images can still be fitted to the window
+    factor = qMax(0.001, qMin(10.0, factor));
     
     if (qFuzzyCompare(zoomFactor_, factor)) {
         return;
     }
     
     zoomFactor_ = factor;
-    updatePixmap();
+    updateCanvas();
     emit zoomChanged(zoomFactor_);
+    publishTransform();
 }
 
 /**
@@ -256,12 +377,12 @@ void ImageViewer::pan(const QPoint &delta) {
  * @param pos Position to center on (image coordinates)
  */
 void ImageViewer::centerOn(const QPoint &pos) {
-    QPoint widgetPos = imageToWidget(pos);
     QScrollBar *hBar = scrollArea_->horizontalScrollBar();
     QScrollBar *vBar = scrollArea_->verticalScrollBar();
     
-    int hValue = widgetPos.x() - scrollArea_->viewport()->width() / 2;
-    int vValue = widgetPos.y() - scrollArea_->viewport()->height() / 2;
+    // Scroll values are canvas coordinates of the viewport's top-left
+    int hValue = qRound(pos.x() * zoomFactor_) - scrollArea_->viewport()->width() / 2;
+    int vValue = qRound(pos.y() * zoomFactor_) - scrollArea_->viewport()->height() / 2;
     
     hBar->setValue(hValue);
     vBar->setValue(vValue);
@@ -290,27 +411,6 @@ bool ImageViewer::saveImage(const QString &filePath, const char *format) {
     return currentImage_.save(filePath, format);
 }
 
-/**
- * @brief Paint event handler
- * @param event Paint event
- */
-void ImageViewer::paintEvent(QPaintEvent *event) {
-    QWidget::paintEvent(event);
-    
-    if (showGrid_ || showCrosshair_) {
-        QPainter painter(imageLabel_);
-        painter.setRenderHint(QPainter::Antialiasing);
-        
-        if (showGrid_) {
-            drawGrid(painter);
-        }
-        
-        if (showCrosshair_) {
-            drawCrosshair(painter);
-        }
-    }
-}
-
 /**
  * @brief Resize event handler
  * @param event Resize event
@@ -323,16 +423,17 @@ void ImageViewer::resizeEvent(QResizeEvent *event) {
     } else if (viewMode_ == VIEW_FIT_WIDTH && !currentImage_.isNull()) {
         // Fit width
         int viewerWidth = scrollArea_->viewport()->width();
-        double scale = static_cast<double>(viewerWidth) / currentImage_.width();
+        double scale = static_cast<double>(viewerWidth) / pyramid_->imageSize().width();
         setZoomFactor(scale);
     } else if (viewMode_ == VIEW_FIT_HEIGHT && !currentImage_.isNull()) {
         // Fit height
         int viewerHeight = scrollArea_->viewport()->height();
-        double scale = static_cast<double>(viewerHeight) / currentImage_.height();
+        double scale = static_cast<double>(viewerHeight) / pyramid_->imageSize().height();
         setZoomFactor(scale);
     }
     
     adjustScrollBars();
+    publishTransform();
 }
 
 /**
@@ -350,10 +451,15 @@ void ImageViewer::mousePressEvent(QMouseEvent *event) {
     } else if (event->button() == Qt::LeftButton && event->modifiers() & Qt::ControlModifier) {
         // Start selection
         isSelecting_ = true;
-        rubberBandOrigin_ = imageLabel_->mapFromParent(event->pos());
+        rubberBandOrigin_ = canvas_->mapFrom(this, event->pos());
         rubberBand_->setGeometry(QRect(rubberBandOrigin_, QSize()));
         rubberBand_->show();
         event->accept();
+    } else if (event->button() == Qt::LeftButton &&
+               isNearSwipeLine(canvas_->mapFrom(this, event->pos()))) {
+        // Start dragging the comparison swipe line
+        isSwiping_ = true;
+        event->accept();
     } else if (event->button() == Qt::LeftButton) {
         // Emit click signal
         QPoint imagePos = widgetToImage(event->pos());
@@ -369,16 +475,22 @@ void ImageViewer::mousePressEvent(QMouseEvent *event) {
  * @param event Mouse event
  */
 void ImageViewer::mouseMoveEvent(QMouseEvent *event) {
+    QPoint canvasPos = canvas_->mapFrom(this, event->pos());
+    moveCrosshair(canvasPos, canvas_->rect().contains(canvasPos));
+    
     if (isPanning_) {
         QPoint delta = event->pos() - lastPanPos_;
         pan(delta);
         lastPanPos_ = event->pos();
         event->accept();
     } else if (isSelecting_) {
-        QPoint currentPos = imageLabel_->mapFromParent(event->pos());
+        QPoint currentPos = canvas_->mapFrom(this, event->pos());
         QRect rect = QRect(rubberBandOrigin_, currentPos).normalized();
         rubberBand_->setGeometry(rect);
         event->accept();
+    } else if (isSwiping_) {
+        setSwipePosition(static_cast<double>(canvasPos.x()) / qMax(1, canvas_->width()));
+        event->accept();
     } else {
         // Update cursor
         if (event->buttons() == Qt::NoButton) {
@@ -386,6 +498,8 @@ void ImageViewer::mouseMoveEvent(QMouseEvent *event) {
                 setCursor(Qt::OpenHandCursor);
             } else if (event->modifiers() & Qt::ControlModifier) {
                 setCursor(Qt::CrossCursor);
+            } else if (isNearSwipeLine(canvasPos)) {
+                setCursor(Qt::SplitHCursor);
             } else {
                 setCursor(Qt::ArrowCursor);
             }
@@ -410,6 +524,9 @@ void ImageViewer::mouseReleaseEvent(QMouseEvent *event) {
         isPanning_ = false;
         setCursor(Qt::ArrowCursor);
         event->accept();
+    } else if (event->button() == Qt::LeftButton && isSwiping_) {
+        isSwiping_ = false;
+        event->accept();
     } else if (event->button() == Qt::LeftButton && isSelecting_) {
         // Finish selection
         isSelecting_ = false;
@@ -418,8 +535,8 @@ void ImageViewer::mouseReleaseEvent(QMouseEvent *event) {
         QRect selection = rubberBand_->geometry();
         if (selection.width() > 5 && selection.height() > 5) {
             // Convert selection to image coordinates
-            QPoint topLeft = widgetToImage(rubberBand_->geometry().topLeft());
-            QPoint bottomRight = widgetToImage(rubberBand_->geometry().bottomRight());
+            QPoint topLeft = widgetToImage(canvas_->mapTo(this, selection.topLeft()));
+            QPoint bottomRight = widgetToImage(canvas_->mapTo(this, selection.bottomRight()));
             QRect imageSelection = QRect(topLeft, bottomRight);
             
             // You could emit a selection signal here
@@ -434,6 +551,15 @@ void ImageViewer::mouseReleaseEvent(QMouseEvent *event) {
     QWidget::mouseReleaseEvent(event);
 }
 
+/**
+ * @brief Leave event handler; hides the crosshair
+ * @param event Leave event
+ */
+void ImageViewer::leaveEvent(QEvent *event) {
+    moveCrosshair(crosshairPos_, false);
+    QWidget::leaveEvent(event);
+}
+
 /**
  * @brief Mouse wheel event handler for zooming
  * @param event Wheel event
@@ -477,30 +603,200 @@ void ImageViewer::contextMenuEvent(QContextMenuEvent *event) {
 }
 
 /**
- * @brief Update the displayed pixmap with current zoom
+ * @brief Resize the canvas to the zoomed image and repaint it
+ *
+ * Nothing is scaled here: the canvas only changes size, and its next paint
+ * event draws the exposed tiles at the new zoom.
  */
-void ImageViewer::updatePixmap() {
-    if (currentPixmap_.isNull()) {
-        imageLabel_->clear();
+void ImageViewer::updateCanvas() {
+    if (pyramid_->isNull()) {
+        canvas_->resize(0, 0);
         return;
     }
     
-    QPixmap scaledPixmap;
+    QSize imageSize = pyramid_->imageSize();
+    canvas_->resize(qMax(1, qRound(imageSize.width() * zoomFactor_)),
+                    qMax(1, qRound(imageSize.height() * zoomFactor_)));
+    canvas_->update();
     
-    if (qFuzzyCompare(zoomFactor_, 1.0)) {
-        scaledPixmap = currentPixmap_;
+    // Update scroll bars
+    adjustScrollBars();
+}
+
+/**
+ * @brief Paint part of the canvas
+ * @param painter Painter on the canvas
+ * @param exposed Canvas area to repaint
+ *
+ * Draws the image tiles, then the comparison overlay (left of the swipe
+ * line, or blended over everything), then the grid and crosshair.
+ */
+void ImageViewer::paintCanvas(QPainter &painter, const QRect &exposed) {
+    painter.fillRect(exposed, backgroundColor_);
+    if (pyramid_->isNull()) {
+        return;
+    }
+    
+    const bool comparing = compareMode_ != COMPARE_OFF && !comparePyramid_->isNull();
+    if (comparing && compareMode_ == COMPARE_SWIPE) {
+        // Each side is drawn from one pyramid only
+        const int split = swipeX();
+        const QRect left = exposed.intersected(QRect(0, 0, split, canvas_->height()));
+        const QRect right = exposed.intersected(QRect(split, 0, canvas_->width() - split,
+                                                      canvas_->height()));
+        if (!right.isEmpty()) {
+            painter.save();
+            painter.setClipRect(right);
+            drawTiles(painter, pyramid_, zoomFactor_, right);
+            painter.restore();
+        }
+        if (!left.isEmpty()) {
+            painter.save();
+            painter.setClipRect(left);
+            drawTiles(painter, comparePyramid_, compareZoom(), left);
+            painter.restore();
+        }
     } else {
-        QSize scaledSize = currentPixmap_.size() * zoomFactor_;
-        scaledPixmap = currentPixmap_.scaled(scaledSize, 
-                                            Qt::KeepAspectRatio, 
-                                            Qt::SmoothTransformation);
+        drawTiles(painter, pyramid_, zoomFactor_, exposed);
+        if (comparing) {
+            painter.save();
+            painter.setOpacity(onionOpacity_);
+            drawTiles(painter, comparePyramid_, compareZoom(), exposed);
+            painter.restore();
+        }
     }
     
-    imageLabel_->setPixmap(scaledPixmap);
-    imageLabel_->adjustSize();
+    if (showGrid_) {
+        drawGrid(painter, exposed);
+    }
     
-    // Update scroll bars
-    adjustScrollBars();
+    if (comparing && compareMode_ == COMPARE_SWIPE) {
+        const int split = swipeX();
+        if (exposed.left() <= split + 1 && exposed.right() >= split - 1) {
+            painter.save();
+            painter.setPen(QPen(Qt::white, 2));
+            painter.drawLine(split, exposed.top(), split, exposed.bottom());
+            painter.restore();
+        }
+    }
+    
+    if (showCrosshair_ && crosshairRect(crosshairPos_).intersects(exposed)) {
+        drawCrosshair(painter);
+    }
+}
+
+/**
+ * @brief Draw the exposed tiles of one pyramid
+ * @param painter Painter on the canvas
+ * @param pyramid Pyramid to draw from
+ * @param zoom Canvas pixels per pixel of the pyramid's image
+ * @param exposed Canvas area to draw
+ *
+ * Tiles come from the level nearest the zoom factor. A tile that is not
+ * loaded yet is requested and, meanwhile, stood in for by the matching
+ * part of a cached tile from a coarser level.
+ */
+void ImageViewer::drawTiles(QPainter &painter, TilePyramid *pyramid, double zoom,
+                            const QRect &exposed) {
+    const int level = pyramid->levelForScale(zoom);
+    const double scale = zoom * (1 << level);  // Canvas pixels per level pixel
+    const QSize levelSize = pyramid->levelSize(level);
+    const int tileSize = TilePyramid::TileSize;
+    
+    const int firstColumn = qMax(0, static_cast<int>(exposed.left() / scale) / tileSize);
+    const int lastColumn = qMin((levelSize.width() - 1) / tileSize,
+                                static_cast<int>(exposed.right() / scale) / tileSize);
+    const int firstRow = qMax(0, static_cast<int>(exposed.top() / scale) / tileSize);
+    const int lastRow = qMin((levelSize.height() - 1) / tileSize,
+                             static_cast<int>(exposed.bottom() / scale) / tileSize);
+    
+    // Coarse levels of a progressive result are magnified; smooth them too
+    painter.setRenderHint(QPainter::SmoothPixmapTransform, scale < 1.0 || level > 0);
+    
+    for (int row = firstRow; row <= lastRow; row++) {
+        for (int column = firstColumn; column <= lastColumn; column++) {
+            const QRect source = pyramid->tileRect(level, column, row);
+            const QRect target = tileTarget(level, source, zoom);
+            
+            QPixmap pixmap = pyramid->tile(level, column, row);
+            if (!pixmap.isNull()) {
+                painter.drawPixmap(target, pixmap);
+                continue;
+            }
+            
+            // Stand in with the first coarser level that has this area cached
+            for (int coarser = level + 1; coarser < pyramid->levelCount(); coarser++) {
+                const int factor = 1 << (coarser - level);
+                const int coarseColumn = column / factor;
+                const int coarseRow = row / factor;
+                QPixmap stand = pyramid->cachedTile(coarser, coarseColumn, coarseRow);
+                if (stand.isNull()) {
+                    continue;
+                }
+                const QRectF part(static_cast<double>(source.x()) / factor - coarseColumn * tileSize,
+                                  static_cast<double>(source.y()) / factor - coarseRow * tileSize,
+                                  static_cast<double>(source.width()) / factor,
+                                  static_cast<double>(source.height()) / factor);
+                painter.drawPixmap(QRectF(target), stand, part);
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Canvas rectangle a tile is drawn into
+ * @param level Pyramid level of the tile
+ * @param source Tile area in level pixels
+ * @param zoom Canvas pixels per pixel of the pyramid's image
+ * @return Canvas rectangle; edges are rounded from level coordinates, so
+ *         neighbouring tiles meet without gaps or overlap
+ */
+QRect ImageViewer::tileTarget(int level, const QRect &source, double zoom) const {
+    const double scale = zoom * (1 << level);
+    return QRect(QPoint(qRound(source.left() * scale), qRound(source.top() * scale)),
+                 QPoint(qRound((source.right() + 1) * scale) - 1,
+                        qRound((source.bottom() + 1) * scale) - 1));
+}
+
+/**
+ * @brief Canvas area covering an image rectangle
+ * @param imageRect Rectangle in image pixels
+ * @return Canvas rectangle, grown to whole canvas pixels
+ */
+QRect ImageViewer::imageToCanvas(const QRect &imageRect) const {
+    return QRectF(imageRect.x() * zoomFactor_, imageRect.y() * zoomFactor_,
+                  imageRect.width() * zoomFactor_, imageRect.height() * zoomFactor_)
+        .toAlignedRect()
+        .adjusted(-1, -1, 1, 1);
+}
+
+/**
+ * @brief Repaint the area of a tile that finished loading
+ * @param level Pyramid level of the tile
+ * @param column Tile column
+ * @param row Tile row
+ */
+void ImageViewer::onTileReady(int level, int column, int row) {
+    // Only tiles of the level on screen are drawn (coarser ones only fill in)
+    if (level != pyramid_->levelForScale(zoomFactor_)) {
+        return;
+    }
+    canvas_->update(tileTarget(level, pyramid_->tileRect(level, column, row), zoomFactor_));
+}
+
+/**
+ * @brief Repaint the area of a comparison tile that finished loading
+ * @param level Pyramid level of the tile
+ * @param column Tile column
+ * @param row Tile row
+ */
+void ImageViewer::onCompareTileReady(int level, int column, int row) {
+    if (compareMode_ == COMPARE_OFF || level != comparePyramid_->levelForScale(compareZoom())) {
+        return;
+    }
+    canvas_->update(tileTarget(level, comparePyramid_->tileRect(level, column, row),
+                               compareZoom()));
 }
 
 /**
@@ -513,27 +809,16 @@ QPoint ImageViewer::widgetToImage(const QPoint &widgetPos) const {
         return QPoint();
     }
     
-    // Get position relative to image label
-    QPoint labelPos = imageLabel_->mapFromParent(widgetPos);
-    
-    // Account for label alignment (centered)
-    QRect labelRect = imageLabel_->rect();
-    QSize pixmapSize = imageLabel_->pixmap(Qt::ReturnByValue).size();
-    
-    // Calculate offset if pixmap is smaller than label
-    int xOffset = (labelRect.width() - pixmapSize.width()) / 2;
-    int yOffset = (labelRect.height() - pixmapSize.height()) / 2;
-    
-    // Adjust position relative to pixmap
-    QPoint pixmapPos = labelPos - QPoint(xOffset, yOffset);
+    // The canvas is the zoomed image; the scroll area handles centering
+    QPoint canvasPos = canvas_->mapFrom(this, widgetPos);
     
     // Convert to image coordinates using zoom factor
-    int imageX = qRound(pixmapPos.x() / zoomFactor_);
-    int imageY = qRound(pixmapPos.y() / zoomFactor_);
+    int imageX = qRound(canvasPos.x() / zoomFactor_);
+    int imageY = qRound(canvasPos.y() / zoomFactor_);
     
     // Clamp to image bounds
-    imageX = qBound(0, imageX, currentImage_.width() - 1);
-    imageY = qBound(0, imageY, currentImage_.height() - 1);
+    imageX = qBound(0, imageX, pyramid_->imageSize().width() - 1);
+    imageY = qBound(0, imageY, pyramid_->imageSize().height() - 1);
     
     return QPoint(imageX, imageY);
 }
@@ -548,23 +833,12 @@ QPoint ImageViewer::imageToWidget(const QPoint &imagePos) const {
         return QPoint();
     }
     
-    // Convert from image to pixmap coordinates
-    QPoint pixmapPos = QPoint(imagePos.x() * zoomFactor_, 
-                             imagePos.y() * zoomFactor_);
-    
-    // Get label position
-    QRect labelRect = imageLabel_->rect();
-    QSize pixmapSize = imageLabel_->pixmap(Qt::ReturnByValue).size();
-    
-    // Calculate offset if pixmap is smaller than label
-    int xOffset = (labelRect.width() - pixmapSize.width()) / 2;
-    int yOffset = (labelRect.height() - pixmapSize.height()) / 2;
-    
-    // Convert to label coordinates
-    QPoint labelPos = pixmapPos + QPoint(xOffset, yOffset);
+    // Convert from image to canvas coordinates
+    QPoint canvasPos = QPoint(imagePos.x() * zoomFactor_, 
+                              imagePos.y() * zoomFactor_);
     
     // Convert to widget coordinates
-    return imageLabel_->mapToParent(labelPos);
+    return canvas_->mapTo(this, canvasPos);
 }
 
 /**
@@ -577,8 +851,8 @@ QRect ImageViewer::imageRect() const {
     }
     
     QPoint topLeft = imageToWidget(QPoint(0, 0));
-    QPoint bottomRight = imageToWidget(QPoint(currentImage_.width(), 
-                                             currentImage_.height()));
+    QPoint bottomRight = imageToWidget(QPoint(pyramid_->imageSize().width(), 
+                                             pyramid_->imageSize().height()));
     
     return QRect(topLeft, bottomRight);
 }
@@ -595,8 +869,8 @@ void ImageViewer::adjustScrollBars() {
     QScrollBar *vBar = scrollArea_->verticalScrollBar();
     
     // Calculate maximum scroll values
-    int hMax = qMax(0, imageLabel_->width() - scrollArea_->viewport()->width());
-    int vMax = qMax(0, imageLabel_->height() - scrollArea_->viewport()->height());
+    int hMax = qMax(0, canvas_->width() - scrollArea_->viewport()->width());
+    int vMax = qMax(0, canvas_->height() - scrollArea_->viewport()->height());
     
     hBar->setRange(0, hMax);
     vBar->setRange(0, vMax);
@@ -624,13 +898,13 @@ void ImageViewer::updateView() {
             break;
         case VIEW_FIT_WIDTH: {
             int viewerWidth = scrollArea_->viewport()->width();
-            double scale = static_cast<double>(viewerWidth) / currentImage_.width();
+            double scale = static_cast<double>(viewerWidth) / pyramid_->imageSize().width();
             setZoomFactor(scale);
             break;
         }
         case VIEW_FIT_HEIGHT: {
             int viewerHeight = scrollArea_->viewport()->height();
-            double scale = static_cast<double>(viewerHeight) / currentImage_.height();
+            double scale = static_cast<double>(viewerHeight) / pyramid_->imageSize().height();
             setZoomFactor(scale);
             break;
         }
@@ -639,86 +913,158 @@ void ImageViewer::updateView() {
             break;
     }
     
-    updatePixmap();
+    updateCanvas();
+}
+
+/**
+ * @brief Show or hide the grid overlay
+ * @param show Whether to draw the grid
+ */
+void ImageViewer::setShowGrid(bool show) {
+    if (showGrid_ != show) {
+        showGrid_ = show;
+        canvas_->update();
+    }
+}
+
+/**
+ * @brief Show or hide the crosshair that follows the mouse
+ * @param show Whether to draw the crosshair
+ */
+void ImageViewer::setShowCrosshair(bool show) {
+    if (showCrosshair_ != show) {
+        showCrosshair_ = show;
+        if (crosshairVisible_) {
+            canvas_->update(crosshairRect(crosshairPos_));
+        }
+    }
+}
+
+/**
+ * @brief Set the grid spacing
+ * @param pixels Distance between grid lines in image pixels
+ */
+void ImageViewer::setGridSpacing(int pixels) {
+    pixels = qMax(1, pixels);
+    if (gridSpacing_ != pixels) {
+        gridSpacing_ = pixels;
+        gridBrushZoom_ = 0.0;  // Rebuild the pattern on the next paint
+        if (showGrid_) {
+            canvas_->update();
+        }
+    }
 }
 
 /**
  * @brief Draw grid on image
- * @param painter QPainter to use
+ * @param painter QPainter on the canvas
+ * @param exposed Canvas area being repainted
+ *
+ * The grid is a cached pattern brush, so filling the exposed area costs
+ * the same however many grid lines cross it.
  */
-void ImageViewer::drawGrid(QPainter &painter) {
+void ImageViewer::drawGrid(QPainter &painter, const QRect &exposed) {
     if (currentImage_.isNull() || zoomFactor_ < 0.5) {
         return; // Don't draw grid at low zoom levels
     }
     
-    QRect viewport = scrollArea_->viewport()->rect();
-    QPoint topLeft = widgetToImage(viewport.topLeft());
-    QPoint bottomRight = widgetToImage(viewport.bottomRight());
-    
-    // Calculate grid spacing in image coordinates
-    int gridSpacing = 50; // 50 pixels at 100% zoom
-    
-    // Adjust spacing for zoom level
-    int effectiveSpacing = qMax(1, static_cast<int>(gridSpacing * zoomFactor_));
-    
-    if (effectiveSpacing < 10) {
+    if (gridSpacing_ * zoomFactor_ < 10) {
         return; // Don't draw if grid would be too dense
     }
     
-    // Convert back to widget coordinates for drawing
-    int startX = qMax(0, topLeft.x() / gridSpacing) * gridSpacing;
-    int startY = qMax(0, topLeft.y() / gridSpacing) * gridSpacing;
-    int endX = bottomRight.x();
-    int endY = bottomRight.y();
+    if (gridBrushZoom_ != zoomFactor_) {
+        updateGridBrush();
+    }
     
     painter.save();
-    painter.setPen(QPen(gridColor_, 1, Qt::DotLine));
-    
-    // Draw vertical lines
-    for (int x = startX; x <= endX; x += gridSpacing) {
-        QPoint p1 = imageToWidget(QPoint(x, topLeft.y()));
-        QPoint p2 = imageToWidget(QPoint(x, bottomRight.y()));
-        painter.drawLine(p1, p2);
-    }
+    painter.setRenderHint(QPainter::SmoothPixmapTransform, false);
+    painter.fillRect(exposed.intersected(canvas_->rect()), gridBrush_);
+    painter.restore();
+}
+
+/**
+ * @brief Rebuild the grid pattern for the current zoom factor
+ *
+ * One grid cell is drawn into a pixmap of whole pixels and the brush
+ * transform stretches it to the exact spacing, so the lines stay on image
+ * coordinates across the whole canvas. Stretching rather than shrinking
+ * keeps every 1-pixel line visible.
+ */
+void ImageViewer::updateGridBrush() {
+    const double spacing = gridSpacing_ * zoomFactor_;
+    const int period = qMax(1, static_cast<int>(spacing));
     
-    // Draw horizontal lines
-    for (int y = startY; y <= endY; y += gridSpacing) {
-        QPoint p1 = imageToWidget(QPoint(topLeft.x(), y));
-        QPoint p2 = imageToWidget(QPoint(bottomRight.x(), y));
-        painter.drawLine(p1, p2);
-    }
+    QPixmap cell(period, period);
+    cell.fill(Qt::transparent);
+    QPainter painter(&cell);
+    painter.setPen(QPen(gridColor_, 1, Qt::DotLine));
+    painter.drawLine(0, 0, period - 1, 0);
+    painter.drawLine(0, 0, 0, period - 1);
+    painter.end();
     
-    painter.restore();
+    gridBrush_ = QBrush(cell);
+    gridBrush_.setTransform(QTransform::fromScale(spacing / period, spacing / period));
+    gridBrushZoom_ = zoomFactor_;
 }
 
 /**
- * @brief Draw crosshair on image
- * @param painter QPainter to use
+ * @brief Draw crosshair at the mouse position
+ * @param painter QPainter on the canvas
  */
 void ImageViewer::drawCrosshair(QPainter &painter) {
-    if (currentImage_.isNull()) {
+    if (currentImage_.isNull() || !crosshairVisible_) {
         return;
     }
     
-    QPoint center = widgetToImage(rect().center());
-    QPoint widgetCenter = imageToWidget(center);
+    const QPoint center = crosshairPos_;
     
     painter.save();
+    painter.setRenderHint(QPainter::Antialiasing);
     painter.setPen(QPen(Qt::red, 2));
     
     // Draw crosshair
-    int size = 20;
-    painter.drawLine(widgetCenter.x() - size, widgetCenter.y(), 
-                     widgetCenter.x() + size, widgetCenter.y());
-    painter.drawLine(widgetCenter.x(), widgetCenter.y() - size, 
-                     widgetCenter.x(), widgetCenter.y() + size);
+    int size = CrosshairSize;
+    painter.drawLine(center.x() - size, center.y(), 
+                     center.x() + size, center.y());
+    painter.drawLine(center.x(), center.y() - size, 
+                     center.x(), center.y() + size);
     
     // Draw circle around center
-    painter.drawEllipse(widgetCenter, size / 2, size / 2);
+    painter.drawEllipse(center, size / 2, size / 2);
     
     painter.restore();
 }
 
+/**
+ * @brief Canvas area the crosshair covers
+ * @param center Crosshair position in canvas coordinates
+ * @return Rectangle including the pen width and antialiasing
+ */
+QRect ImageViewer::crosshairRect(const QPoint &center) const {
+    const int reach = CrosshairSize + 2;
+    return QRect(center.x() - reach, center.y() - reach, 2 * reach + 1, 2 * reach + 1);
+}
+
+/**
+ * @brief Move the crosshair, repainting only where it was and where it goes
+ * @param canvasPos New position in canvas coordinates
+ * @param visible Whether the mouse is over the canvas
+ */
+void ImageViewer::moveCrosshair(const QPoint &canvasPos, bool visible) {
+    if (canvasPos == crosshairPos_ && visible == crosshairVisible_) {
+        return;
+    }
+    
+    if (showCrosshair_ && crosshairVisible_) {
+        canvas_->update(crosshairRect(crosshairPos_));
+    }
+    crosshairPos_ = canvasPos;
+    crosshairVisible_ = visible;
+    if (showCrosshair_ && crosshairVisible_) {
+        canvas_->update(crosshairRect(crosshairPos_));
+    }
+}
+
 /**
  * @brief Slot for copying image to clipboard
  */
@@ -780,5 +1126,169 @@ void ImageViewer::updateViewport() {
         QRect imageVisibleRect = QRect(topLeft, bottomRight);
         
         emit viewportChanged(imageVisibleRect);
+        publishTransform();
+    }
+}
+
+/**
+ * @brief Link this viewer's viewport to a shared transform
+ * @param transform Shared transform, or nullptr to unlink
+ *
+ * A viewer joining a transform that is already set follows it; otherwise
+ * it sets the transform from its own view.
+ */
+void ImageViewer::setViewTransform(ViewTransform *transform) {
+    if (viewTransform_ == transform) {
+        return;
+    }
+    
+    if (viewTransform_) {
+        disconnect(viewTransform_, nullptr, this, nullptr);
+    }
+    viewTransform_ = transform;
+    if (!viewTransform_) {
+        return;
+    }
+    
+    connect(viewTransform_, &ViewTransform::changed, this, &ImageViewer::applyTransform);
+    if (viewTransform_->isValid()) {
+        applyTransform(nullptr);
+    } else {
+        publishTransform();
     }
+}
+
+/**
+ * @brief Store this viewer's viewport in the shared transform
+ */
+void ImageViewer::publishTransform() {
+    if (!viewTransform_ || applyingTransform_ || !hasImage()) {
+        return;
+    }
+    
+    // View centre as a fraction of the canvas; a canvas smaller than the
+    // viewport is centred by the scroll area
+    const QSize viewport = scrollArea_->viewport()->size();
+    const QSize canvas = canvas_->size();
+    QPointF center(0.5, 0.5);
+    if (canvas.width() > viewport.width()) {
+        center.setX((scrollArea_->horizontalScrollBar()->value() + viewport.width() / 2.0) /
+                    canvas.width());
+    }
+    if (canvas.height() > viewport.height()) {
+        center.setY((scrollArea_->verticalScrollBar()->value() + viewport.height() / 2.0) /
+                    canvas.height());
+    }
+    
+    viewTransform_->setTransform(zoomFactor_ * pyramid_->imageSize().width(), center, this);
+}
+
+/**
+ * @brief Follow a change of the shared transform
+ * @param source Viewer that made the change; nothing to do if it is this one
+ */
+void ImageViewer::applyTransform(QObject *source) {
+    if (source == this || !viewTransform_ || !viewTransform_->isValid() || !hasImage()) {
+        return;
+    }
+    
+    applyingTransform_ = true;
+    viewMode_ = VIEW_NORMAL;
+    setZoomFactor(viewTransform_->displayWidth() / pyramid_->imageSize().width());
+    
+    const QSize viewport = scrollArea_->viewport()->size();
+    const QPointF center = viewTransform_->center();
+    scrollArea_->horizontalScrollBar()->setValue(
+        qRound(center.x() * canvas_->width() - viewport.width() / 2.0));
+    scrollArea_->verticalScrollBar()->setValue(
+        qRound(center.y() * canvas_->height() - viewport.height() / 2.0));
+    applyingTransform_ = false;
+}
+
+/**
+ * @brief Set the image laid over this one in comparison modes
+ * @param image Overlay image; drawn stretched to this viewer's image size
+ */
+void ImageViewer::setCompareImage(const QImage &image) {
+    if (image.isNull()) {
+        comparePyramid_->clear();
+    } else {
+        comparePyramid_->setImage(image);
+    }
+    if (compareMode_ != COMPARE_OFF) {
+        canvas_->update();
+    }
+}
+
+/**
+ * @brief Choose how the comparison image is shown
+ * @param mode Comparison mode
+ */
+void ImageViewer::setCompareMode(CompareMode mode) {
+    if (compareMode_ != mode) {
+        compareMode_ = mode;
+        isSwiping_ = false;
+        canvas_->update();
+    }
+}
+
+/**
+ * @brief Move the swipe line
+ * @param fraction Position as a fraction of the image width
+ *
+ * Only the strip between the old and new line is repainted.
+ */
+void ImageViewer::setSwipePosition(double fraction) {
+    fraction = qBound(0.0, fraction, 1.0);
+    if (qFuzzyCompare(swipePosition_, fraction)) {
+        return;
+    }
+    
+    const int oldX = swipeX();
+    swipePosition_ = fraction;
+    const int newX = swipeX();
+    if (compareMode_ == COMPARE_SWIPE) {
+        canvas_->update(QRect(qMin(oldX, newX) - 2, 0, qAbs(newX - oldX) + 5, canvas_->height()));
+    }
+}
+
+/**
+ * @brief Set the opacity of the onion skin overlay
+ * @param opacity Overlay opacity, 0..1
+ */
+void ImageViewer::setOnionOpacity(double opacity) {
+    opacity = qBound(0.0, opacity, 1.0);
+    if (!qFuzzyCompare(onionOpacity_, opacity)) {
+        onionOpacity_ = opacity;
+        if (compareMode_ == COMPARE_ONION) {
+            canvas_->update();
+        }
+    }
+}
+
+/**
+ * @brief Zoom at which the comparison image covers the canvas
+ * @return Canvas pixels per comparison image pixel
+ */
+double ImageViewer::compareZoom() const {
+    if (comparePyramid_->isNull() || pyramid_->isNull()) {
+        return zoomFactor_;
+    }
+    return zoomFactor_ * pyramid_->imageSize().width() / comparePyramid_->imageSize().width();
+}
+
+/**
+ * @brief Canvas x coordinate of the swipe line
+ */
+int ImageViewer::swipeX() const {
+    return qRound(swipePosition_ * canvas_->width());
+}
+
+/**
+ * @brief Whether a canvas position is close enough to grab the swipe line
+ * @param canvasPos Position in canvas coordinates
+ */
+bool ImageViewer::isNearSwipeLine(const QPoint &canvasPos) const {
+    return compareMode_ == COMPARE_SWIPE && !comparePyramid_->isNull() &&
+           canvas_->rect().contains(canvasPos) && qAbs(canvasPos.x() - swipeX()) <= 4;
 }
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include <QScrollArea>
 #include <QImage>
 #include <QPixmap>
+#include <QBrush>
 #include <QMouseEvent>
 #include <QWheelEvent>
 #include <QPoint>
@@ -21,9 +22,72 @@
 #include <QCheckBox>
 #include <QSpinBox>
 #include <QDoubleSpinBox>
+#include <QPointF>
+#include "TilePyramid.hpp"
+
+class ImageCanvas;
+
+/**
+ * @brief Viewport shared by linked viewers
+ *
+ * Stored independently of image size: the zoom as the display width of
+ * the whole image and the view centre as a fraction of the image, so a
+ * viewer showing a resized stencil still lines up with its original.
+ */
+class ViewTransform : public QObject {
+    Q_OBJECT
+    
+public:
+    explicit ViewTransform(QObject *parent = nullptr) : QObject(parent) {}
+    
+    bool isValid() const { return displayWidth_ > 0.0; }
+    double displayWidth() const { return displayWidth_; }
+    QPointF center() const { return center_; }
+    
+    /**
+     * @brief Update the shared viewport
+     * @param displayWidth Width of the whole image on screen, in pixels
+     * @param center View centre, 0..1 on both axes
+     * @param source Viewer making the change; it ignores its own update
+     */
+    void setTransform(double displayWidth, const QPointF &center, QObject *source) {
+        if (qFuzzyCompare(displayWidth_, displayWidth) && center_ == center) {
+            return;
+        }
+        displayWidth_ = displayWidth;
+        center_ = center;
+        emit changed(source);
+    }
+    
+    /**
+     * @brief Forget the viewport; the next viewer to show an image sets it
+     */
+    void reset() {
+        displayWidth_ = 0.0;
+        center_ = QPointF(0.5, 0.5);
+    }
+    
+signals:
+    void changed(QObject *source);
+    
+private:
+    double displayWidth_ = 0.0;
+    QPointF center_{0.5, 0.5};
+};
 
 /**
  * @brief Image viewer widget with zoom and pan capabilities
+ *
+ * The image is never scaled as a whole. A TilePyramid is built once per
+ * image and the canvas paints only the tiles it exposes, from the level
+ * nearest the zoom factor, so pan and zoom cost the same for any image
+ * size. Tiles still loading are drawn from a coarser cached level.
+ *
+ * Viewers given the same ViewTransform pan and zoom together. A second
+ * image can be laid over the first for comparison, either split by a
+ * draggable swipe line or blended as an onion skin, and updateImage()
+ * replaces the image while repainting only the area that changed.
+ * refineImage() shows a result that arrives coarse first and sharpens.
  */
 class ImageViewer : public QWidget {
     Q_OBJECT
@@ -35,6 +99,8 @@ public:
     // Image display
     void setImage(const QImage &image);
     void setPixmap(const QPixmap &pixmap);
+    void updateImage(const QImage &image, const QRegion &changed);
+    void refineImage(const QImage &image, const QSize &fullSize);
     void clear();
     
     // Zoom control
@@ -49,6 +115,10 @@ public:
     void pan(const QPoint &delta);
     void centerOn(const QPoint &pos);
     
+    // Linked viewport
+    void setViewTransform(ViewTransform *transform);
+    ViewTransform *viewTransform() const { return viewTransform_; }
+    
     // View modes
     enum ViewMode {
         VIEW_NORMAL,
@@ -59,9 +129,29 @@ public:
     
     void setViewMode(ViewMode mode);
     
+    // Overlays
+    void setShowGrid(bool show);
+    void setShowCrosshair(bool show);
+    void setGridSpacing(int pixels);
+    bool isGridShown() const { return showGrid_; }
+    bool isCrosshairShown() const { return showCrosshair_; }
+    
+    // Comparison overlay
+    enum CompareMode {
+        COMPARE_OFF,
+        COMPARE_SWIPE,    // Overlay left of a draggable vertical line
+        COMPARE_ONION     // Overlay blended over the whole image
+    };
+    
+    void setCompareImage(const QImage &image);
+    void setCompareMode(CompareMode mode);
+    void setSwipePosition(double fraction);
+    void setOnionOpacity(double opacity);
+    CompareMode getCompareMode() const { return compareMode_; }
+    
     // Getters
     QImage getImage() const { return currentImage_; }
-    QPixmap getPixmap() const { return currentPixmap_; }
+    QPixmap getPixmap() const { return QPixmap::fromImage(currentImage_); }
     bool hasImage() const { return !currentImage_.isNull(); }
     
     // Export
@@ -75,22 +165,22 @@ signals:
     void contextMenuRequested(const QPoint &pos);
     
 protected:
-    void paintEvent(QPaintEvent *event) override;
     void resizeEvent(QResizeEvent *event) override;
     void mousePressEvent(QMouseEvent *event) override;
     void mouseMoveEvent(QMouseEvent *event) override;
     void mouseReleaseEvent(QMouseEvent *event) override;
+    void leaveEvent(QEvent *event) override;
     void wheelEvent(QWheelEvent *event) override;
     void contextMenuEvent(QContextMenuEvent *event) override;
     
 private:
     // UI Components
-    QLabel *imageLabel_;
+    ImageCanvas *canvas_;
     QScrollArea *scrollArea_;
     
     // Image data
     QImage currentImage_;
-    QPixmap currentPixmap_;
+    TilePyramid *pyramid_;
     
     // Zoom and pan
     double zoomFactor_;
@@ -104,6 +194,26 @@ private:
     bool showCrosshair_;
     QColor backgroundColor_;
     QColor gridColor_;
+    int gridSpacing_;
+    
+    // Overlay cache: the grid pattern for one zoom level, and where the
+    // crosshair was last drawn (canvas coordinates)
+    QBrush gridBrush_;
+    double gridBrushZoom_;
+    QPoint crosshairPos_;
+    bool crosshairVisible_;
+    static constexpr int CrosshairSize = 20;
+    
+    // Linked viewport
+    ViewTransform *viewTransform_;
+    bool applyingTransform_;
+    
+    // Comparison overlay
+    TilePyramid *comparePyramid_;
+    CompareMode compareMode_;
+    double swipePosition_;     // Fraction of the canvas width
+    double onionOpacity_;
+    bool isSwiping_;
     
     // Tools
     QRubberBand *rubberBand_;
@@ -125,7 +235,11 @@ private:
     void setupConnections();
     
     // Helper functions
-    void updatePixmap();
+    void updateCanvas();
+    void paintCanvas(QPainter &painter, const QRect &exposed);
+    void drawTiles(QPainter &painter, TilePyramid *pyramid, double zoom, const QRect &exposed);
+    QRect tileTarget(int level, const QRect &source, double zoom) const;
+    QRect imageToCanvas(const QRect &imageRect) const;
     QPoint widgetToImage(const QPoint &widgetPos) const;
     QPoint imageToWidget(const QPoint &imagePos) const;
     QRect imageRect() const;
@@ -133,12 +247,29 @@ private:
     void updateView();
     
     // Drawing helpers
-    void drawGrid(QPainter &painter);
+    void drawGrid(QPainter &painter, const QRect &exposed);
     void drawCrosshair(QPainter &painter);
+    void updateGridBrush();
+    QRect crosshairRect(const QPoint &center) const;
+    void moveCrosshair(const QPoint &canvasPos, bool visible);
+    
+    // Comparison helpers
+    double compareZoom() const;
+    int swipeX() const;
+    bool isNearSwipeLine(const QPoint &canvasPos) const;
+    
+    // Linked viewport helpers
+    void publishTransform();
     
 private slots:
     void onCopyImage();
     void onSaveImageAs();
+    void onTileReady(int level, int column, int row);
+    void onCompareTileReady(int level, int column, int row);
+    void applyTransform(QObject *source);
+    void updateViewport();
+    
+    friend class ImageCanvas;
 };
 
 #endif // IMAGEVIEWER_HPP
\ No newline at end of file
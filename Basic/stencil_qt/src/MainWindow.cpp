@@ -2,6 +2,7 @@
 #include <QApplication>
 #include <QFileInfo>
 #include <QDateTime>
+#include <QStandardPaths>
 
 /**
  * @brief MainWindow constructor
@@ -14,6 +15,11 @@ MainWindow::MainWindow(QWidget *parent)
     // Load application settings
     appSettings_ = new QSettings("StencilStudio", "QtStencilGenerator", this);
     
+    // Stencils of images and settings seen before load from disk
+    QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/stencils";
+    stencilGenerator_->setResultCache(
+        std::make_shared<stencil::ResultCache>(cacheDir.toStdString()));
+    
     setupUI();
     loadSettings();
     
@@ -40,6 +46,11 @@ void MainWindow::setupUI() {
     originalViewer_->setViewMode(ImageViewer::VIEW_FIT_WINDOW);
     processedViewer_->setViewMode(ImageViewer::VIEW_FIT_WINDOW);
     
+    // Both viewers pan and zoom together while the views are linked
+    viewTransform_ = new ViewTransform(this);
+    originalViewer_->setViewTransform(viewTransform_);
+    processedViewer_->setViewTransform(viewTransform_);
+    
     // Add viewers to splitter
     mainSplitter_->addWidget(originalViewer_);
     mainSplitter_->addWidget(processedViewer_);
@@ -55,6 +66,15 @@ void MainWindow::setupUI() {
     controlDock_->setAllowedAreas(Qt::LeftDockWidgetArea | Qt::RightDockWidgetArea);
     addDockWidget(Qt::RightDockWidgetArea, controlDock_);
     
+    // Per-stage timings; hidden until asked for
+    performancePanel_ = new PerformancePanel(this);
+    performanceDock_ = new QDockWidget(tr("Performance"), this);
+    performanceDock_->setObjectName("performanceDock");
+    performanceDock_->setWidget(performancePanel_);
+    performanceDock_->setAllowedAreas(Qt::BottomDockWidgetArea | Qt::RightDockWidgetArea);
+    addDockWidget(Qt::BottomDockWidgetArea, performanceDock_);
+    performanceDock_->hide();
+    
     // Setup menu bar and toolbars
     setupMenuBar();
     setupToolBar();
@@ -88,12 +108,21 @@ void MainWindow::setupMenuBar() {
     saveAsAction_->setIcon(QIcon::fromTheme("document-save-as"));
     saveAsAction_->setEnabled(false);
     
+    exportVectorAction_ = new QAction(tr("Export &Vector (SVG/DXF)..."), this);
+    exportVectorAction_->setIcon(QIcon::fromTheme("document-export"));
+    exportVectorAction_->setEnabled(false);
+    
+    exportGcodeAction_ = new QAction(tr("Export &G-code..."), this);
+    exportGcodeAction_->setEnabled(false);
+    
     exitAction_ = new QAction(tr("E&xit"), this);
     exitAction_->setShortcut(QKeySequence::Quit);
     
     fileMenu->addAction(openAction_);
     fileMenu->addAction(saveAction_);
     fileMenu->addAction(saveAsAction_);
+    fileMenu->addAction(exportVectorAction_);
+    fileMenu->addAction(exportGcodeAction_);
     fileMenu->addSeparator();
     fileMenu->addAction(exitAction_);
     
@@ -119,17 +148,56 @@ void MainWindow::setupMenuBar() {
     toggleDockAction_ = controlDock_->toggleViewAction();
     toggleDockAction_->setText(tr("Show &Controls"));
     
+    togglePerformanceAction_ = performanceDock_->toggleViewAction();
+    togglePerformanceAction_->setText(tr("Show &Performance"));
+    
     toggleSideBySideAction_ = new QAction(tr("&Side by Side View"), this);
     toggleSideBySideAction_->setCheckable(true);
     toggleSideBySideAction_->setChecked(true);
     
+    showGridAction_ = new QAction(tr("Show &Grid"), this);
+    showGridAction_->setCheckable(true);
+    showGridAction_->setShortcut(Qt::Key_G);
+    
+    showCrosshairAction_ = new QAction(tr("Show &Crosshair"), this);
+    showCrosshairAction_->setCheckable(true);
+    showCrosshairAction_->setShortcut(Qt::Key_C);
+    
+    linkViewsAction_ = new QAction(tr("&Link Views"), this);
+    linkViewsAction_->setCheckable(true);
+    linkViewsAction_->setChecked(true);
+    linkViewsAction_->setShortcut(Qt::Key_L);
+    
+    // Overlay of the original on the stencil, in the processed viewer
+    compareModeGroup_ = new QActionGroup(this);
+    QMenu *compareMenu = new QMenu(tr("Co&mpare With Original"), this);
+    const QList<QPair<QString, ImageViewer::CompareMode>> compareModes = {
+        {tr("&Off"), ImageViewer::COMPARE_OFF},
+        {tr("&Swipe"), ImageViewer::COMPARE_SWIPE},
+        {tr("O&nion Skin"), ImageViewer::COMPARE_ONION}
+    };
+    for (const auto &mode : compareModes) {
+        QAction *action = compareMenu->addAction(mode.first);
+        action->setCheckable(true);
+        action->setChecked(mode.second == ImageViewer::COMPARE_OFF);
+        action->setData(static_cast<int>(mode.second));
+        compareModeGroup_->addAction(action);
+    }
+    
     viewMenu->addAction(zoomInAction_);
     viewMenu->addAction(zoomOutAction_);
     viewMenu->addAction(zoomFitAction_);
     viewMenu->addAction(zoomOriginalAction_);
     viewMenu->addSeparator();
     viewMenu->addAction(toggleDockAction_);
+    viewMenu->addAction(togglePerformanceAction_);
     viewMenu->addAction(toggleSideBySideAction_);
+    viewMenu->addSeparator();
+    viewMenu->addAction(showGridAction_);
+    viewMenu->addAction(showCrosshairAction_);
+    viewMenu->addSeparator();
+    viewMenu->addAction(linkViewsAction_);
+    viewMenu->addMenu(compareMenu);
     
     // Processing menu
     QMenu *processMenu = menuBar()->addMenu(tr("&Processing"));
@@ -183,6 +251,7 @@ void MainWindow::setupToolBar() {
     modeCombo->addItem(tr("Multi-layer"), QVariant::fromValue(ProcessingMode::MULTI_LAYER));
     modeCombo->addItem(tr("Polygon"), QVariant::fromValue(ProcessingMode::CONTOUR_POLYGON));
     modeCombo->addItem(tr("Detail Preserving"), QVariant::fromValue(ProcessingMode::DETAIL_PRESERVING));
+    modeCombo->addItem(tr("Local Threshold"), QVariant::fromValue(ProcessingMode::LOCAL_THRESHOLD));
     
     connect(modeCombo, QOverload<int>::of(&QComboBox::currentIndexChanged),
             processingWidget_, &ProcessingWidget::onModeChanged);
@@ -212,17 +281,33 @@ void MainWindow::setupConnections() {
     connect(openAction_, &QAction::triggered, this, &MainWindow::onOpenFile);
     connect(saveAction_, &QAction::triggered, this, &MainWindow::onSaveFile);
     connect(saveAsAction_, &QAction::triggered, this, &MainWindow::onSaveAsFile);
+    connect(exportVectorAction_, &QAction::triggered, this, &MainWindow::onExportVector);
+    connect(exportGcodeAction_, &QAction::triggered, this, &MainWindow::onExportGcode);
     connect(exitAction_, &QAction::triggered, this, &MainWindow::onExit);
     
     // View actions
-    connect(zoomInAction_, &QAction::triggered, originalViewer_, &ImageViewer::zoomIn);
-    connect(zoomInAction_, &QAction::triggered, processedViewer_, &ImageViewer::zoomIn);
-    connect(zoomOutAction_, &QAction::triggered, originalViewer_, &ImageViewer::zoomOut);
-    connect(zoomOutAction_, &QAction::triggered, processedViewer_, &ImageViewer::zoomOut);
-    connect(zoomFitAction_, &QAction::triggered, originalViewer_, &ImageViewer::zoomFit);
-    connect(zoomFitAction_, &QAction::triggered, processedViewer_, &ImageViewer::zoomFit);
-    connect(zoomOriginalAction_, &QAction::triggered, originalViewer_, &ImageViewer::zoomOriginal);
-    connect(zoomOriginalAction_, &QAction::triggered, processedViewer_, &ImageViewer::zoomOriginal);
+    connect(zoomInAction_, &QAction::triggered, [this]() { zoomViewers(&ImageViewer::zoomIn); });
+    connect(zoomOutAction_, &QAction::triggered, [this]() { zoomViewers(&ImageViewer::zoomOut); });
+    connect(zoomFitAction_, &QAction::triggered, [this]() { zoomViewers(&ImageViewer::zoomFit); });
+    connect(zoomOriginalAction_, &QAction::triggered,
+            [this]() { zoomViewers(&ImageViewer::zoomOriginal); });
+    connect(showGridAction_, &QAction::toggled, originalViewer_, &ImageViewer::setShowGrid);
+    connect(showGridAction_, &QAction::toggled, processedViewer_, &ImageViewer::setShowGrid);
+    connect(showCrosshairAction_, &QAction::toggled, originalViewer_, &ImageViewer::setShowCrosshair);
+    connect(showCrosshairAction_, &QAction::toggled, processedViewer_, &ImageViewer::setShowCrosshair);
+    
+    connect(linkViewsAction_, &QAction::toggled, [this](bool checked) {
+        // The viewer linked first sets the shared viewport for both
+        viewTransform_->reset();
+        ImageViewer *lead = processedViewer_->hasImage() ? processedViewer_ : originalViewer_;
+        ImageViewer *other = lead == processedViewer_ ? originalViewer_ : processedViewer_;
+        lead->setViewTransform(checked ? viewTransform_ : nullptr);
+        other->setViewTransform(checked ? viewTransform_ : nullptr);
+    });
+    connect(compareModeGroup_, &QActionGroup::triggered, [this](QAction *action) {
+        processedViewer_->setCompareMode(
+            static_cast<ImageViewer::CompareMode>(action->data().toInt()));
+    });
     
     connect(toggleSideBySideAction_, &QAction::toggled, [this](bool checked) {
         if (checked) {
@@ -245,8 +330,12 @@ void MainWindow::setupConnections() {
             this, &MainWindow::onProcessingProgress);
     connect(stencilGenerator_, &StencilGenerator::processingCompleted,
             this, &MainWindow::onProcessingCompleted);
+    connect(stencilGenerator_, &StencilGenerator::stencilRefined,
+            this, &MainWindow::onStencilRefined);
     connect(stencilGenerator_, &StencilGenerator::processingError,
             this, &MainWindow::onProcessingError);
+    connect(stencilGenerator_, &StencilGenerator::livePreviewReady,
+            this, &MainWindow::onLivePreviewReady);
     
     // Live preview timer
     connect(livePreviewTimer_, &QTimer::timeout,
@@ -278,13 +367,18 @@ void MainWindow::onOpenFile() {
         return;
     }
     
+    // Results of jobs on the previous image are no longer wanted
+    stencilGenerator_->cancelPendingJobs();
+    
     // Load the image
     if (stencilGenerator_->loadImage(filePath)) {
         currentFilePath_ = filePath;
         saveDirectory_ = QFileInfo(filePath).absolutePath();
         
-        // Display original image
+        // Display original image; a new image starts from a fitted view
+        viewTransform_->reset();
         originalViewer_->setImage(stencilGenerator_->getOriginalQImage());
+        processedViewer_->setCompareImage(stencilGenerator_->getOriginalQImage());
         
         // Enable actions
         saveAction_->setEnabled(true);
@@ -296,6 +390,7 @@ void MainWindow::onOpenFile() {
         
         // Clear processed viewer
         processedViewer_->clear();
+        shownStencil_ = SharedImage();
         
         // Enable processing
         processingWidget_->setControlsEnabled(true);
@@ -323,14 +418,70 @@ void MainWindow::processImage() {
         return;
     }
     
+    // Runs on the worker pool; large images show coarse stencils in
+    // onStencilRefined() first, the result arrives in onProcessingCompleted()
     StencilParams params = processingWidget_->getCurrentParams();
-    StencilResult result = stencilGenerator_->generateStencil(params);
-    
-    if (result.success) {
-        processedViewer_->setImage(result.fullResolutionImage);
-        updateStatistics(result);
-        statusBar_->showMessage(tr("Stencil generated successfully"), 3000);
-    }
+    lastProcessParams_ = params;
+    stencilGenerator_->generateStencilAsync(params, true);
+}
+
+/**
+ * @brief Generate stencil on request
+ */
+void MainWindow::onProcessRequested() {
+    processImage();
+}
+
+/**
+ * @brief Processing job started
+ */
+void MainWindow::onProcessingStarted() {
+    processingWidget_->onProcessingStarted();
+    statusBar_->showMessage(tr("Generating stencil..."));
+}
+
+/**
+ * @brief Processing job progress (queued from the worker thread)
+ */
+void MainWindow::onProcessingProgress(int percent) {
+    processingWidget_->onProcessingProgress(percent);
+}
+
+/**
+ * @brief Processing job finished
+ */
+void MainWindow::onProcessingCompleted(const StencilResult &result) {
+    processingWidget_->onProcessingCompleted();
+    showStencil(result.stencilImage);
+    lastResult_ = result;
+    exportVectorAction_->setEnabled(true);
+    exportGcodeAction_->setEnabled(true);
+    updateStatistics(result);
+    statusBar_->showMessage(result.fromCache ? tr("Stencil loaded from cache")
+                                             : tr("Stencil generated successfully"), 3000);
+}
+
+/**
+ * @brief Show a coarse stencil while the full-size one is being generated
+ *
+ * The viewer keeps the geometry of the final stencil and sharpens in
+ * place with each step; the final result in onProcessingCompleted() is
+ * the last step. Statistics wait for the final result.
+ */
+void MainWindow::onStencilRefined(const StencilResult &result) {
+    processedViewer_->refineImage(result.stencilImage.toQImage(), result.fullSize);
+    shownStencil_ = result.stencilImage;
+    statusBar_->showMessage(tr("Generating stencil... 1/%1 size in %2 ms")
+                                .arg(1 << result.level)
+                                .arg(result.processingTimeMs, 0, 'f', 0));
+}
+
+/**
+ * @brief Processing job failed
+ */
+void MainWindow::onProcessingError(const QString &error) {
+    processingWidget_->onProcessingError(error);
+    statusBar_->showMessage(tr("Processing failed: %1").arg(error), 5000);
 }
 
 /**
@@ -353,9 +504,51 @@ void MainWindow::onLivePreviewTimer() {
         return;
     }
     
-    StencilResult preview = stencilGenerator_->generateLivePreview(lastPreviewParams_);
-    if (preview.success) {
-        processedViewer_->setImage(preview.previewImage);
+    // Latest wins: requests made while a preview renders replace each other
+    stencilGenerator_->requestLivePreview(lastPreviewParams_);
+}
+
+/**
+ * @brief Show a finished live preview
+ */
+void MainWindow::onLivePreviewReady(const StencilResult &result) {
+    if (livePreviewEnabled_ && result.success) {
+        showStencil(result.previewImage);
+        statusBar_->showMessage(tr("Preview: %1x%2 in %3 ms")
+                                    .arg(result.previewImage.width())
+                                    .arg(result.previewImage.height())
+                                    .arg(result.processingTimeMs, 0, 'f', 1), 1000);
+    }
+}
+
+/**
+ * @brief Show a stencil in the processed viewer
+ * @param stencil Result or preview image
+ *
+ * Consecutive results mostly agree, so the new stencil is diffed against
+ * the one on screen and only the blocks that changed are re-uploaded and
+ * repainted.
+ */
+void MainWindow::showStencil(const SharedImage &stencil) {
+    const QRegion changed = SharedImage::changedRegion(shownStencil_, stencil);
+    processedViewer_->updateImage(stencil.toQImage(), changed);
+    shownStencil_ = stencil;
+}
+
+/**
+ * @brief Apply a zoom action to the viewers
+ * @param zoom ImageViewer zoom function
+ *
+ * Linked viewers follow each other, so only one of them is zoomed
+ * (preferably the one showing the stencil); unlinked ones are zoomed
+ * separately.
+ */
+void MainWindow::zoomViewers(void (ImageViewer::*zoom)()) {
+    ImageViewer *lead = processedViewer_->hasImage() ? processedViewer_ : originalViewer_;
+    ImageViewer *other = lead == processedViewer_ ? originalViewer_ : processedViewer_;
+    (lead->*zoom)();
+    if (!linkViewsAction_->isChecked()) {
+        (other->*zoom)();
     }
 }
 
@@ -410,16 +603,107 @@ void MainWindow::onSaveFile() {
     }
 }
 
+/**
+ * @brief Export the last stencil as SVG or DXF outlines
+ */
+void MainWindow::onExportVector() {
+    if (!lastResult_.success) {
+        QMessageBox::warning(this, tr("No Stencil"),
+            tr("Generate a stencil before exporting vectors."));
+        return;
+    }
+    
+    QString defaultPath;
+    if (!currentFilePath_.isEmpty()) {
+        QFileInfo info(currentFilePath_);
+        defaultPath = info.path() + "/" + info.baseName() + "_stencil.svg";
+    } else {
+        defaultPath = saveDirectory_ + "/stencil.svg";
+    }
+    
+    QString filePath = QFileDialog::getSaveFileName(this,
+        tr("Export Vector Stencil"),
+        defaultPath,
+        tr("SVG files (*.svg);;DXF files (*.dxf)"));
+    
+    if (filePath.isEmpty()) {
+        return;
+    }
+    
+    if (stencilGenerator_->exportVector(lastResult_, filePath, lastProcessParams_.polygonEpsilon)) {
+        statusBar_->showMessage(tr("Vectors exported: %1").arg(filePath), 3000);
+        saveDirectory_ = QFileInfo(filePath).absolutePath();
+    } else {
+        QMessageBox::critical(this, tr("Error"),
+            tr("Failed to export vectors:\n%1").arg(filePath));
+    }
+}
+
+/**
+ * @brief Export the last stencil as G-code toolpaths
+ */
+void MainWindow::onExportGcode() {
+    if (!lastResult_.success) {
+        QMessageBox::warning(this, tr("No Stencil"),
+            tr("Generate a stencil before exporting G-code."));
+        return;
+    }
+    
+    QString defaultPath;
+    if (!currentFilePath_.isEmpty()) {
+        QFileInfo info(currentFilePath_);
+        defaultPath = info.path() + "/" + info.baseName() + "_stencil.gcode";
+    } else {
+        defaultPath = saveDirectory_ + "/stencil.gcode";
+    }
+    
+    QString filePath = QFileDialog::getSaveFileName(this,
+        tr("Export G-code"),
+        defaultPath,
+        tr("G-code files (*.gcode *.nc)"));
+    
+    if (filePath.isEmpty()) {
+        return;
+    }
+    
+    stencil::GcodeOptions options;
+    options.epsilon = lastProcessParams_.polygonEpsilon;
+    
+    stencil::GcodeStats stats;
+    if (stencilGenerator_->exportGcode(lastResult_, filePath, options, &stats)) {
+        statusBar_->showMessage(tr("G-code exported: %1 paths, %2 mm travel, ~%3 min")
+            .arg(stats.paths)
+            .arg(stats.travel_length_mm, 0, 'f', 0)
+            .arg(stats.total_time_s / 60.0, 0, 'f', 1), 5000);
+        saveDirectory_ = QFileInfo(filePath).absolutePath();
+    } else {
+        QMessageBox::critical(this, tr("Error"),
+            tr("Failed to export G-code:\n%1").arg(filePath));
+    }
+}
+
 /**
  * @brief Update statistics display
  */
 void MainWindow::updateStatistics(const StencilResult &result) {
-    QString stats = QString("Black: %1 px | White: %2 px | Islands: %3 | Time: %4 ms")
+    QString stats = QString("Black: %1 px | White: %2 px | Cut area: %3x%4 px | Islands: %5 | "
+                            "Bridges: %6 px | Time: %7 ms")
         .arg(result.blackPixels)
         .arg(result.whitePixels)
+        .arg(result.cutBounds.width)
+        .arg(result.cutBounds.height)
         .arg(result.islandCount)
+        .arg(result.bridgeLength, 0, 'f', 0)
         .arg(result.processingTimeMs, 0, 'f', 1);
     
+    stencil::CacheStats cache = stencilGenerator_->cacheStats();
+    if (cache.hits + cache.misses > 0) {
+        stats += QString(" | Cache: %1 hits, %2 misses%3")
+            .arg(cache.hits)
+            .arg(cache.misses)
+            .arg(result.fromCache ? " (cached)" : "");
+    }
+    
     statsLabel_->setText(stats);
 }
 
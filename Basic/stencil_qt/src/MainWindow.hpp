@@ -10,10 +10,12 @@
 #include <QMessageBox>
 #include <QSettings>
 #include <QTimer>
+#include <QActionGroup>
 
 #include "ImageViewer.hpp"
 #include "ProcessingWidget.hpp"
 #include "StencilGenerator.hpp"
+#include "PerformancePanel.hpp"
 
 /**
  * @brief Main application window
@@ -33,25 +35,35 @@ private:
     StencilGenerator *stencilGenerator_;
     ImageViewer *originalViewer_;
     ImageViewer *processedViewer_;
+    ViewTransform *viewTransform_;
     ProcessingWidget *processingWidget_;
     
     // UI Components
     QToolBar *mainToolBar_;
     QStatusBar *statusBar_;
     QDockWidget *controlDock_;
+    QDockWidget *performanceDock_;
+    PerformancePanel *performancePanel_;
     QSplitter *mainSplitter_;
     
     // Actions
     QAction *openAction_;
     QAction *saveAction_;
     QAction *saveAsAction_;
+    QAction *exportVectorAction_;
+    QAction *exportGcodeAction_;
     QAction *exitAction_;
     QAction *zoomInAction_;
     QAction *zoomOutAction_;
     QAction *zoomFitAction_;
     QAction *zoomOriginalAction_;
     QAction *toggleDockAction_;
+    QAction *togglePerformanceAction_;
     QAction *toggleSideBySideAction_;
+    QAction *showGridAction_;
+    QAction *showCrosshairAction_;
+    QAction *linkViewsAction_;
+    QActionGroup *compareModeGroup_;
     QAction *aboutAction_;
     QAction *aboutQtAction_;
     
@@ -60,6 +72,13 @@ private:
     bool livePreviewEnabled_;
     StencilParams lastPreviewParams_;
     
+    // Last completed stencil and the parameters it was requested with
+    StencilResult lastResult_;
+    StencilParams lastProcessParams_;
+    
+    // Stencil on screen in the processed viewer, diffed against the next one
+    SharedImage shownStencil_;
+    
     // Application state
     QString currentFilePath_;
     QString saveDirectory_;
@@ -84,6 +103,8 @@ private:
     void updateStatistics(const StencilResult &result);
     bool confirmUnsavedChanges();
     void showImageInfo(const QImage &image);
+    void showStencil(const SharedImage &stencil);
+    void zoomViewers(void (ImageViewer::*zoom)());
     
     // Processing
     void processImage();
@@ -94,6 +115,8 @@ private slots:
     void onOpenFile();
     void onSaveFile();
     void onSaveAsFile();
+    void onExportVector();
+    void onExportGcode();
     void onExit();
     
     // View operations
@@ -110,7 +133,9 @@ private slots:
     void onProcessingStarted();
     void onProcessingProgress(int percent);
     void onProcessingCompleted(const StencilResult &result);
+    void onStencilRefined(const StencilResult &result);
     void onProcessingError(const QString &error);
+    void onLivePreviewReady(const StencilResult &result);
     
     // Help
     void onAbout();
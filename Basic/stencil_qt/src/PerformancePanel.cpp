@@ -0,0 +1,195 @@
+#include "PerformancePanel.hpp"
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QFileDialog>
+#include <QMessageBox>
+#include <QDir>
+#include <QHash>
+#include <QSet>
+#include <QShowEvent>
+#include <QHideEvent>
+#include <algorithm>
+
+namespace {
+
+/**
+ * @brief Totals of one stage over all its spans
+ */
+struct StageTotals {
+    int calls = 0;
+    qint64 totalNs = 0;
+    qint64 maxNs = 0;
+    qint64 bytes = 0;
+    qint64 allocations = 0;
+};
+
+QString milliseconds(qint64 ns) {
+    return QString::number(ns / 1.0e6, 'f', 2);
+}
+
+} // namespace
+
+/**
+ * @brief Constructor for PerformancePanel
+ * @param parent Parent widget
+ */
+PerformancePanel::PerformancePanel(QWidget *parent)
+    : QWidget(parent) {
+    recordButton_ = new QPushButton(tr("Record"), this);
+    recordButton_->setCheckable(true);
+    recordButton_->setChecked(StageTrace::isEnabled());
+    recordButton_->setToolTip(tr("Trace every pipeline stage on every thread"));
+    
+    clearButton_ = new QPushButton(tr("Clear"), this);
+    exportButton_ = new QPushButton(tr("Export Chrome Trace..."), this);
+    exportButton_->setToolTip(tr("Timeline for chrome://tracing, Perfetto or speedscope"));
+    summaryLabel_ = new QLabel(this);
+    
+    stageTree_ = new QTreeWidget(this);
+    stageTree_->setRootIsDecorated(false);
+    stageTree_->setUniformRowHeights(true);
+    stageTree_->setHeaderLabels({tr("Stage"), tr("Calls"), tr("Total (ms)"), tr("Mean (ms)"),
+                                 tr("Max (ms)"), tr("MB touched"), tr("Mat allocs")});
+    stageTree_->header()->setSectionResizeMode(QHeaderView::ResizeToContents);
+    
+    QHBoxLayout *buttons = new QHBoxLayout;
+    buttons->addWidget(recordButton_);
+    buttons->addWidget(clearButton_);
+    buttons->addWidget(exportButton_);
+    buttons->addStretch();
+    buttons->addWidget(summaryLabel_);
+    
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addLayout(buttons);
+    layout->addWidget(stageTree_);
+    
+    refreshTimer_ = new QTimer(this);
+    refreshTimer_->setInterval(kRefreshIntervalMs);
+    
+    connect(recordButton_, &QPushButton::toggled, this, &PerformancePanel::setRecording);
+    connect(clearButton_, &QPushButton::clicked, this, &PerformancePanel::clearTrace);
+    connect(exportButton_, &QPushButton::clicked, this, &PerformancePanel::exportTrace);
+    connect(refreshTimer_, &QTimer::timeout, this, &PerformancePanel::refresh);
+    
+    refresh();
+}
+
+/**
+ * @brief Rebuild the stage table from the current trace
+ *
+ * Stages are listed in the order they first ran, which follows the
+ * pipeline; nested stages are indented by their depth.
+ */
+void PerformancePanel::refresh() {
+    const QVector<TraceSpan> spans = StageTrace::snapshot();
+    
+    QStringList order;
+    QHash<QString, StageTotals> totals;
+    QHash<QString, int> depths;
+    QSet<int> threads;
+    for (const TraceSpan &span : spans) {
+        const QString name = QString::fromLatin1(span.name);
+        if (!totals.contains(name)) {
+            order.append(name);
+            depths[name] = span.depth;
+        }
+        StageTotals &stage = totals[name];
+        stage.calls++;
+        stage.totalNs += span.durationNs;
+        stage.maxNs = std::max(stage.maxNs, span.durationNs);
+        stage.bytes += span.bytes;
+        stage.allocations += span.allocations;
+        threads.insert(span.threadId);
+    }
+    
+    stageTree_->clear();
+    for (const QString &name : order) {
+        const StageTotals &stage = totals[name];
+        QTreeWidgetItem *item = new QTreeWidgetItem(stageTree_);
+        item->setText(0, QString(depths[name] * 2, QLatin1Char(' ')) + name);
+        item->setText(1, QString::number(stage.calls));
+        item->setText(2, milliseconds(stage.totalNs));
+        item->setText(3, milliseconds(stage.totalNs / stage.calls));
+        item->setText(4, milliseconds(stage.maxNs));
+        item->setText(5, QString::number(stage.bytes / (1024.0 * 1024.0), 'f', 1));
+        item->setText(6, QString::number(stage.allocations));
+        for (int column = 1; column < stageTree_->columnCount(); column++) {
+            item->setTextAlignment(column, Qt::AlignRight | Qt::AlignVCenter);
+        }
+    }
+    
+    summaryLabel_->setText(tr("%1 spans on %2 threads").arg(spans.size()).arg(threads.size()));
+}
+
+/**
+ * @brief Start or stop tracing
+ * @param recording New state
+ */
+void PerformancePanel::setRecording(bool recording) {
+    StageTrace::setEnabled(recording);
+    if (recordButton_->isChecked() != recording) {
+        recordButton_->setChecked(recording);
+    }
+    updateTimer();
+    refresh();
+}
+
+/**
+ * @brief Drop the spans recorded so far
+ */
+void PerformancePanel::clearTrace() {
+    StageTrace::clear();
+    refresh();
+}
+
+/**
+ * @brief Save the trace as Chrome trace JSON
+ */
+void PerformancePanel::exportTrace() {
+    QString filePath = QFileDialog::getSaveFileName(
+        this,
+        tr("Export Chrome Trace"),
+        QDir::homePath() + "/stencil_trace.json",
+        tr("Chrome Trace (*.json);;All Files (*)")
+    );
+    
+    if (filePath.isEmpty()) {
+        return;
+    }
+    
+    if (!StageTrace::writeChromeTrace(filePath)) {
+        QMessageBox::critical(this, tr("Error"),
+            tr("Failed to export trace:\n%1").arg(filePath));
+    }
+}
+
+/**
+ * @brief Refresh periodically while shown
+ * @param event Show event
+ */
+void PerformancePanel::showEvent(QShowEvent *event) {
+    QWidget::showEvent(event);
+    updateTimer();
+    refresh();
+}
+
+/**
+ * @brief Stop refreshing while hidden
+ * @param event Hide event
+ */
+void PerformancePanel::hideEvent(QHideEvent *event) {
+    QWidget::hideEvent(event);
+    updateTimer();
+}
+
+/**
+ * @brief Run the refresh timer only while visible and recording
+ */
+void PerformancePanel::updateTimer() {
+    if (isVisible() && StageTrace::isEnabled()) {
+        refreshTimer_->start();
+    } else {
+        refreshTimer_->stop();
+    }
+}
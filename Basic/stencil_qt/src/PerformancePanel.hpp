@@ -0,0 +1,49 @@
+#ifndef PERFORMANCEPANEL_HPP
+#define PERFORMANCEPANEL_HPP
+
+#include <QWidget>
+#include <QTreeWidget>
+#include <QPushButton>
+#include <QLabel>
+#include <QTimer>
+
+#include "StageTrace.hpp"
+
+/**
+ * @brief Per-stage timing table over the StageTrace spans
+ *
+ * Spans are grouped by stage name: call count, total, mean and worst time,
+ * bytes touched and Mat allocations. The table refreshes on a timer while
+ * the panel is visible and recording. The raw spans can be exported as a
+ * Chrome trace for a timeline (flame chart) per thread.
+ */
+class PerformancePanel : public QWidget {
+    Q_OBJECT
+
+public:
+    explicit PerformancePanel(QWidget *parent = nullptr);
+
+public slots:
+    void refresh();
+    void setRecording(bool recording);
+    void clearTrace();
+    void exportTrace();
+
+protected:
+    void showEvent(QShowEvent *event) override;
+    void hideEvent(QHideEvent *event) override;
+
+private:
+    QPushButton *recordButton_;
+    QPushButton *clearButton_;
+    QPushButton *exportButton_;
+    QLabel *summaryLabel_;
+    QTreeWidget *stageTree_;
+    QTimer *refreshTimer_;
+    
+    static constexpr int kRefreshIntervalMs = 500;
+    
+    void updateTimer();
+};
+
+#endif // PERFORMANCEPANEL_HPP
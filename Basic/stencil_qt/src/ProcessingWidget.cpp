@@ -352,12 +352,42 @@ void ProcessingWidget::createAdaptiveTab() {
     adaptiveGroup_->setLayout(gridLayout);
     layout->addWidget(adaptiveGroup_);
     
+    // Local statistics threshold group; any method but Gaussian switches
+    // the tab to LOCAL_THRESHOLD
+    localGroup_ = new QGroupBox(tr("Local Statistics"), adaptiveTab);
+    QFormLayout *localLayout = new QFormLayout(localGroup_);
+    
+    localMethodCombo_ = new QComboBox(localGroup_);
+    localMethodCombo_->addItem(tr("Gaussian (above)"));
+    localMethodCombo_->addItem(tr("Mean"));
+    localMethodCombo_->addItem(tr("Niblack"));
+    localMethodCombo_->addItem(tr("Sauvola"));
+    localLayout->addRow(tr("Method:"), localMethodCombo_);
+    
+    localBlockSpin_ = new QSpinBox(localGroup_);
+    localBlockSpin_->setRange(3, 1001);
+    localBlockSpin_->setValue(51);
+    localBlockSpin_->setSingleStep(2);
+    localBlockSpin_->setSuffix(" px");
+    localLayout->addRow(tr("Block Size:"), localBlockSpin_);
+    
+    localKSpin_ = new QDoubleSpinBox(localGroup_);
+    localKSpin_->setRange(-1.0, 1.0);
+    localKSpin_->setSingleStep(0.05);
+    localKSpin_->setValue(0.2);
+    localLayout->addRow(tr("k:"), localKSpin_);
+    
+    layout->addWidget(localGroup_);
+    
     // Add information label
     QLabel *infoLabel = new QLabel(
         tr("<b>Adaptive Threshold:</b> Automatically adjusts threshold value for "
            "different regions of the image. Useful for images with uneven lighting "
            "or shadows. Block size determines neighborhood size, C constant "
-           "subtracts from the mean."),
+           "subtracts from the mean.<br><b>Local Statistics:</b> Mean, Niblack and "
+           "Sauvola run in the same time for any block size, so blocks of several "
+           "hundred pixels can even out lighting on large scans. Sauvola (k = 0.2) "
+           "suits photographed artwork; Niblack usually wants a negative k."),
         adaptiveTab);
     infoLabel->setWordWrap(true);
     infoLabel->setStyleSheet("QLabel { background-color: #2A2A2A; padding: 8px; border-radius: 4px; }");
@@ -464,6 +494,11 @@ void ProcessingWidget::createMultiLayerTab() {
     gridLayout->addWidget(layerCountSlider_, 0, 1);
     gridLayout->addWidget(layerCountSpin_, 0, 2);
     
+    // Band placement
+    equalizeLayersCheck_ = new QCheckBox(tr("Equalize layers (equal area per layer)"), multiLayerGroup_);
+    equalizeLayersCheck_->setChecked(false);
+    gridLayout->addWidget(equalizeLayersCheck_, 1, 0, 1, 3);
+    
     multiLayerGroup_->setLayout(gridLayout);
     layout->addWidget(multiLayerGroup_);
     
@@ -587,9 +622,19 @@ void ProcessingWidget::setupConnections() {
     connect(adaptiveCSlider_, &QSlider::valueChanged, adaptiveCSpin_, &QSpinBox::setValue);
     connect(adaptiveCSpin_, QOverload<int>::of(&QSpinBox::valueChanged), adaptiveCSlider_, &QSlider::setValue);
     
+    // Local threshold controls
+    connect(localMethodCombo_, QOverload<int>::of(&QComboBox::currentIndexChanged),
+            this, &ProcessingWidget::onLocalThresholdChanged);
+    connect(localBlockSpin_, QOverload<int>::of(&QSpinBox::valueChanged),
+            this, &ProcessingWidget::onLocalThresholdChanged);
+    connect(localKSpin_, QOverload<double>::of(&QDoubleSpinBox::valueChanged),
+            this, &ProcessingWidget::onLocalThresholdChanged);
+    
     // Multi-layer controls
     connect(layerCountSlider_, &QSlider::valueChanged, layerCountSpin_, &QSpinBox::setValue);
     connect(layerCountSpin_, QOverload<int>::of(&QSpinBox::valueChanged), layerCountSlider_, &QSlider::setValue);
+    connect(layerCountSlider_, &QSlider::valueChanged, this, &ProcessingWidget::onMultiLayerChanged);
+    connect(equalizeLayersCheck_, &QCheckBox::toggled, this, &ProcessingWidget::onMultiLayerChanged);
     
     // Connect value changes to parameter updates
     connect(thresholdSlider_, &QSlider::valueChanged, this, &ProcessingWidget::onThresholdChanged);
@@ -749,7 +794,10 @@ void ProcessingWidget::updateParamsFromUI() {
     switch (tabIndex) {
         case 0: currentParams_.mode = ProcessingMode::SIMPLE_THRESHOLD; break;
         case 1: currentParams_.mode = ProcessingMode::EDGE_DETECTION; break;
-        case 2: currentParams_.mode = ProcessingMode::ADAPTIVE_THRESHOLD; break;
+        case 2:
+            currentParams_.mode = localMethodCombo_->currentIndex() > 0 ? ProcessingMode::LOCAL_THRESHOLD
+                                                                        : ProcessingMode::ADAPTIVE_THRESHOLD;
+            break;
         case 3: currentParams_.mode = ProcessingMode::CONTOUR_POLYGON; break;
         case 4: currentParams_.mode = ProcessingMode::MULTI_LAYER; break;
         case 5: currentParams_.mode = ProcessingMode::DETAIL_PRESERVING; break;
@@ -772,12 +820,20 @@ void ProcessingWidget::updateParamsFromUI() {
     currentParams_.adaptiveBlockSize = adaptiveBlockSlider_->value();
     currentParams_.adaptiveC = adaptiveCSpin_->value();
     
+    // Local threshold parameters (combo index 0 is the Gaussian method)
+    if (localMethodCombo_->currentIndex() > 0) {
+        currentParams_.localMethod = static_cast<stencil::LocalMethod>(localMethodCombo_->currentIndex() - 1);
+    }
+    currentParams_.localBlockSize = localBlockSpin_->value();
+    currentParams_.localK = localKSpin_->value();
+    
     // Polygon parameters
     currentParams_.polygonEpsilon = polygonEpsilonSpin_->value();
     currentParams_.minContourArea = minContourAreaSpin_->value();
     
     // Multi-layer parameters
     currentParams_.layerCount = layerCountSlider_->value();
+    currentParams_.equalizeLayers = equalizeLayersCheck_->isChecked();
     
     // Output parameters
     currentParams_.outputWidth = widthSpin_->value();
@@ -798,6 +854,7 @@ void ProcessingWidget::updateUIFromParams() {
         case ProcessingMode::CONTOUR_POLYGON: tabIndex = 3; break;
         case ProcessingMode::MULTI_LAYER: tabIndex = 4; break;
         case ProcessingMode::DETAIL_PRESERVING: tabIndex = 0; break; // Default to basic
+        case ProcessingMode::LOCAL_THRESHOLD: tabIndex = 2; break;
     }
     modeTabs_->setCurrentIndex(tabIndex);
     
@@ -818,12 +875,19 @@ void ProcessingWidget::updateUIFromParams() {
     adaptiveBlockSlider_->setValue(currentParams_.adaptiveBlockSize);
     adaptiveCSpin_->setValue(currentParams_.adaptiveC);
     
+    // Local threshold parameters
+    localMethodCombo_->setCurrentIndex(currentParams_.mode == ProcessingMode::LOCAL_THRESHOLD
+                                           ? static_cast<int>(currentParams_.localMethod) + 1 : 0);
+    localBlockSpin_->setValue(currentParams_.localBlockSize);
+    localKSpin_->setValue(currentParams_.localK);
+    
     // Polygon parameters
     polygonEpsilonSpin_->setValue(currentParams_.polygonEpsilon);
     minContourAreaSpin_->setValue(currentParams_.minContourArea);
     
     // Multi-layer parameters
     layerCountSlider_->setValue(currentParams_.layerCount);
+    equalizeLayersCheck_->setChecked(currentParams_.equalizeLayers);
     
     // Output parameters
     widthSpin_->setValue(currentParams_.outputWidth);
@@ -891,6 +955,22 @@ void ProcessingWidget::onInvertToggled(bool checked) {
     emit paramsChanged(currentParams_);
 }
 
+/**
+ * @brief Slot for multi-layer control changes
+ */
+void ProcessingWidget::onMultiLayerChanged() {
+    updateParamsFromUI();
+    emit paramsChanged(currentParams_);
+}
+
+/**
+ * @brief Slot for local threshold control changes
+ */
+void ProcessingWidget::onLocalThresholdChanged() {
+    updateParamsFromUI();
+    emit paramsChanged(currentParams_);
+}
+
 /**
  * @brief Slot for process button click
  */
@@ -1001,9 +1081,13 @@ void ProcessingWidget::savePresetToFile(const QString &name, const StencilParams
     json["edgeKernelSize"] = params.edgeKernelSize;
     json["adaptiveBlockSize"] = params.adaptiveBlockSize;
     json["adaptiveC"] = params.adaptiveC;
+    json["localMethod"] = static_cast<int>(params.localMethod);
+    json["localBlockSize"] = params.localBlockSize;
+    json["localK"] = params.localK;
     json["polygonEpsilon"] = params.polygonEpsilon;
     json["minContourArea"] = params.minContourArea;
     json["layerCount"] = params.layerCount;
+    json["equalizeLayers"] = params.equalizeLayers;
     json["outputWidth"] = params.outputWidth;
     json["outputHeight"] = params.outputHeight;
     json["maintainAspectRatio"] = params.maintainAspectRatio;
@@ -1052,9 +1136,15 @@ StencilParams ProcessingWidget::loadPresetFromFile(const QString &name) {
             params.edgeKernelSize = json["edgeKernelSize"].toInt();
             params.adaptiveBlockSize = json["adaptiveBlockSize"].toInt();
             params.adaptiveC = json["adaptiveC"].toInt();
+            params.localMethod = static_cast<stencil::LocalMethod>(
+                json["localMethod"].toInt(static_cast<int>(params.localMethod)));
+            params.localBlockSize = json["localBlockSize"].toInt(params.localBlockSize);
+            params.localK = json["localK"].toDouble(params.localK);
             params.polygonEpsilon = json["polygonEpsilon"].toDouble();
             params.minContourArea = json["minContourArea"].toInt();
-            params.layerCount = json["layerCount"].toInt();
+            // Same range as the layer slider; the file may be hand-edited
+            params.layerCount = qBound(2, json["layerCount"].toInt(params.layerCount), 8);
+            params.equalizeLayers = json["equalizeLayers"].toBool();
             params.outputWidth = json["outputWidth"].toInt();
             params.outputHeight = json["outputHeight"].toInt();
             params.maintainAspectRatio = json["maintainAspectRatio"].toBool();
@@ -95,6 +95,12 @@ private:
     QSlider *adaptiveCSlider_;
     QSpinBox *adaptiveCSpin_;
     
+    // Local threshold controls (share the adaptive tab)
+    QGroupBox *localGroup_;
+    QComboBox *localMethodCombo_;
+    QSpinBox *localBlockSpin_;
+    QDoubleSpinBox *localKSpin_;
+    
     // Polygon controls
     QGroupBox *polygonGroup_;
     QDoubleSpinBox *polygonEpsilonSpin_;
@@ -104,6 +110,7 @@ private:
     QGroupBox *multiLayerGroup_;
     QSlider *layerCountSlider_;
     QSpinBox *layerCountSpin_;
+    QCheckBox *equalizeLayersCheck_;
     
     // Output controls
     QGroupBox *outputGroup_;
@@ -150,6 +157,8 @@ private slots:
     void onBrightnessChanged(double value);
     void onBlurChanged(int value);
     void onInvertToggled(bool checked);
+    void onMultiLayerChanged();
+    void onLocalThresholdChanged();
     void onProcessClicked();
     void onSaveClicked();
     void onResetClicked();
@@ -0,0 +1,227 @@
+#include "SharedImage.hpp"
+#include "StageTrace.hpp"
+#include <QtGlobal>
+#include <cstring>
+
+namespace {
+
+/**
+ * @brief QImage cleanup function releasing the wrapped Mat reference
+ * @param info Heap-allocated cv::Mat header created by toQImage()
+ */
+void releaseMat(void *info) {
+    delete static_cast<cv::Mat *>(info);
+}
+
+} // namespace
+
+/**
+ * @brief Share an OpenCV Mat (no pixel copy for 8-bit data)
+ * @param mat Image to share; other depths are converted to 8-bit once
+ * @param order Channel order of 3- and 4-channel data
+ */
+SharedImage::SharedImage(const cv::Mat &mat, ChannelOrder order)
+    : order_(order) {
+    if (mat.empty() || mat.depth() == CV_8U) {
+        mat_ = mat;
+    } else {
+        mat.convertTo(mat_, CV_8UC(mat.channels()));
+    }
+}
+
+/**
+ * @brief Share a QImage's pixels as a cv::Mat
+ * @param image Source image
+ * @return SharedImage viewing the QImage buffer
+ *
+ * Formats OpenCV can read directly are wrapped without copying; the
+ * SharedImage keeps the QImage alive, so mat() stays valid for as long as
+ * the SharedImage (or a copy of it) exists. Other formats are converted
+ * once to RGB888 or RGBA8888.
+ */
+SharedImage SharedImage::fromQImage(const QImage &image) {
+    SharedImage shared;
+    if (image.isNull()) {
+        return shared;
+    }
+    
+    QImage source = image;
+    int type = -1;
+    switch (source.format()) {
+        case QImage::Format_Grayscale8:
+            type = CV_8UC1;
+            break;
+        case QImage::Format_RGB888:
+            type = CV_8UC3;
+            break;
+        case QImage::Format_BGR888:
+            type = CV_8UC3;
+            shared.order_ = ChannelOrder::BGR;
+            break;
+        case QImage::Format_RGBA8888:
+        case QImage::Format_RGBX8888:
+            type = CV_8UC4;
+            break;
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+        case QImage::Format_ARGB32:
+        case QImage::Format_RGB32:
+            // 0xAARRGGBB words are B, G, R, A bytes in memory
+            type = CV_8UC4;
+            shared.order_ = ChannelOrder::BGR;
+            break;
+#endif
+        default:
+            source = image.convertToFormat(image.hasAlphaChannel() ? QImage::Format_RGBA8888
+                                                                   : QImage::Format_RGB888);
+            type = image.hasAlphaChannel() ? CV_8UC4 : CV_8UC3;
+            break;
+    }
+    
+    // constBits() does not detach, so the buffer stays shared with the caller
+    shared.owner_ = source;
+    shared.mat_ = cv::Mat(source.height(), source.width(), type,
+                          const_cast<uchar *>(source.constBits()),
+                          static_cast<size_t>(source.bytesPerLine()));
+    return shared;
+}
+
+/**
+ * @brief Get a QImage view of the pixels
+ * @return Read-only QImage sharing the buffer
+ *
+ * The QImage holds its own reference to the Mat, so it remains valid after
+ * this SharedImage is gone. Qt copies the data only if the QImage is
+ * written to.
+ */
+QImage SharedImage::toQImage() const {
+    if (mat_.empty()) {
+        return QImage();
+    }
+    if (!owner_.isNull()) {
+        return owner_;
+    }
+    
+    // Zero-copy unless the channels need a swizzle (then nested below)
+    TraceScope trace("mat_to_qimage");
+    QImage::Format format = qtFormat(mat_.type(), order_);
+    if (format == QImage::Format_Invalid) {
+        if (order_ == ChannelOrder::RGB) {
+            return QImage();  // Unsupported channel count
+        }
+        // No matching Qt format on this platform: swizzle once
+        return SharedImage(toMat(ChannelOrder::RGB), ChannelOrder::RGB).toQImage();
+    }
+    
+    cv::Mat *reference = new cv::Mat(mat_);
+    return QImage(static_cast<const uchar *>(reference->data), reference->cols, reference->rows,
+                  static_cast<qsizetype>(reference->step), format, releaseMat, reference);
+}
+
+/**
+ * @brief Get the pixels in a given channel order
+ * @param order Requested channel order
+ * @return The shared Mat when the order already matches, otherwise a swizzled copy
+ */
+cv::Mat SharedImage::toMat(ChannelOrder order) const {
+    if (order == order_ || mat_.channels() == 1 || mat_.empty()) {
+        return mat_;
+    }
+    
+    // RGB<->BGR and RGBA<->BGRA are their own inverses
+    cv::Mat swizzled;
+    cv::cvtColor(mat_, swizzled, mat_.channels() == 4 ? cv::COLOR_RGBA2BGRA : cv::COLOR_RGB2BGR);
+    return swizzled;
+}
+
+/**
+ * @brief Find where two images differ
+ * @param before Image currently shown
+ * @param after Image replacing it
+ * @param blockSize Edge of the square blocks compared
+ * @return Changed area as blockSize-aligned rectangles (clipped to the
+ *         image); the whole image when the two are not comparable
+ *
+ * Each block row is compared with memcmp, rows in parallel, and runs of
+ * changed blocks are merged into one rectangle. Untouched stencils share
+ * long unchanged stretches, so this is far cheaper than re-uploading.
+ */
+QRegion SharedImage::changedRegion(const SharedImage &before, const SharedImage &after,
+                                   int blockSize) {
+    const QRect bounds(0, 0, after.width(), after.height());
+    if (before.isNull() || after.isNull() || before.mat_.size() != after.mat_.size() ||
+        before.mat_.type() != after.mat_.type() || before.order_ != after.order_) {
+        return QRegion(bounds);
+    }
+    
+    blockSize = qMax(1, blockSize);
+    const cv::Mat &a = before.mat_;
+    const cv::Mat &b = after.mat_;
+    const int blockColumns = (a.cols + blockSize - 1) / blockSize;
+    const int blockRows = (a.rows + blockSize - 1) / blockSize;
+    const size_t pixelSize = a.elemSize();
+    
+    // One flag per block, filled one block row per task
+    std::vector<uchar> changed(static_cast<size_t>(blockColumns) * blockRows, 0);
+    cv::parallel_for_(cv::Range(0, blockRows), [&](const cv::Range &range) {
+        for (int blockRow = range.start; blockRow < range.end; blockRow++) {
+            uchar *flags = changed.data() + static_cast<size_t>(blockRow) * blockColumns;
+            const int y1 = qMin(a.rows, (blockRow + 1) * blockSize);
+            for (int y = blockRow * blockSize; y < y1; y++) {
+                const uchar *rowA = a.ptr<uchar>(y);
+                const uchar *rowB = b.ptr<uchar>(y);
+                for (int column = 0; column < blockColumns; column++) {
+                    if (flags[column]) {
+                        continue;
+                    }
+                    const int x0 = column * blockSize;
+                    const int width = qMin(blockSize, a.cols - x0);
+                    flags[column] = std::memcmp(rowA + x0 * pixelSize, rowB + x0 * pixelSize,
+                                                width * pixelSize) != 0;
+                }
+            }
+        }
+    });
+    
+    QRegion region;
+    for (int blockRow = 0; blockRow < blockRows; blockRow++) {
+        const uchar *flags = changed.data() + static_cast<size_t>(blockRow) * blockColumns;
+        for (int column = 0; column < blockColumns; column++) {
+            if (!flags[column]) {
+                continue;
+            }
+            const int first = column;
+            while (column + 1 < blockColumns && flags[column + 1]) {
+                column++;
+            }
+            region += QRect(first * blockSize, blockRow * blockSize,
+                            (column - first + 1) * blockSize, blockSize).intersected(bounds);
+        }
+    }
+    return region;
+}
+
+/**
+ * @brief Map an 8-bit Mat type and channel order to a QImage format
+ * @param type OpenCV Mat type
+ * @param order Channel order
+ * @return Matching format, or Format_Invalid when Qt has none
+ */
+QImage::Format SharedImage::qtFormat(int type, ChannelOrder order) {
+    switch (type) {
+        case CV_8UC1:
+            return QImage::Format_Grayscale8;
+        case CV_8UC3:
+            return order == ChannelOrder::RGB ? QImage::Format_RGB888 : QImage::Format_BGR888;
+        case CV_8UC4:
+            if (order == ChannelOrder::RGB) {
+                return QImage::Format_RGBA8888;
+            }
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+            return QImage::Format_ARGB32;
+#else
+            return QImage::Format_Invalid;
+#endif
+        default:
+            return QImage::Format_Invalid;
+    }
+}
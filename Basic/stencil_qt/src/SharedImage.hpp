@@ -0,0 +1,54 @@
+#ifndef SHAREDIMAGE_HPP
+#define SHAREDIMAGE_HPP
+
+#include <opencv2/opencv.hpp>
+#include <QImage>
+#include <QRegion>
+
+/**
+ * @brief Image buffer shared between a cv::Mat and a QImage
+ *
+ * The pixels are stored once. QImages handed out by toQImage() wrap the
+ * Mat's buffer read-only and keep it alive through their cleanup
+ * function, so either side can outlive the other. Channel order is
+ * recorded instead of converted: 3- and 4-channel data is exposed to Qt
+ * in its native order (e.g. Format_BGR888) and swizzled only when Qt
+ * draws it.
+ */
+class SharedImage {
+public:
+    enum class ChannelOrder {
+        RGB,  // RGB / RGBA (StencilGenerator's internal order)
+        BGR   // BGR / BGRA (cv::imread order)
+    };
+    
+    SharedImage() = default;
+    explicit SharedImage(const cv::Mat &mat, ChannelOrder order = ChannelOrder::RGB);
+    
+    static SharedImage fromQImage(const QImage &image);
+    
+    // Views of the same pixels
+    const cv::Mat &mat() const { return mat_; }
+    QImage toQImage() const;
+    
+    bool isNull() const { return mat_.empty(); }
+    int width() const { return mat_.cols; }
+    int height() const { return mat_.rows; }
+    int channels() const { return mat_.channels(); }
+    ChannelOrder channelOrder() const { return order_; }
+    
+    cv::Mat toMat(ChannelOrder order) const;
+    
+    // Area where two images differ, in blockSize-aligned rectangles
+    static QRegion changedRegion(const SharedImage &before, const SharedImage &after,
+                                 int blockSize = 64);
+
+private:
+    cv::Mat mat_;
+    ChannelOrder order_ = ChannelOrder::RGB;
+    QImage owner_;  // Set when the pixels belong to a wrapped QImage
+    
+    static QImage::Format qtFormat(int type, ChannelOrder order);
+};
+
+#endif // SHAREDIMAGE_HPP
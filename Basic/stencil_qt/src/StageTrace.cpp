@@ -0,0 +1,347 @@
+#include "StageTrace.hpp"
+#include <QCoreApplication>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+namespace {
+
+/**
+ * @brief Span ring of one thread; written only by that thread
+ */
+struct TraceRing {
+    int threadId = 0;
+    QString name;
+    bool free = false;             // Owner has exited; guarded by the registry mutex
+    std::atomic<quint64> head{0};  // Spans ever written; slot = index % capacity
+    TraceSpan spans[StageTrace::kRingCapacity];
+};
+
+/**
+ * @brief Every ring ever registered; rings outlive their threads and are
+ *        handed on to later threads
+ */
+struct TraceRegistry {
+    QMutex mutex;
+    std::vector<std::shared_ptr<TraceRing>> rings;
+};
+
+TraceRegistry &registry() {
+    static TraceRegistry instance;
+    return instance;
+}
+
+/**
+ * @brief The calling thread's ring; gives it back when the thread exits
+ */
+struct RingHandle {
+    TraceRing *ring = nullptr;
+    
+    ~RingHandle() {
+        if (ring) {
+            QMutexLocker locker(&registry().mutex);
+            ring->free = true;
+        }
+    }
+};
+
+thread_local RingHandle threadRing_;
+thread_local int threadDepth_ = 0;
+thread_local qint64 threadAllocations_ = 0;
+
+/**
+ * @brief Ring of the calling thread, registered on first use
+ * @return The thread's ring
+ *
+ * Pool threads expire and are recreated, so a new thread takes over the
+ * ring of one that has exited before a ring is allocated. The ring keeps
+ * its id and its spans (they are history, not the new thread's); only
+ * the one owner at a time ever writes it.
+ */
+TraceRing *currentRing() {
+    if (threadRing_.ring) {
+        return threadRing_.ring;
+    }
+    
+    QCoreApplication *app = QCoreApplication::instance();
+    const bool gui = app && QThread::currentThread() == app->thread();
+    
+    TraceRegistry &reg = registry();
+    QMutexLocker locker(&reg.mutex);
+    TraceRing *ring = nullptr;
+    for (const auto &candidate : reg.rings) {
+        if (candidate->free) {
+            ring = candidate.get();
+            break;
+        }
+    }
+    if (!ring) {
+        reg.rings.push_back(std::make_shared<TraceRing>());
+        ring = reg.rings.back().get();
+        ring->threadId = static_cast<int>(reg.rings.size());
+    }
+    ring->free = false;
+    ring->name = gui ? QStringLiteral("GUI") : QStringLiteral("Worker %1").arg(ring->threadId);
+    threadRing_.ring = ring;
+    return ring;
+}
+
+/**
+ * @brief Forwards to the previous default allocator, counting buffers per thread
+ *
+ * The UMatData it returns names the base allocator, so frees bypass this.
+ */
+class CountingMatAllocator : public cv::MatAllocator {
+public:
+    explicit CountingMatAllocator(cv::MatAllocator *base) : base_(base) {}
+    
+    cv::UMatData *allocate(int dims, const int *sizes, int type, void *data, size_t *step,
+                           cv::AccessFlag flags, cv::UMatUsageFlags usage) const override {
+        cv::UMatData *u = base_->allocate(dims, sizes, type, data, step, flags, usage);
+        if (u && !data) {
+            threadAllocations_++;
+        }
+        return u;
+    }
+    
+    bool allocate(cv::UMatData *data, cv::AccessFlag flags, cv::UMatUsageFlags usage) const override {
+        return base_->allocate(data, flags, usage);
+    }
+    
+    void deallocate(cv::UMatData *data) const override {
+        base_->deallocate(data);
+    }
+
+private:
+    cv::MatAllocator *base_;
+};
+
+} // namespace
+
+std::atomic<bool> StageTrace::enabled_{false};
+std::atomic<qint64> StageTrace::clearedNs_{0};
+
+/**
+ * @brief Turn span recording on or off
+ * @param enabled New state
+ *
+ * The first call that enables tracing installs the counting Mat allocator;
+ * it stays installed afterwards and only costs a thread-local increment.
+ */
+void StageTrace::setEnabled(bool enabled) {
+    if (enabled) {
+        static const bool installed = [] {
+            static CountingMatAllocator allocator(cv::Mat::getDefaultAllocator());
+            cv::Mat::setDefaultAllocator(&allocator);
+            return true;
+        }();
+        Q_UNUSED(installed);
+    }
+    enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Copy the spans of every thread
+ * @return Spans recorded since the last clear(), sorted by start time
+ */
+QVector<TraceSpan> StageTrace::snapshot() {
+    std::vector<std::shared_ptr<TraceRing>> rings;
+    {
+        QMutexLocker locker(&registry().mutex);
+        rings = registry().rings;
+    }
+    
+    const qint64 cleared = clearedNs_.load(std::memory_order_relaxed);
+    const quint64 capacity = kRingCapacity;
+    QVector<TraceSpan> spans;
+    QVector<TraceSpan> copied;
+    
+    for (const auto &ring : rings) {
+        const quint64 head = ring->head.load(std::memory_order_acquire);
+        const quint64 first = head > capacity ? head - capacity : 0;
+        copied.clear();
+        for (quint64 i = first; i < head; i++) {
+            copied.append(ring->spans[i % capacity]);
+        }
+        
+        // The owner may have moved on meanwhile; the span it is writing now
+        // reuses the slot of index after - capacity, so keep only later ones
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const quint64 after = ring->head.load(std::memory_order_relaxed);
+        const quint64 valid = after + 1 > capacity ? after + 1 - capacity : 0;
+        for (quint64 i = std::max(first, valid); i < head; i++) {
+            const TraceSpan &span = copied[static_cast<int>(i - first)];
+            if (span.startNs >= cleared) {
+                spans.append(span);
+            }
+        }
+    }
+    
+    std::sort(spans.begin(), spans.end(), [](const TraceSpan &a, const TraceSpan &b) {
+        return a.startNs < b.startNs;
+    });
+    return spans;
+}
+
+/**
+ * @brief Hide every span recorded so far
+ *
+ * The rings are not touched (their owners may be writing); later snapshots
+ * simply skip spans that started before now.
+ */
+void StageTrace::clear() {
+    clearedNs_.store(nowNs(), std::memory_order_relaxed);
+}
+
+/**
+ * @brief Display name of a traced thread
+ * @param threadId Id from TraceSpan::threadId
+ * @return "GUI" or "Worker <id>"; empty for unknown ids
+ */
+QString StageTrace::threadName(int threadId) {
+    QMutexLocker locker(&registry().mutex);
+    for (const auto &ring : registry().rings) {
+        if (ring->threadId == threadId) {
+            return ring->name;
+        }
+    }
+    return QString();
+}
+
+/**
+ * @brief Encode spans in the Chrome trace event format
+ * @param spans Spans to encode
+ * @return JSON document with one complete ("X") event per span
+ *
+ * Times are in microseconds; bytes and allocations go to the event args.
+ * Thread names are emitted as metadata events so viewers label the rows.
+ */
+QByteArray StageTrace::chromeTraceJson(const QVector<TraceSpan> &spans) {
+    const qint64 pid = QCoreApplication::applicationPid();
+    QJsonArray events;
+    QVector<int> named;
+    
+    for (const TraceSpan &span : spans) {
+        if (!named.contains(span.threadId)) {
+            named.append(span.threadId);
+            QJsonObject meta;
+            meta["name"] = "thread_name";
+            meta["ph"] = "M";
+            meta["pid"] = pid;
+            meta["tid"] = span.threadId;
+            meta["args"] = QJsonObject{{"name", threadName(span.threadId)}};
+            events.append(meta);
+        }
+        
+        QJsonObject event;
+        event["name"] = QString::fromLatin1(span.name);
+        event["cat"] = "stencil";
+        event["ph"] = "X";
+        event["ts"] = span.startNs / 1000.0;
+        event["dur"] = span.durationNs / 1000.0;
+        event["pid"] = pid;
+        event["tid"] = span.threadId;
+        event["args"] = QJsonObject{
+            {"bytes", span.bytes},
+            {"allocations", span.allocations},
+            {"depth", span.depth}
+        };
+        events.append(event);
+    }
+    
+    QJsonObject root;
+    root["traceEvents"] = events;
+    root["displayTimeUnit"] = "ms";
+    return QJsonDocument(root).toJson(QJsonDocument::Compact);
+}
+
+/**
+ * @brief Write the current snapshot as a Chrome trace file
+ * @param filePath Output path (.json)
+ * @return true on success
+ */
+bool StageTrace::writeChromeTrace(const QString &filePath) {
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+    return file.write(chromeTraceJson(snapshot())) >= 0;
+}
+
+/**
+ * @brief Monotonic trace clock
+ * @return Nanoseconds since the clock was first read
+ */
+qint64 StageTrace::nowNs() {
+    using Clock = std::chrono::steady_clock;
+    static const Clock::time_point epoch = Clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - epoch).count();
+}
+
+/**
+ * @brief Mat buffers allocated so far on the calling thread
+ * @return Running count (only advances while the counting allocator is installed)
+ */
+qint64 StageTrace::threadAllocations() {
+    return threadAllocations_;
+}
+
+/**
+ * @brief Open a scope on the calling thread
+ * @return Nesting depth of the new scope
+ */
+int StageTrace::enterScope() {
+    return threadDepth_++;
+}
+
+/**
+ * @brief Close the innermost scope and store its span in the thread's ring
+ * @param span Finished span; its thread id is filled in here
+ */
+void StageTrace::record(const TraceSpan &span) {
+    threadDepth_--;
+    
+    TraceRing *ring = currentRing();
+    const quint64 head = ring->head.load(std::memory_order_relaxed);
+    TraceSpan &slot = ring->spans[head % kRingCapacity];
+    slot = span;
+    slot.threadId = ring->threadId;
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+/**
+ * @brief Start timing a stage
+ * @param name Stage name (string literal)
+ * @param bytes Pixel bytes the stage touches, if known up front
+ */
+TraceScope::TraceScope(const char *name, qint64 bytes) {
+    if (!StageTrace::isEnabled()) {
+        return;
+    }
+    active_ = true;
+    span_.name = name;
+    span_.bytes = bytes;
+    span_.depth = StageTrace::enterScope();
+    startAllocations_ = StageTrace::threadAllocations();
+    span_.startNs = StageTrace::nowNs();
+}
+
+/**
+ * @brief Finish the span and record it
+ */
+TraceScope::~TraceScope() {
+    if (!active_) {
+        return;
+    }
+    span_.durationNs = StageTrace::nowNs() - span_.startNs;
+    span_.allocations = StageTrace::threadAllocations() - startAllocations_;
+    StageTrace::record(span_);
+}
@@ -0,0 +1,93 @@
+#ifndef STAGETRACE_HPP
+#define STAGETRACE_HPP
+
+#include <opencv2/opencv.hpp>
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+#include <atomic>
+
+/**
+ * @brief One finished pipeline stage on one thread
+ */
+struct TraceSpan {
+    const char *name = nullptr;  // String literal; spans never own their name
+    int threadId = 0;            // Small sequential id, see StageTrace::threadName()
+    int depth = 0;               // Nesting level on its thread
+    qint64 startNs = 0;          // Since the trace clock started
+    qint64 durationNs = 0;
+    qint64 bytes = 0;            // Pixel bytes read plus written
+    qint64 allocations = 0;      // cv::Mat buffers allocated on the thread meanwhile
+};
+
+/**
+ * @brief Per-stage tracing of the stencil pipeline
+ *
+ * Stages open a TraceScope; when it closes, the span goes to a ring buffer
+ * owned by the calling thread. Recording takes no lock: only the owning
+ * thread writes its ring and publishes each span with a release store of
+ * the ring's head, and readers copy a ring and then drop whatever the
+ * owner may have overwritten while they were copying. A ring keeps the
+ * latest kRingCapacity spans. The only lock is taken once per thread, when
+ * its ring is registered. A thread's ring is handed on when it exits, so
+ * there are never more rings than threads tracing at the same time.
+ *
+ * Tracing is off until setEnabled(true); a disabled TraceScope costs one
+ * relaxed atomic load. Enabling also installs a cv::MatAllocator that
+ * counts buffers per thread, which is where the allocation figures come
+ * from (OpenCV's internal scratch buffers are not covered).
+ */
+class StageTrace {
+public:
+    static constexpr int kRingCapacity = 4096;
+    
+    static void setEnabled(bool enabled);
+    static bool isEnabled() { return enabled_.load(std::memory_order_relaxed); }
+    
+    // Spans of every thread recorded since the last clear(), by start time
+    static QVector<TraceSpan> snapshot();
+    static void clear();
+    static QString threadName(int threadId);
+    
+    // Chrome trace event format (chrome://tracing, Perfetto, speedscope)
+    static QByteArray chromeTraceJson(const QVector<TraceSpan> &spans);
+    static bool writeChromeTrace(const QString &filePath);
+    
+    // Used by TraceScope
+    static qint64 nowNs();
+    static qint64 threadAllocations();
+    static int enterScope();
+    static void record(const TraceSpan &span);
+    
+    static qint64 bytesOf(const cv::Mat &mat) {
+        return static_cast<qint64>(mat.total() * mat.elemSize());
+    }
+
+private:
+    static std::atomic<bool> enabled_;
+    static std::atomic<qint64> clearedNs_;  // Spans starting earlier are hidden
+};
+
+/**
+ * @brief Scoped span: times the enclosing block on the current thread
+ *
+ * name must be a string literal (or otherwise outlive the trace).
+ */
+class TraceScope {
+public:
+    explicit TraceScope(const char *name, qint64 bytes = 0);
+    ~TraceScope();
+    
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+    
+    void addBytes(qint64 bytes) { span_.bytes += bytes; }
+    void addBytes(const cv::Mat &mat) { span_.bytes += StageTrace::bytesOf(mat); }
+
+private:
+    TraceSpan span_;
+    qint64 startAllocations_ = 0;
+    bool active_ = false;
+};
+
+#endif // STAGETRACE_HPP
@@ -1,14 +1,32 @@
 #include "StencilGenerator.hpp"
+#include "fused_preprocess.hpp"
+#include "layer_quantizer.hpp"
+#include "vector_export.hpp"
+#include "gcode_generator.hpp"
+#include "edge_preserving_filter.hpp"
+#include "StageTrace.hpp"
 #include <QDebug>
 #include <QElapsedTimer>
+#include <QStringList>
 #include <QtConcurrent/QtConcurrent>
+#include <algorithm>
 #include <cmath>
+#include <iterator>
 
 /**
  * @brief Constructor for StencilGenerator
  * @param parent Parent QObject
  */
 StencilGenerator::StencilGenerator(QObject *parent) : QObject(parent) {
+    qRegisterMetaType<StencilResult>("StencilResult");
+    
+    // Full-resolution jobs and the live preview run on separate pools, so
+    // superseded full jobs winding down to their next cancel check can
+    // never hold up the preview. The second job slot lets the newest full
+    // job start meanwhile; OpenCV parallelises inside each of them
+    jobPool_.setMaxThreadCount(2);
+    previewPool_.setMaxThreadCount(1);
+    
     qDebug() << "StencilGenerator initialized";
 }
 
@@ -16,6 +34,9 @@ StencilGenerator::StencilGenerator(QObject *parent) : QObject(parent) {
  * @brief Destructor for StencilGenerator
  */
 StencilGenerator::~StencilGenerator() {
+    cancelPendingJobs();
+    jobPool_.waitForDone();
+    previewPool_.waitForDone();
     qDebug() << "StencilGenerator destroyed";
 }
 
@@ -34,6 +55,7 @@ bool StencilGenerator::loadImage(const QString &filePath) {
         
         // Convert BGR to RGB for Qt compatibility
         cv::cvtColor(originalImage_, originalImage_, cv::COLOR_BGR2RGB);
+        imageGeneration_++;
         
         qDebug() << "Image loaded:" << filePath 
                  << "Size:" << originalImage_.cols << "x" << originalImage_.rows
@@ -58,6 +80,7 @@ bool StencilGenerator::loadImage(const QImage &image) {
     }
     
     originalImage_ = qImageToCvMat(image);
+    imageGeneration_++;
     qDebug() << "QImage loaded, converted to CV Mat";
     return true;
 }
@@ -73,7 +96,9 @@ bool StencilGenerator::loadImage(const cv::Mat &image) {
         return false;
     }
     
-    image.copyTo(originalImage_);
+    // Always a fresh buffer: running jobs may still read the previous one
+    originalImage_ = image.clone();
+    imageGeneration_++;
     return true;
 }
 
@@ -84,6 +109,16 @@ bool StencilGenerator::loadImage(const cv::Mat &image) {
  * @return Preprocessed image
  */
 cv::Mat StencilGenerator::preprocessImage(const cv::Mat &image, const StencilParams &params) {
+    TraceScope trace("preprocess", StageTrace::bytesOf(image));
+    
+    // Without blur every step is per-pixel: convert and tone-map in one pass
+    if (params.blurRadius <= 0 && image.depth() == CV_8U) {
+        cv::Mat processed;
+        stencil::fusedToneMap(image, processed, buildToneLut(params, false), cv::COLOR_RGB2GRAY);
+        trace.addBytes(processed);
+        return processed;
+    }
+    
     cv::Mat processed = image.clone();
     
     // Convert to grayscale if not already
@@ -91,23 +126,49 @@ cv::Mat StencilGenerator::preprocessImage(const cv::Mat &image, const StencilPar
         processed = convertToGrayscale(processed);
     }
     
-    // Apply brightness and contrast adjustment
+    processed = applyToneStage(processed, params);
+    processed = applyBlurStage(processed, params);
+    trace.addBytes(processed);
+    
+    return processed;
+}
+
+/**
+ * @brief Apply the brightness/contrast stage
+ * @param gray Grayscale input
+ * @param params Processing parameters
+ * @return Adjusted image (shares data with the input when nothing changes)
+ */
+cv::Mat StencilGenerator::applyToneStage(const cv::Mat &gray, const StencilParams &params) {
     if (params.brightness != 0.0f || params.contrast != 1.0f) {
-        processed = adjustBrightnessContrast(processed, params.contrast, params.brightness);
+        TraceScope trace("tone", 2 * StageTrace::bytesOf(gray));
+        return adjustBrightnessContrast(gray, params.contrast, params.brightness);
+    }
+    return gray;
+}
+
+/**
+ * @brief Apply the blur stage
+ * @param toned Tone-adjusted grayscale input
+ * @param params Processing parameters
+ * @return Blurred image (shares data with the input when blur is off)
+ */
+cv::Mat StencilGenerator::applyBlurStage(const cv::Mat &toned, const StencilParams &params) {
+    if (params.blurRadius <= 0) {
+        return toned;
     }
     
-    // Apply blur if specified
-    if (params.blurRadius > 0) {
-        if (params.preserveEdges) {
-            // Bilateral filter preserves edges while reducing noise
-            processed = applyBilateralFilter(processed, params.blurRadius * 2 + 1, 
-                                           75, 75);
-        } else {
-            processed = applyGaussianBlur(processed, params.blurRadius);
+    TraceScope trace("blur", 2 * StageTrace::bytesOf(toned));
+    if (params.preserveEdges) {
+        // Bilateral filter preserves edges while reducing noise; the exact
+        // filter's cost grows with the square of the radius, so large radii
+        // use the grid approximation
+        if (params.blurRadius >= kBilateralGridMinRadius) {
+            return applyBilateralGrid(toned, params.blurRadius * 2 + 1, 75, 75);
         }
+        return applyBilateralFilter(toned, params.blurRadius * 2 + 1, 75, 75);
     }
-    
-    return processed;
+    return applyGaussianBlur(toned, params.blurRadius);
 }
 
 /**
@@ -116,76 +177,227 @@ cv::Mat StencilGenerator::preprocessImage(const cv::Mat &image, const StencilPar
  * @return StencilResult containing processed image and metadata
  */
 StencilResult StencilGenerator::generateStencil(const StencilParams &params) {
-    StencilResult result;
-    QElapsedTimer timer;
-    timer.start();
+    emit processingStarted();
+    
+    StencilResult result = runPipeline(originalImage_, imageGeneration_, params, CancelToken());
+    
+    if (result.success) {
+        emit processingCompleted(result);
+    } else {
+        emit processingError(result.errorMessage);
+    }
+    
+    return result;
+}
+
+/**
+ * @brief Generate a stencil on the worker pool
+ * @param params Processing parameters
+ * @param progressive Emit coarse stencils through stencilRefined() first
+ * @return Future for the result
+ *
+ * Starting a job supersedes any job still in flight: the older one is
+ * cancelled at its next stage boundary and never emits completion. Progress
+ * and completion are delivered through the usual signals, which reach
+ * GUI-thread receivers as queued calls.
+ */
+QFuture<StencilResult> StencilGenerator::generateStencilAsync(const StencilParams &params,
+                                                              bool progressive) {
+    if (activeJob_) {
+        activeJob_->store(true);
+    }
+    
+    CancelToken token = std::make_shared<std::atomic<bool>>(false);
+    activeJob_ = token;
+    
+    // Loads replace originalImage_ instead of writing into it, so this
+    // shallow copy stays valid for the lifetime of the job
+    cv::Mat source = originalImage_;
+    quint64 generation = imageGeneration_;
     
     emit processingStarted();
     
-    try {
-        if (!hasImage()) {
-            result.errorMessage = "No image loaded";
-            emit processingError(result.errorMessage);
+    return QtConcurrent::run(&jobPool_, [this, source, generation, params, token, progressive]() {
+        StencilResult result = runPipeline(source, generation, params, token, progressive);
+        
+        if (isCancelled(token)) {
+            result.cancelled = true;
+            result.success = false;
             return result;
         }
         
-        cv::Mat processed;
-        cv::Mat preprocessed = preprocessImage(originalImage_, params);
-        
-        emit processingProgress(30);
-        
-        // Apply selected processing mode
-        switch (params.mode) {
-            case ProcessingMode::SIMPLE_THRESHOLD:
-                processed = applySimpleThreshold(preprocessed, params);
-                break;
-            case ProcessingMode::EDGE_DETECTION:
-                processed = applyEdgeDetection(preprocessed, params);
-                break;
-            case ProcessingMode::ADAPTIVE_THRESHOLD:
-                processed = applyAdaptiveThreshold(preprocessed, params);
-                break;
-            case ProcessingMode::MULTI_LAYER:
-                processed = applyMultiLayer(preprocessed, params);
-                break;
-            case ProcessingMode::CONTOUR_POLYGON:
-                processed = applyContourPolygon(preprocessed, params);
-                break;
-            case ProcessingMode::DETAIL_PRESERVING:
-                processed = applyDetailPreserving(preprocessed, params);
-                break;
-            default:
-                processed = applySimpleThreshold(preprocessed, params);
-                break;
+        if (result.success) {
+            emit processingCompleted(result);
+        } else {
+            emit processingError(result.errorMessage);
+        }
+        return result;
+    });
+}
+
+/**
+ * @brief Request a live preview, coalescing requests that arrive while one runs
+ * @param params Processing parameters
+ * @param maxPreviewSize Maximum size for preview (maintains aspect ratio)
+ *
+ * Latest wins: at most one preview job runs at a time, and requests made
+ * meanwhile overwrite each other so only the newest is rendered next.
+ * Results arrive through livePreviewReady().
+ */
+void StencilGenerator::requestLivePreview(const StencilParams &params, int maxPreviewSize) {
+    if (!hasImage()) {
+        return;
+    }
+    
+    QMutexLocker locker(&previewMutex_);
+    pendingPreview_.params = params;
+    pendingPreview_.maxPreviewSize = maxPreviewSize;
+    pendingPreview_.source = originalImage_;
+    pendingPreview_.imageGeneration = imageGeneration_;
+    hasPendingPreview_ = true;
+    
+    if (previewRunning_) {
+        return;  // The running job picks the request up when it finishes
+    }
+    previewRunning_ = true;
+    locker.unlock();
+    
+    previewPool_.start([this]() { runPreviewLoop(); });
+}
+
+/**
+ * @brief Cancel every in-flight stencil job and drop queued previews
+ */
+void StencilGenerator::cancelPendingJobs() {
+    if (activeJob_) {
+        activeJob_->store(true);
+        activeJob_.reset();
+    }
+    
+    QMutexLocker locker(&previewMutex_);
+    hasPendingPreview_ = false;
+    pendingPreview_.source = cv::Mat();
+}
+
+/**
+ * @brief Worker loop rendering the newest pending preview request
+ */
+void StencilGenerator::runPreviewLoop() {
+    forever {
+        PreviewRequest request;
+        {
+            QMutexLocker locker(&previewMutex_);
+            if (!hasPendingPreview_) {
+                previewRunning_ = false;
+                return;
+            }
+            request = pendingPreview_;
+            hasPendingPreview_ = false;
+            pendingPreview_.source = cv::Mat();
         }
         
-        emit processingProgress(70);
+        StencilResult result = renderPreview(request.source, request.imageGeneration,
+                                             request.params, request.maxPreviewSize);
         
-        // Invert colors if requested
-        if (params.invertColors) {
-            cv::bitwise_not(processed, processed);
+        // Skip frames that a newer request has already made stale
+        QMutexLocker locker(&previewMutex_);
+        if (!hasPendingPreview_ && result.success) {
+            locker.unlock();
+            emit livePreviewReady(result);
+        }
+    }
+}
+
+/**
+ * @brief Check a cancellation token
+ * @param cancel Token (null tokens are never cancelled)
+ * @return true if the job should stop
+ */
+bool StencilGenerator::isCancelled(const CancelToken &cancel) {
+    return cancel && cancel->load();
+}
+
+/**
+ * @brief Emit progress unless the job has been cancelled
+ * @param cancel Job cancellation token
+ * @param percent Progress percentage
+ */
+void StencilGenerator::reportProgress(const CancelToken &cancel, int percent) {
+    if (!isCancelled(cancel)) {
+        emit processingProgress(percent);
+    }
+}
+
+/**
+ * @brief Full stencil pipeline shared by the synchronous and asynchronous entry points
+ * @param source Source image
+ * @param imageGeneration Generation counter of the source image (keys the content hash)
+ * @param params Processing parameters
+ * @param cancel Cancellation token, checked between stages
+ * @param progressive Run the coarse steps of runProgressiveSteps() first
+ * @return StencilResult; success is false on error or cancellation
+ *
+ * With a result cache attached, the finished stencil is looked up by image
+ * content and parameters before any stage runs, and stored after a miss.
+ * A cache hit skips the progressive steps: it arrives sooner than they would.
+ */
+StencilResult StencilGenerator::runPipeline(const cv::Mat &source, quint64 imageGeneration,
+                                            const StencilParams &params, const CancelToken &cancel,
+                                            bool progressive) {
+    TraceScope trace("stencil");
+    StencilResult result;
+    QElapsedTimer timer;
+    timer.start();
+    
+    try {
+        if (source.empty()) {
+            result.errorMessage = "No image loaded";
+            return result;
         }
         
-        // Detect and bridge floating islands for stencil applications
-        if (params.mode != ProcessingMode::CONTOUR_POLYGON) {
-            cv::Mat islands = detectFloatingIslands(processed);
-            if (!islands.empty()) {
-                // If islands detected, bridge them
-                processed = autoBridgeIslands(processed, 3, 255);
-                result.islandCount = cv::countNonZero(islands);
-            }
+        std::shared_ptr<stencil::ResultCache> cache = resultCache();
+        std::string finalKey;
+        std::string stageKey;
+        if (cache) {
+            uint64_t imageHash = sourceHash(source, imageGeneration);
+            finalKey = stencil::ResultCache::makeKey(imageHash, "qt/stencil/" + canonicalParams(params));
+            stageKey = stencil::ResultCache::makeKey(
+                imageHash, "qt/preprocessed/" + canonicalPreprocessParams(params));
         }
         
-        // Resize if output dimensions specified
-        if (params.outputWidth > 0 && params.outputHeight > 0) {
-            cv::resize(processed, processed, 
-                      cv::Size(params.outputWidth, params.outputHeight),
-                      params.maintainAspectRatio ? cv::INTER_AREA : cv::INTER_LINEAR);
+        cv::Mat processed;
+        stencil::CacheEntry cached;
+        if (cache && cache->load(finalKey, cached) && !cached.image("stencil").empty()) {
+            // The entry maps a read-only file; the result owns its own buffer,
+            // and the copy gathers the statistics
+            TraceScope load("cache_load", 2 * StageTrace::bytesOf(cached.image("stencil")));
+            stencil::PixelStats stats;
+            stencil::writeWithStats(cached.image("stencil"), processed, false, stats);
+            stats.islands = static_cast<int>(cached.value("islandCount"));
+            storeStatistics(stats, result);
+            result.bridgeLength = cached.value("bridgeLength");
+            result.fromCache = true;
+            reportProgress(cancel, 85);
+        } else {
+            if (progressive) {
+                runProgressiveSteps(source, params, cancel);
+            }
+            processed = runStages(source, params, cancel, cache.get(), stageKey, result);
+            if (processed.empty()) {
+                return result;  // Cancelled
+            }
+            
+            if (cache) {
+                stencil::CacheEntry entry;
+                entry.addImage("stencil", processed);
+                entry.addValue("islandCount", result.islandCount);
+                entry.addValue("bridgeLength", result.bridgeLength);
+                cache->store(finalKey, entry);
+            }
         }
         
-        // Store results
-        processed.copyTo(result.processedMat);
-        result.fullResolutionImage = cvMatToQImage(processed);
+        // Store results (shared with the QImage view, no copy)
+        result.stencilImage = SharedImage(processed);
         
         // Find contours for polygon mode
         if (params.mode == ProcessingMode::CONTOUR_POLYGON) {
@@ -193,36 +405,386 @@ StencilResult StencilGenerator::generateStencil(const StencilParams &params) {
             qDebug() << "Found" << result.contours.size() << "contours";
         }
         
-        // Calculate statistics
-        cv::Mat binary;
-        cv::threshold(processed, binary, 127, 255, cv::THRESH_BINARY);
-        result.blackPixels = cv::countNonZero(binary == 0);
-        result.whitePixels = cv::countNonZero(binary == 255);
-        
         result.success = true;
         result.processingTimeMs = timer.elapsed();
         
-        qDebug() << "Stencil generated in" << result.processingTimeMs << "ms"
+        qDebug() << "Stencil" << (result.fromCache ? "loaded from cache in" : "generated in")
+                 << result.processingTimeMs << "ms"
                  << "Black:" << result.blackPixels << "White:" << result.whitePixels;
         
-        emit processingProgress(100);
-        emit processingCompleted(result);
-        
+        reportProgress(cancel, 100);
+    
     } catch (const cv::Exception &e) {
         result.errorMessage = QString("OpenCV error: %1").arg(e.what());
         result.success = false;
-        emit processingError(result.errorMessage);
         qCritical() << result.errorMessage;
     } catch (const std::exception &e) {
         result.errorMessage = QString("Error: %1").arg(e.what());
         result.success = false;
-        emit processingError(result.errorMessage);
         qCritical() << result.errorMessage;
     }
     
     return result;
 }
 
+/**
+ * @brief Compute the full-size stencil from the source image
+ * @param source Source image
+ * @param params Processing parameters
+ * @param cancel Cancellation token, checked between stages
+ * @param cache Result cache for the preprocessed stage, may be null
+ * @param stageKey Cache key of the preprocessed stage
+ * @param result Receives the statistics and bridge length
+ * @return Stencil, or an empty Mat when cancelled
+ */
+cv::Mat StencilGenerator::runStages(const cv::Mat &source, const StencilParams &params,
+                                    const CancelToken &cancel, stencil::ResultCache *cache,
+                                    const std::string &stageKey, StencilResult &result) {
+    cv::Mat processed;
+    bool inverted = false;
+    
+    if (params.mode == ProcessingMode::SIMPLE_THRESHOLD && params.blurRadius <= 0 &&
+        source.depth() == CV_8U) {
+        // Fast path: gray, tone, threshold and invert fused in one pass
+        TraceScope trace("preprocess", StageTrace::bytesOf(source));
+        stencil::fusedToneMap(source, processed, buildToneLut(params, true),
+                              cv::COLOR_RGB2GRAY);
+        trace.addBytes(processed);
+        inverted = params.invertColors;
+        reportProgress(cancel, 30);
+    } else {
+        // Preprocessing only depends on the tone and blur settings, so mode
+        // and threshold changes on the same image reuse it
+        cv::Mat preprocessed;
+        stencil::CacheEntry cached;
+        if (cache && cache->load(stageKey, cached)) {
+            preprocessed = cached.image("preprocessed");
+        }
+        if (preprocessed.empty()) {
+            preprocessed = preprocessImage(source, params);
+            if (cache) {
+                stencil::CacheEntry entry;
+                entry.addImage("preprocessed", preprocessed);
+                cache->store(stageKey, entry);
+            }
+        }
+        
+        reportProgress(cancel, 30);
+        if (isCancelled(cancel)) {
+            return cv::Mat();
+        }
+        
+        processed = applyMode(preprocessed, params);
+    }
+    
+    reportProgress(cancel, 70);
+    if (isCancelled(cancel)) {
+        return cv::Mat();
+    }
+    
+    // Inversion, island bridging and statistics
+    stencil::PixelStats stats;
+    applyFinalStage(processed, params, params.invertColors && !inverted, stats, result);
+    
+    reportProgress(cancel, 85);
+    if (isCancelled(cancel)) {
+        return cv::Mat();
+    }
+    
+    // Resize if output dimensions specified
+    if (params.outputWidth > 0 && params.outputHeight > 0) {
+        TraceScope trace("resize", StageTrace::bytesOf(processed));
+        cv::resize(processed, processed, 
+                  cv::Size(params.outputWidth, params.outputHeight),
+                  params.maintainAspectRatio ? cv::INTER_AREA : cv::INTER_LINEAR);
+        trace.addBytes(processed);
+        
+        // The resize wrote new pixels; count them again
+        stencil::writeWithStats(processed, processed, false, stats);
+    }
+    
+    storeStatistics(stats, result);
+    return processed;
+}
+
+/**
+ * @brief Emit stencils at 1/8, 1/4 and 1/2 size ahead of the full-size one
+ * @param source Source image
+ * @param params Full-resolution processing parameters
+ * @param cancel Cancellation token, checked between steps
+ *
+ * Each step runs every stage, bridging included, on the source halved
+ * level times, with the resolution-dependent parameters scaled as for the
+ * live preview, and is emitted through stencilRefined() with its level and
+ * the final size. The halvings are built once, each from the previous one,
+ * so the coarse steps together read the source a single time.
+ *
+ * Skipped for small sources and when the output is resized. A failing step
+ * ends the steps quietly; the full-size run reports the error.
+ */
+void StencilGenerator::runProgressiveSteps(const cv::Mat &source, const StencilParams &params,
+                                           const CancelToken &cancel) {
+    if (static_cast<double>(source.total()) < kProgressiveMinPixels ||
+        (params.outputWidth > 0 && params.outputHeight > 0)) {
+        return;
+    }
+    
+    TraceScope trace("progressive");
+    QElapsedTimer timer;
+    timer.start();
+    
+    try {
+        std::vector<cv::Mat> halvings{source};
+        for (int level = 1; level <= kProgressiveLevels; level++) {
+            const cv::Mat &previous = halvings.back();
+            cv::Mat half;
+            cv::resize(previous, half, cv::Size(std::max(1, previous.cols / 2),
+                                                std::max(1, previous.rows / 2)),
+                       0, 0, cv::INTER_AREA);
+            halvings.push_back(half);
+        }
+        
+        for (int level = kProgressiveLevels; level >= 1; level--) {
+            if (isCancelled(cancel)) {
+                return;
+            }
+            
+            const cv::Mat &reduced = halvings[level];
+            const StencilParams scaled =
+                scaleParams(params, static_cast<double>(reduced.cols) / source.cols);
+            cv::Mat processed = applyMode(preprocessImage(reduced, scaled), scaled);
+            
+            StencilResult step;
+            stencil::PixelStats stats;
+            applyFinalStage(processed, scaled, scaled.invertColors, stats, step);
+            storeStatistics(stats, step);
+            step.stencilImage = SharedImage(processed);
+            step.level = level;
+            step.fullSize = QSize(source.cols, source.rows);
+            step.success = true;
+            step.processingTimeMs = timer.elapsed();
+            
+            if (isCancelled(cancel)) {
+                return;
+            }
+            emit stencilRefined(step);
+        }
+    } catch (const cv::Exception &e) {
+        qWarning() << "Progressive step failed:" << e.what();
+    }
+}
+
+/**
+ * @brief Run the processing-mode kernel selected in params
+ * @param preprocessed Preprocessed grayscale image
+ * @param params Processing parameters
+ * @return Mode output
+ */
+cv::Mat StencilGenerator::applyMode(const cv::Mat &preprocessed, const StencilParams &params) {
+    // Span names match the benchmark stages, in ProcessingMode order
+    static const char *const kModeStages[] = {
+        "mode_simple_threshold", "mode_edge_detection", "mode_adaptive_threshold",
+        "mode_multi_layer", "mode_contour_polygon", "mode_detail_preserving",
+        "mode_local_threshold"
+    };
+    const int modeIndex = static_cast<int>(params.mode);
+    const bool known = modeIndex >= 0 && modeIndex < static_cast<int>(std::size(kModeStages));
+    TraceScope trace(known ? kModeStages[modeIndex] : "mode",
+                     2 * StageTrace::bytesOf(preprocessed));
+    
+    switch (params.mode) {
+        case ProcessingMode::SIMPLE_THRESHOLD:
+            return applySimpleThreshold(preprocessed, params);
+        case ProcessingMode::EDGE_DETECTION:
+            return applyEdgeDetection(preprocessed, params);
+        case ProcessingMode::ADAPTIVE_THRESHOLD:
+            return applyAdaptiveThreshold(preprocessed, params);
+        case ProcessingMode::MULTI_LAYER:
+            return applyMultiLayer(preprocessed, params);
+        case ProcessingMode::CONTOUR_POLYGON:
+            return applyContourPolygon(preprocessed, params);
+        case ProcessingMode::DETAIL_PRESERVING:
+            return applyDetailPreserving(preprocessed, params);
+        case ProcessingMode::LOCAL_THRESHOLD:
+            return applyLocalThreshold(preprocessed, params);
+        default:
+            return applySimpleThreshold(preprocessed, params);
+    }
+}
+
+/**
+ * @brief Invert, detect floating islands and bridge them, in place
+ * @param processed Mode output; a buffer the pipeline owns
+ * @param params Processing parameters
+ * @param invert Whether the stage inverts the mode output
+ * @param stats Receives the statistics of the finished stencil
+ * @param result Receives the bridge length
+ *
+ * The statistics are gathered by the inversion pass (a read-only pass when
+ * not inverting) and kept in step while the bridges are drawn, so no pass
+ * runs over the finished stencil just to count it. Polygon mode skips
+ * bridging.
+ */
+void StencilGenerator::applyFinalStage(cv::Mat &processed, const StencilParams &params, bool invert,
+                                       stencil::PixelStats &stats, StencilResult &result) {
+    const qint64 bytes = StageTrace::bytesOf(processed);
+    {
+        TraceScope trace(invert ? "invert" : "statistics", invert ? 2 * bytes : bytes);
+        stencil::writeWithStats(processed, processed, invert, stats);
+    }
+    
+    if (params.mode == ProcessingMode::CONTOUR_POLYGON) {
+        return;
+    }
+    
+    stencil::IslandTable islands;
+    {
+        // Reads the stencil, writes 32-bit labels and the island mask
+        TraceScope trace("island_detect", 6 * bytes);
+        islands = stencil::analyzeIslands(processed, params.minIslandArea);
+    }
+    stats.islands = static_cast<int>(islands.islands.size());
+    if (islands.empty()) {
+        return;
+    }
+    
+    // Bridges go straight into the stencil, no copy
+    TraceScope trace("bridge", StageTrace::bytesOf(islands.labels));
+    stencil::BridgePlan plan = stencil::planBridges(islands);
+    stencil::drawBridges(processed, plan, params.bridgeWidth, 255, stats);
+    result.bridgeLength = plan.total_length;
+}
+
+/**
+ * @brief Copy accumulated statistics into a result
+ * @param stats Statistics of the finished stencil
+ * @param result Receives pixel counts, histogram, cut bounds and island count
+ */
+void StencilGenerator::storeStatistics(const stencil::PixelStats &stats, StencilResult &result) {
+    result.blackPixels = static_cast<int>(stats.black());
+    result.whitePixels = static_cast<int>(stats.white());
+    result.islandCount = stats.islands;
+    result.cutBounds = stats.blackBounds();
+    for (int v = 0; v < 256; v++) {
+        result.histogram[v] = static_cast<int>(stats.histogram[v]);
+    }
+}
+
+/**
+ * @brief Scale resolution-dependent parameters to a reduced working resolution
+ * @param params Full-resolution parameters
+ * @param scale Working size divided by full size (0 < scale <= 1)
+ * @return Parameters giving the same look at the reduced resolution
+ *
+ * Lengths scale linearly, areas quadratically; block sizes stay odd and
+ * output resizing is dropped.
+ */
+StencilParams StencilGenerator::scaleParams(const StencilParams &params, double scale) {
+    StencilParams scaled = params;
+    if (scale >= 1.0 || scale <= 0.0) {
+        return scaled;
+    }
+    
+    scaled.blurRadius = cvRound(params.blurRadius * scale);
+    scaled.adaptiveBlockSize = std::max(3, cvRound(params.adaptiveBlockSize * scale) | 1);
+    scaled.localBlockSize = std::max(3, cvRound(params.localBlockSize * scale) | 1);
+    scaled.polygonEpsilon = params.polygonEpsilon * scale;
+    scaled.minContourArea = cvRound(params.minContourArea * scale * scale);
+    scaled.minIslandArea = cvRound(params.minIslandArea * scale * scale);
+    scaled.bridgeWidth = std::max(1, cvRound(params.bridgeWidth * scale));
+    scaled.outputWidth = 0;
+    scaled.outputHeight = 0;
+    return scaled;
+}
+
+/**
+ * @brief Attach an on-disk result cache (null detaches)
+ * @param cache Cache shared with other generators or tools
+ */
+void StencilGenerator::setResultCache(std::shared_ptr<stencil::ResultCache> cache) {
+    QMutexLocker locker(&cacheMutex_);
+    resultCache_ = std::move(cache);
+}
+
+/**
+ * @brief Hit/miss counters of the attached result cache
+ * @return Cache statistics, all zero without a cache
+ */
+stencil::CacheStats StencilGenerator::cacheStats() const {
+    std::shared_ptr<stencil::ResultCache> cache = resultCache();
+    return cache ? cache->stats() : stencil::CacheStats();
+}
+
+/**
+ * @brief Canonical text form of every parameter that affects the stencil
+ * @param params Processing parameters
+ * @return Stable key string; equal strings mean equal output for the same image
+ */
+std::string StencilGenerator::canonicalParams(const StencilParams &params) {
+    QStringList fields;
+    fields << QString("mode=%1").arg(static_cast<int>(params.mode))
+           << QString("threshold=%1").arg(params.threshold)
+           << QString("contrast=%1").arg(params.contrast, 0, 'g', 9)
+           << QString("brightness=%1").arg(params.brightness, 0, 'g', 9)
+           << QString("blur=%1").arg(params.blurRadius)
+           << QString("edge=%1,%2,%3").arg(params.edgeLowThreshold)
+                                      .arg(params.edgeHighThreshold)
+                                      .arg(params.edgeKernelSize)
+           << QString("adaptive=%1,%2").arg(params.adaptiveBlockSize).arg(params.adaptiveC)
+           << QString("local=%1,%2,%3").arg(static_cast<int>(params.localMethod))
+                                       .arg(params.localBlockSize)
+                                       .arg(params.localK, 0, 'g', 17)
+           << QString("polygon=%1,%2").arg(params.polygonEpsilon, 0, 'g', 17)
+                                      .arg(params.minContourArea)
+           << QString("layers=%1,%2").arg(params.layerCount).arg(params.equalizeLayers)
+           << QString("invert=%1").arg(params.invertColors)
+           << QString("edges=%1").arg(params.preserveEdges)
+           << QString("islands=%1,%2").arg(params.minIslandArea).arg(params.bridgeWidth)
+           << QString("output=%1x%2,%3").arg(params.outputWidth)
+                                        .arg(params.outputHeight)
+                                        .arg(params.maintainAspectRatio);
+    return fields.join(';').toStdString();
+}
+
+/**
+ * @brief Canonical text form of the parameters preprocessImage() reads
+ * @param params Processing parameters
+ * @return Stable key string for the preprocessed stage
+ */
+std::string StencilGenerator::canonicalPreprocessParams(const StencilParams &params) {
+    return QString("contrast=%1;brightness=%2;blur=%3;edges=%4")
+        .arg(params.contrast, 0, 'g', 9)
+        .arg(params.brightness, 0, 'g', 9)
+        .arg(params.blurRadius)
+        .arg(params.preserveEdges)
+        .toStdString();
+}
+
+/**
+ * @brief Snapshot of the attached result cache
+ * @return Cache pointer, may be null
+ */
+std::shared_ptr<stencil::ResultCache> StencilGenerator::resultCache() const {
+    QMutexLocker locker(&cacheMutex_);
+    return resultCache_;
+}
+
+/**
+ * @brief Content hash of the source image, computed once per loaded image
+ * @param source Source image
+ * @param imageGeneration Generation counter of the source image
+ * @return 64-bit hash of the pixels, size and type
+ */
+uint64_t StencilGenerator::sourceHash(const cv::Mat &source, quint64 imageGeneration) {
+    QMutexLocker locker(&cacheMutex_);
+    if (!sourceHashValid_ || sourceHashGeneration_ != imageGeneration) {
+        sourceHash_ = stencil::hashImage(source);
+        sourceHashGeneration_ = imageGeneration;
+        sourceHashValid_ = true;
+    }
+    return sourceHash_;
+}
+
 /**
  * @brief Generate live preview for real-time updates
  * @param params Processing parameters
@@ -230,45 +792,174 @@ StencilResult StencilGenerator::generateStencil(const StencilParams &params) {
  * @return StencilResult with preview image
  */
 StencilResult StencilGenerator::generateLivePreview(const StencilParams &params, int maxPreviewSize) {
+    if (!hasImage()) {
+        return StencilResult();
+    }
+    
+    return renderPreview(originalImage_, imageGeneration_, params, maxPreviewSize);
+}
+
+/**
+ * @brief Set the per-frame time budget of the live preview
+ * @param budgetMs Budget in milliseconds
+ *
+ * Frames that overrun the budget lower the preview resolution for the
+ * following frames; frames well inside it raise it back towards the
+ * requested size.
+ */
+void StencilGenerator::setPreviewBudget(double budgetMs) {
+    QMutexLocker locker(&previewCacheMutex_);
+    previewBudgetMs_ = std::max(1.0, budgetMs);
+}
+
+/**
+ * @brief Render one timed preview frame
+ * @param source Source image
+ * @param imageGeneration Generation counter of the source image
+ * @param params Full-resolution processing parameters
+ * @param maxPreviewSize Requested maximum preview size
+ * @return StencilResult with preview image, statistics and frame time
+ */
+StencilResult StencilGenerator::renderPreview(const cv::Mat &source, quint64 imageGeneration,
+                                              const StencilParams &params, int maxPreviewSize) {
+    TraceScope trace("preview");
     StencilResult result;
+    QElapsedTimer timer;
+    timer.start();
     
     try {
-        if (!hasImage()) {
-            return result;
-        }
-        
-        // Create a smaller copy for preview
-        cv::Mat previewImage = resizeImage(originalImage_, maxPreviewSize);
-        
-        // Apply preprocessing
-        cv::Mat preprocessed = preprocessImage(previewImage, params);
+        cv::Mat processed = previewStages(source, imageGeneration, params, maxPreviewSize, result);
         
-        // Apply processing (simplified for speed)
-        cv::Mat processed;
-        switch (params.mode) {
-            case ProcessingMode::SIMPLE_THRESHOLD:
-                processed = applySimpleThreshold(preprocessed, params);
-                break;
-            case ProcessingMode::EDGE_DETECTION:
-                processed = applyEdgeDetection(preprocessed, params);
-                break;
-            default:
-                // For preview, use simple threshold for speed
-                cv::threshold(preprocessed, processed, params.threshold, 255, cv::THRESH_BINARY);
-                break;
-        }
-        
-        // Convert to QImage for display
-        result.previewImage = cvMatToQImage(processed);
+        // Shared with the cache; QImage view is made on display
+        result.previewImage = SharedImage(processed);
         result.success = true;
-        
+    
     } catch (...) {
         // Silently fail for preview
     }
     
+    result.processingTimeMs = timer.nsecsElapsed() / 1.0e6;
+    
+    // Adapt the working resolution to the budget
+    QMutexLocker locker(&previewCacheMutex_);
+    if (result.processingTimeMs > previewBudgetMs_) {
+        previewScale_ *= std::max(0.5, std::sqrt(previewBudgetMs_ / result.processingTimeMs));
+        previewScale_ = std::max(kMinPreviewScale, previewScale_);
+    } else if (previewFrameWasFull_ && result.processingTimeMs < previewBudgetMs_ * 0.5 &&
+               previewScale_ < 1.0) {
+        // Only frames that ran from the tone stage on say anything about headroom
+        previewScale_ = std::min(1.0, previewScale_ * 1.25);
+    }
+    
     return result;
 }
 
+/**
+ * @brief Run the preview pipeline, reusing every cached stage still valid
+ * @param source Source image
+ * @param imageGeneration Generation counter of the source image
+ * @param params Full-resolution processing parameters
+ * @param maxPreviewSize Maximum size for preview (maintains aspect ratio)
+ * @param result Receives the statistics and bridge length
+ * @return Processed preview image
+ *
+ * Every processing mode runs, including island bridging, with its
+ * resolution-dependent parameters scaled to the preview size.
+ */
+cv::Mat StencilGenerator::previewStages(const cv::Mat &source, quint64 imageGeneration,
+                                        const StencilParams &fullParams, int maxPreviewSize,
+                                        StencilResult &result) {
+    QMutexLocker locker(&previewCacheMutex_);
+    PreviewCache &cache = previewCache_;
+    
+    // Snap the budget-driven size to 1/16 steps so small adjustments
+    // do not throw the whole cache away
+    int previewSize = std::max(kMinPreviewSize,
+                               maxPreviewSize * cvRound(previewScale_ * 16.0) / 16);
+    
+    // Downscaled source and grayscale
+    if (cache.imageGeneration != imageGeneration || cache.maxPreviewSize != previewSize ||
+        cache.gray.empty()) {
+        cache.downscaled = resizeImage(source, previewSize);
+        cache.gray = convertToGrayscale(cache.downscaled);
+        cache.imageGeneration = imageGeneration;
+        cache.maxPreviewSize = previewSize;
+        cache.toneValid = false;
+    }
+    
+    const double scale = static_cast<double>(cache.gray.cols) / std::max(1, source.cols);
+    previewFrameWasFull_ = !cache.toneValid;
+    const StencilParams params = scaleParams(fullParams, scale);
+    
+    // Contrast/brightness
+    if (!cache.toneValid || cache.contrast != params.contrast ||
+        cache.brightness != params.brightness) {
+        cache.toned = applyToneStage(cache.gray, params);
+        cache.contrast = params.contrast;
+        cache.brightness = params.brightness;
+        cache.toneValid = true;
+        cache.blurValid = false;
+    }
+    
+    // Blur
+    if (!cache.blurValid || cache.blurRadius != params.blurRadius ||
+        (params.blurRadius > 0 && cache.preserveEdges != params.preserveEdges)) {
+        cache.blurred = applyBlurStage(cache.toned, params);
+        cache.blurRadius = params.blurRadius;
+        cache.preserveEdges = params.preserveEdges;
+        cache.blurValid = true;
+        cache.finalValid = false;
+    }
+    
+    // Mode kernel, inversion and island bridging
+    if (!cache.finalValid || !sameFinalStageParams(cache.finalParams, params)) {
+        // Always a fresh buffer: earlier previews may still be on screen
+        cv::Mat processed = applyMode(cache.blurred, params);
+        
+        StencilResult bridging;
+        applyFinalStage(processed, params, params.invertColors, cache.finalStats, bridging);
+        cache.final = processed;
+        cache.finalBridgeLength = bridging.bridgeLength;
+        cache.finalParams = params;
+        cache.finalValid = true;
+    }
+    
+    storeStatistics(cache.finalStats, result);
+    result.bridgeLength = cache.finalBridgeLength;
+    return cache.final;
+}
+
+/**
+ * @brief Check whether two parameter sets produce the same final preview stage
+ * @param a First parameter set
+ * @param b Second parameter set
+ * @return true if the mode kernel, inversion and bridging inputs are identical
+ */
+bool StencilGenerator::sameFinalStageParams(const StencilParams &a, const StencilParams &b) {
+    if (a.mode != b.mode || a.threshold != b.threshold || a.invertColors != b.invertColors ||
+        a.minIslandArea != b.minIslandArea || a.bridgeWidth != b.bridgeWidth) {
+        return false;
+    }
+    
+    switch (a.mode) {
+        case ProcessingMode::EDGE_DETECTION:
+            return a.edgeLowThreshold == b.edgeLowThreshold &&
+                   a.edgeHighThreshold == b.edgeHighThreshold &&
+                   a.edgeKernelSize == b.edgeKernelSize;
+        case ProcessingMode::ADAPTIVE_THRESHOLD:
+            return a.adaptiveBlockSize == b.adaptiveBlockSize && a.adaptiveC == b.adaptiveC;
+        case ProcessingMode::LOCAL_THRESHOLD:
+            return a.localMethod == b.localMethod && a.localBlockSize == b.localBlockSize &&
+                   a.localK == b.localK && a.adaptiveC == b.adaptiveC;
+        case ProcessingMode::MULTI_LAYER:
+            return a.layerCount == b.layerCount && a.equalizeLayers == b.equalizeLayers;
+        case ProcessingMode::CONTOUR_POLYGON:
+            return a.polygonEpsilon == b.polygonEpsilon && a.minContourArea == b.minContourArea;
+        default:
+            return true;
+    }
+}
+
 /**
  * @brief Apply simple threshold processing
  * @param image Input grayscale image
@@ -323,29 +1014,56 @@ cv::Mat StencilGenerator::applyAdaptiveThreshold(const cv::Mat &image, const Ste
 }
 
 /**
- * @brief Apply multi-layer stencil processing
+ * @brief Apply local threshold (mean, Niblack or Sauvola)
  * @param image Input grayscale image
  * @param params Processing parameters
- * @return Multi-layer stencil image
+ * @return Thresholded binary image
+ *
+ * Same polarity as applyAdaptiveThreshold(), but the block statistics come
+ * from running sums, so large blocks for uneven lighting cost no more
+ * than small ones.
  */
-cv::Mat StencilGenerator::applyMultiLayer(const cv::Mat &image, const StencilParams &params) {
-    cv::Mat result = cv::Mat::zeros(image.size(), CV_8UC1);
+cv::Mat StencilGenerator::applyLocalThreshold(const cv::Mat &image, const StencilParams &params) {
+    stencil::LocalThresholdParams local;
+    local.method = params.localMethod;
+    local.block_size = params.localBlockSize | 1;
+    local.k = params.localK;
+    local.offset = params.adaptiveC;
     
-    // Calculate layer thresholds
-    int layerStep = 255 / params.layerCount;
+    cv::Mat result;
+    stencil::localThreshold(image, result, local);
+    return result;
+}
+
+/**
+ * @brief Apply multi-layer processing
+ * @param image Preprocessed grayscale image
+ * @param params Processing parameters
+ * @param layerMasks Optional per-layer 0/255 masks, filled in the same pass
+ * @return Multi-layer image, darkest layer brightest
+ */
+cv::Mat StencilGenerator::applyMultiLayer(const cv::Mat &image, const StencilParams &params,
+                                          std::vector<cv::Mat> *layerMasks) {
+    stencil::LayerSpec spec = params.equalizeLayers ? stencil::equalizedLayers(image, params.layerCount)
+                                                    : stencil::uniformLayers(params.layerCount);
     
-    for (int i = 0; i < params.layerCount; i++) {
-        int lowThresh = i * layerStep;
-        int highThresh = (i + 1) * layerStep;
-        
-        cv::Mat layer;
-        cv::inRange(image, lowThresh, highThresh, layer);
-        
-        // Assign different gray levels to each layer
-        int grayValue = 255 - (i * (255 / params.layerCount));
-        result.setTo(grayValue, layer);
+    // Assign different gray levels to each layer; equal-width bands keep
+    // their original cuts at multiples of 255 / layerCount. The spec has
+    // the layer count clamped to what the quantizer supports.
+    const int layerCount = static_cast<int>(spec.tones.size());
+    const int layerStep = 255 / layerCount;
+    for (size_t i = 0; i < spec.tones.size(); i++) {
+        spec.tones[i] = static_cast<uchar>(255 - static_cast<int>(i) * layerStep);
+    }
+    if (!params.equalizeLayers) {
+        for (size_t i = 0; i < spec.boundaries.size(); i++) {
+            spec.boundaries[i] = (static_cast<int>(i) + 1) * layerStep - 1;
+        }
     }
     
+    // Single LUT sweep, every gray value belongs to exactly one layer
+    cv::Mat result;
+    stencil::quantizeLayers(image, result, spec, layerMasks);
     return result;
 }
 
@@ -430,43 +1148,96 @@ cv::Mat StencilGenerator::applyDetailPreserving(const cv::Mat &image, const Sten
     return result;
 }
 
+/**
+ * @brief Export a stencil result as SVG or DXF outlines
+ * @param result Completed stencil result
+ * @param filePath Target file; the extension (.svg/.dxf) picks the format
+ * @param polygonEpsilon Simplification tolerance in pixels
+ * @return true if the file was written
+ *
+ * The black regions (the cut-outs) are traced from the stencil image, as in
+ * the CPP saveStencilAsSVG/DXF, so both export the same shapes. White is
+ * the sheet and its bridges; its outline is not exported.
+ */
+bool StencilGenerator::exportVector(const StencilResult &result, const QString &filePath,
+                                    double polygonEpsilon) {
+    stencil::VectorFormat format;
+    if (!stencil::vectorFormatFromPath(filePath.toStdString(), format)) {
+        qWarning() << "Unsupported vector format:" << filePath;
+        return false;
+    }
+    
+    const cv::Mat &stencilMat = result.stencilImage.mat();
+    if (stencilMat.empty()) {
+        return false;
+    }
+    
+    // Black cut-outs on a white page, as the stencil looks on screen
+    stencil::VectorExportOptions options;
+    options.epsilon = polygonEpsilon;
+    
+    try {
+        cv::Mat binary = convertToGrayscale(stencilMat);
+        cv::threshold(binary, binary, 127, 255, cv::THRESH_BINARY_INV);
+        
+        stencil::VectorExportStats stats;
+        bool ok = stencil::exportBinary(filePath.toStdString(), format, binary, options, &stats);
+        
+        qDebug() << "Vector export:" << filePath << stats.shapes << "shapes,"
+                 << stats.holes << "holes," << stats.vertices << "vertices";
+        return ok;
+    } catch (const cv::Exception &e) {
+        qCritical() << "OpenCV error exporting vectors:" << e.what();
+        return false;
+    }
+}
+
+/**
+ * @brief Export a stencil result as G-code toolpaths
+ * @param result Completed stencil result
+ * @param filePath Target .gcode/.nc file
+ * @param options Machine, kerf and ordering options
+ * @param stats Optional output for path count, travel and time estimate
+ * @return true if the file was written
+ *
+ * The black regions are cut, like the shapes of exportVector; the white
+ * sheet and its bridges stay. The full contour tree is traced here so
+ * nested shapes are cut inside-first.
+ */
+bool StencilGenerator::exportGcode(const StencilResult &result, const QString &filePath,
+                                   const stencil::GcodeOptions &options, stencil::GcodeStats *stats) {
+    const cv::Mat &stencilMat = result.stencilImage.mat();
+    if (stencilMat.empty()) {
+        return false;
+    }
+    
+    try {
+        cv::Mat binary = convertToGrayscale(stencilMat);
+        cv::threshold(binary, binary, 127, 255, cv::THRESH_BINARY_INV);
+        
+        stencil::GcodeStats local;
+        stencil::GcodeStats &gcodeStats = stats ? *stats : local;
+        bool ok = stencil::exportGcode(filePath.toStdString(), binary, options, &gcodeStats);
+        
+        qDebug() << "G-code export:" << filePath << gcodeStats.paths << "paths,"
+                 << gcodeStats.travel_length_mm << "mm travel (unoptimized"
+                 << gcodeStats.travel_unoptimized_mm << "mm),"
+                 << gcodeStats.total_time_s << "s estimated";
+        return ok;
+    } catch (const cv::Exception &e) {
+        qCritical() << "OpenCV error exporting G-code:" << e.what();
+        return false;
+    }
+}
+
 /**
  * @brief Convert OpenCV Mat to Qt QImage
- * @param mat OpenCV Mat to convert
- * @return QImage
+ * @param mat OpenCV Mat to convert (3/4 channels in the generator's RGB order)
+ * @return QImage sharing the Mat's buffer
  */
 QImage StencilGenerator::cvMatToQImage(const cv::Mat &mat) {
     try {
-        if (mat.empty()) {
-            return QImage();
-        }
-        
-        // Convert based on number of channels
-        switch (mat.type()) {
-            case CV_8UC1: {  // Grayscale
-                QImage image(mat.data, mat.cols, mat.rows, 
-                            static_cast<int>(mat.step), QImage::Format_Grayscale8);
-                return image.copy();  // Copy to ensure data persistence
-            }
-            case CV_8UC3: {  // RGB
-                cv::Mat rgb;
-                cv::cvtColor(mat, rgb, cv::COLOR_BGR2RGB);
-                QImage image(rgb.data, rgb.cols, rgb.rows, 
-                            static_cast<int>(rgb.step), QImage::Format_RGB888);
-                return image.copy();
-            }
-            case CV_8UC4: {  // RGBA
-                QImage image(mat.data, mat.cols, mat.rows, 
-                            static_cast<int>(mat.step), QImage::Format_RGBA8888);
-                return image.copy();
-            }
-            default: {
-                // Convert to 8-bit
-                cv::Mat converted;
-                mat.convertTo(converted, CV_8UC(mat.channels()));
-                return cvMatToQImage(converted);
-            }
-        }
+        return SharedImage(mat).toQImage();
     } catch (const cv::Exception &e) {
         qCritical() << "Error converting CV Mat to QImage:" << e.what();
         return QImage();
@@ -476,34 +1247,15 @@ QImage StencilGenerator::cvMatToQImage(const cv::Mat &mat) {
 /**
  * @brief Convert Qt QImage to OpenCV Mat
  * @param image QImage to convert
- * @return OpenCV Mat
+ * @return OpenCV Mat in the generator's RGB order, owning its pixels
  */
 cv::Mat StencilGenerator::qImageToCvMat(const QImage &image) {
     try {
-        if (image.isNull()) {
-            return cv::Mat();
-        }
-        
-        QImage converted = image;
-        if (image.format() != QImage::Format_RGB888 && 
-            image.format() != QImage::Format_Grayscale8) {
-            converted = image.convertToFormat(QImage::Format_RGB888);
-        }
-        
-        cv::Mat mat(converted.height(), converted.width(),
-                   converted.format() == QImage::Format_Grayscale8 ? CV_8UC1 : CV_8UC3,
-                   const_cast<uchar*>(converted.bits()),
-                   static_cast<size_t>(converted.bytesPerLine()));
-        
-        cv::Mat result;
-        mat.copyTo(result);  // Create a deep copy
-        
-        // Convert RGB to BGR if needed
-        if (result.channels() == 3) {
-            cv::cvtColor(result, result, cv::COLOR_RGB2BGR);
+        SharedImage shared = SharedImage::fromQImage(image);
+        if (shared.channelOrder() == SharedImage::ChannelOrder::BGR && shared.channels() > 1) {
+            return shared.toMat(SharedImage::ChannelOrder::RGB);  // Swizzle is the only copy
         }
-        
-        return result;
+        return shared.mat().clone();
     } catch (...) {
         qCritical() << "Error converting QImage to CV Mat";
         return cv::Mat();
@@ -512,92 +1264,214 @@ cv::Mat StencilGenerator::qImageToCvMat(const QImage &image) {
 
 // Additional helper implementations...
 
-cv::Mat StencilGenerator::adjustBrightnessContrast(const cv::Mat &image, float alpha, float beta) {
-    cv::Mat result;
-    image.convertTo(result, -1, alpha, beta);
-    return result;
+/**
+ * @brief Build the 256-entry tone table for the fused preprocessing kernel
+ * @param params Processing parameters
+ * @param binarize Also fold the simple threshold and optional inversion into the table
+ * @return 1x256 CV_8UC1 lookup table
+ *
+ * The table is produced by running the regular per-pixel stages over a
+ * 0..255 ramp, so the fused path matches the staged path exactly.
+ */
+cv::Mat StencilGenerator::buildToneLut(const StencilParams &params, bool binarize) {
+    cv::Mat lut = stencil::identityLut();
+    
+    if (params.brightness != 0.0f || params.contrast != 1.0f) {
+        lut = adjustBrightnessContrast(lut, params.contrast, params.brightness);
+    }
+    
+    if (binarize) {
+        lut = applySimpleThreshold(lut, params);
+        if (params.invertColors) {
+            cv::bitwise_not(lut, lut);
+        }
+    }
+    
+    return lut;
 }
 
-cv::Mat StencilGenerator::detectFloatingIslands(const cv::Mat &binaryImage) {
-    cv::Mat islands = cv::Mat::zeros(binaryImage.size(), CV_8UC1);
+/**
+ * @brief Downscale an image so its longest side fits maxSize
+ * @param image Input image
+ * @param maxSize Maximum width/height in pixels
+ * @param keepAspect Keep the aspect ratio (otherwise resize to maxSize x maxSize)
+ * @return Resized image, or the input itself when it already fits
+ */
+cv::Mat StencilGenerator::resizeImage(const cv::Mat &image, int maxSize, bool keepAspect) {
+    if (image.empty() || maxSize <= 0 || std::max(image.cols, image.rows) <= maxSize) {
+        return image;
+    }
     
-    // Find connected components
-    cv::Mat labels, stats, centroids;
-    int numLabels = cv::connectedComponentsWithStats(binaryImage, labels, stats, centroids, 8);
+    cv::Size size(maxSize, maxSize);
+    if (keepAspect) {
+        double scale = static_cast<double>(maxSize) / std::max(image.cols, image.rows);
+        size = cv::Size(std::max(1, cvRound(image.cols * scale)),
+                        std::max(1, cvRound(image.rows * scale)));
+    }
     
-    // Check which components touch the border
-    cv::Mat borderMask = cv::Mat::zeros(binaryImage.size(), CV_8UC1);
-    borderMask.row(0).setTo(1);
-    borderMask.row(borderMask.rows - 1).setTo(1);
-    borderMask.col(0).setTo(1);
-    borderMask.col(borderMask.cols - 1).setTo(1);
+    cv::Mat resized;
+    cv::resize(image, resized, size, 0, 0, cv::INTER_AREA);
+    return resized;
+}
+
+/**
+ * @brief Gaussian blur with a kernel of radius pixels
+ * @param image Input image
+ * @param radius Kernel radius
+ * @return Blurred image
+ */
+cv::Mat StencilGenerator::applyGaussianBlur(const cv::Mat &image, int radius) {
+    cv::Mat blurred;
+    cv::GaussianBlur(image, blurred, cv::Size(radius * 2 + 1, radius * 2 + 1), 0);
+    return blurred;
+}
+
+/**
+ * @brief Edge-preserving bilateral filter
+ * @param image Input image
+ * @param d Filter diameter
+ * @param sigmaColor Range sigma
+ * @param sigmaSpace Spatial sigma
+ * @return Filtered image
+ */
+cv::Mat StencilGenerator::applyBilateralFilter(const cv::Mat &image, int d, double sigmaColor, double sigmaSpace) {
+    cv::Mat filtered;
+    cv::bilateralFilter(image, filtered, d, sigmaColor, sigmaSpace);
+    return filtered;
+}
+
+/**
+ * @brief Bilateral filter approximated on a downsampled grid
+ * @param image Input grayscale image
+ * @param d Filter diameter
+ * @param sigmaColor Range sigma
+ * @param sigmaSpace Spatial sigma
+ * @return Filtered image; near-constant cost per pixel for any diameter
+ */
+cv::Mat StencilGenerator::applyBilateralGrid(const cv::Mat &image, int d, double sigmaColor, double sigmaSpace) {
+    cv::Mat filtered;
+    stencil::bilateralGrid(image, filtered, d, sigmaColor, sigmaSpace);
+    return filtered;
+}
+
+/**
+ * @brief Convert an RGB image to single-channel grayscale
+ * @param image Input image (RGB order, as stored by loadImage)
+ * @return Grayscale image
+ */
+cv::Mat StencilGenerator::convertToGrayscale(const cv::Mat &image) {
+    cv::Mat gray;
+    if (image.channels() == 3) {
+        cv::cvtColor(image, gray, cv::COLOR_RGB2GRAY);
+    } else if (image.channels() == 4) {
+        cv::cvtColor(image, gray, cv::COLOR_RGBA2GRAY);
+    } else {
+        gray = image.clone();
+    }
+    return gray;
+}
+
+/**
+ * @brief Remove foreground specks smaller than minArea
+ * @param binaryImage Binary image, non-zero pixels are foreground
+ * @param minArea Components below this many pixels are cleared
+ * @return Cleaned binary image
+ */
+cv::Mat StencilGenerator::removeSmallNoise(const cv::Mat &binaryImage, int minArea) {
+    cv::Mat labels, stats, centroids;
+    int numLabels = cv::connectedComponentsWithStats(binaryImage, labels, stats, centroids, 8, CV_32S);
     
+    // Per-label keep table, then one pass over the pixels
+    std::vector<uchar> keep(numLabels, 0);
     for (int i = 1; i < numLabels; i++) {
-        bool touchesBorder = false;
-        
-        // Check if component touches border
-        for (int y = 0; y < labels.rows && !touchesBorder; y++) {
-            const int* row = labels.ptr<int>(y);
-            for (int x = 0; x < labels.cols; x++) {
-                if (row[x] == i && borderMask.at<uchar>(y, x)) {
-                    touchesBorder = true;
-                    break;
-                }
-            }
-        }
-        
-        // Mark as island if doesn't touch border
-        if (!touchesBorder && stats.at<int>(i, cv::CC_STAT_AREA) > 50) {
-            cv::Mat component = (labels == i);
-            islands.setTo(255, component);
-        }
+        keep[i] = stats.at<int>(i, cv::CC_STAT_AREA) >= minArea ? 255 : 0;
     }
     
-    return islands;
+    cv::Mat cleaned(binaryImage.size(), CV_8UC1);
+    for (int y = 0; y < labels.rows; y++) {
+        const int *labelRow = labels.ptr<int>(y);
+        uchar *outRow = cleaned.ptr<uchar>(y);
+        for (int x = 0; x < labels.cols; x++) {
+            outRow[x] = keep[labelRow[x]];
+        }
+    }
+    return cleaned;
+}
+
+/**
+ * @brief Find the outer contours of a binary image
+ * @param binaryImage Binary image, non-zero pixels are foreground
+ * @return Outer contours
+ */
+std::vector<std::vector<cv::Point>> StencilGenerator::findContours(const cv::Mat &binaryImage) {
+    std::vector<std::vector<cv::Point>> contours;
+    cv::findContours(binaryImage, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+    return contours;
+}
+
+cv::Mat StencilGenerator::adjustBrightnessContrast(const cv::Mat &image, float alpha, float beta) {
+    cv::Mat result;
+    image.convertTo(result, -1, alpha, beta);
+    return result;
+}
+
+/**
+ * @brief Label the foreground and classify floating islands
+ * @param binaryImage Binary image, non-zero pixels are foreground
+ * @return Island table shared with the bridging stage
+ */
+stencil::IslandTable StencilGenerator::analyzeIslands(const cv::Mat &binaryImage) {
+    return stencil::analyzeIslands(binaryImage);
 }
 
+/**
+ * @brief Mask of all foreground components that do not touch the border
+ * @param binaryImage Binary image, non-zero pixels are foreground
+ * @return CV_8U mask, 255 on island pixels
+ */
+cv::Mat StencilGenerator::detectFloatingIslands(const cv::Mat &binaryImage) {
+    stencil::IslandTable islands = analyzeIslands(binaryImage);
+    if (islands.mask.empty()) {
+        return cv::Mat::zeros(binaryImage.size(), CV_8UC1);
+    }
+    return islands.mask;
+}
+
+/**
+ * @brief Bridge every floating island to the image border
+ * @param stencil Binary stencil
+ * @param bridgeWidth Bridge line width in pixels
+ * @param bridgeColor Bridge color
+ * @return Stencil with bridges drawn
+ */
 cv::Mat StencilGenerator::autoBridgeIslands(const cv::Mat &stencil, int bridgeWidth, uchar bridgeColor) {
+    return autoBridgeIslands(stencil, analyzeIslands(stencil), bridgeWidth, bridgeColor);
+}
+
+/**
+ * @brief Bridge islands from an existing island table
+ * @param stencil Binary stencil the table was computed from
+ * @param islands Island table
+ * @param bridgeWidth Bridge line width in pixels
+ * @param bridgeColor Bridge color
+ * @param plan Optional output for the planned bridges and their total length
+ * @return Stencil with bridges drawn
+ *
+ * Each island is routed to an approximately nearest connected pixel
+ * (border-touching component or image edge, found by a two-pass chamfer
+ * sweep) rather than straight to the closest edge.
+ */
+cv::Mat StencilGenerator::autoBridgeIslands(const cv::Mat &stencil, const stencil::IslandTable &islands,
+                                            int bridgeWidth, uchar bridgeColor,
+                                            stencil::BridgePlan *plan) {
     cv::Mat result = stencil.clone();
-    cv::Mat islands = detectFloatingIslands(stencil);
     
-    if (islands.empty()) {
-        return result;
-    }
-    
-    // Find contours of islands
-    std::vector<std::vector<cv::Point>> contours;
-    cv::findContours(islands, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+    stencil::BridgePlan bridges = stencil::planBridges(islands);
+    stencil::drawBridges(result, bridges, bridgeWidth, bridgeColor);
     
-    for (const auto& contour : contours) {
-        if (contour.empty()) continue;
-        
-        // Find centroid
-        cv::Moments m = cv::moments(contour);
-        if (m.m00 == 0) continue;
-        
-        cv::Point centroid(static_cast<int>(m.m10 / m.m00),
-                          static_cast<int>(m.m01 / m.m00));
-        
-        // Find closest border direction
-        int leftDist = centroid.x;
-        int rightDist = result.cols - centroid.x - 1;
-        int topDist = centroid.y;
-        int bottomDist = result.rows - centroid.y - 1;
-        
-        cv::Point endPoint;
-        if (leftDist <= rightDist && leftDist <= topDist && leftDist <= bottomDist) {
-            endPoint = cv::Point(0, centroid.y);
-        } else if (rightDist <= leftDist && rightDist <= topDist && rightDist <= bottomDist) {
-            endPoint = cv::Point(result.cols - 1, centroid.y);
-        } else if (topDist <= leftDist && topDist <= rightDist && topDist <= bottomDist) {
-            endPoint = cv::Point(centroid.x, 0);
-        } else {
-            endPoint = cv::Point(centroid.x, result.rows - 1);
-        }
-        
-        // Draw bridge
-        cv::line(result, centroid, endPoint, bridgeColor, bridgeWidth, cv::LINE_AA);
+    if (plan) {
+        *plan = std::move(bridges);
     }
     
     return result;
-}
\ No newline at end of file
+}
@@ -0,0 +1,474 @@
+#include "TilePyramid.hpp"
+#include <QMutexLocker>
+#include <QPainter>
+#include <QThread>
+#include <QtMath>
+
+/**
+ * @brief Constructor for TilePyramid
+ * @param parent Parent object
+ */
+TilePyramid::TilePyramid(QObject *parent)
+    : QObject(parent) {
+    // The level chain takes one thread; the rest cut tiles
+    pool_.setMaxThreadCount(qMax(2, QThread::idealThreadCount() / 2));
+    tiles_.setMaxCost(128 * 1024);
+}
+
+/**
+ * @brief Destructor; waits for background work still touching the levels
+ */
+TilePyramid::~TilePyramid() {
+    generation_++;
+    pool_.clear();
+    pool_.waitForDone();
+}
+
+/**
+ * @brief Start a new pyramid for an image
+ * @param image Image to display; shared, not copied
+ *
+ * Returns at once. Level 0 is usable immediately, the coarser levels
+ * follow in the background.
+ */
+void TilePyramid::setImage(const QImage &image) {
+    setImage(image, 0, image.size());
+}
+
+/**
+ * @brief Start a new pyramid from one of its levels
+ * @param image Image of the given level; shared, not copied
+ * @param level Level the image is, i.e. fullSize halved this many times
+ * @param fullSize Size of level 0
+ *
+ * The pyramid has the geometry of fullSize, but nothing finer than level
+ * is drawn until refineImage() supplies it. The coarser levels are built
+ * from image in the background.
+ */
+void TilePyramid::setImage(const QImage &image, int level, const QSize &fullSize) {
+    clear();
+    if (image.isNull() || level < 0) {
+        return;
+    }
+    
+    QSize size = fullSize;
+    levelSizes_.append(size);
+    while (size.width() > TileSize || size.height() > TileSize || levelSizes_.size() <= level) {
+        size = QSize(qMax(1, size.width() / 2), qMax(1, size.height() / 2));
+        levelSizes_.append(size);
+    }
+    Q_ASSERT(levelSizes_[level] == image.size());
+    
+    {
+        QMutexLocker locker(&levelMutex_);
+        levels_.fill(QImage(), levelSizes_.size());
+        levels_[level] = image;
+    }
+    finestLevel_ = level;
+    builtLevels_ = level + 1;
+    
+    if (levelSizes_.size() > level + 1) {
+        const quint64 generation = generation_;
+        const QVector<QSize> sizes = levelSizes_;
+        pool_.start([this, generation, image, sizes, level]() {
+            buildLevels(generation, image, sizes, level);
+        });
+    }
+}
+
+/**
+ * @brief Add a level finer than any known so far
+ * @param image Image of the level; shared, not copied
+ * @param level Level the image is; must be finer than finestLevel()
+ * @return false if the pyramid cannot take the image (no pyramid, not a
+ *         finer level, or the wrong size); the caller should use setImage()
+ *
+ * The new level is drawn from now on. Its tiles are cut as the view asks
+ * for them, and until one arrives the cached coarser tile over the same
+ * area stands in. Every cached tile is marked stale, since the coarser
+ * levels are rebuilt from the new image in the background; each is still
+ * drawn until its replacement arrives, so the swap never flashes.
+ */
+bool TilePyramid::refineImage(const QImage &image, int level) {
+    if (isNull() || level < 0 || level >= finestLevel_ || image.size() != levelSize(level)) {
+        return false;
+    }
+    
+    // Work on the coarser image still in flight is dropped, not merged
+    generation_++;
+    pool_.clear();
+    pending_.clear();
+    
+    update_++;
+    const QList<quint64> cached = tiles_.keys();
+    for (quint64 key : cached) {
+        stale_.insert(key, update_);
+    }
+    
+    {
+        QMutexLocker locker(&levelMutex_);
+        levels_.fill(QImage());
+        levels_[level] = image;
+    }
+    finestLevel_ = level;
+    builtLevels_ = level + 1;
+    
+    if (levelCount() > level + 1) {
+        const quint64 generation = generation_;
+        const QVector<QSize> sizes = levelSizes_;
+        pool_.start([this, generation, image, sizes, level]() {
+            buildLevels(generation, image, sizes, level);
+        });
+    }
+    return true;
+}
+
+/**
+ * @brief Find which level of a pyramid an image size is
+ * @param size Image size
+ * @param fullSize Size of level 0
+ * @return Number of halvings from fullSize to size, or -1 if none gives it
+ */
+int TilePyramid::levelOf(const QSize &size, const QSize &fullSize) {
+    QSize level = fullSize;
+    for (int index = 0; index < 32 && !level.isEmpty(); index++) {
+        if (level == size) {
+            return index;
+        }
+        if (level == QSize(1, 1)) {
+            break;
+        }
+        level = QSize(qMax(1, level.width() / 2), qMax(1, level.height() / 2));
+    }
+    return -1;
+}
+
+/**
+ * @brief Drop the image, its levels and every cached tile
+ */
+void TilePyramid::clear() {
+    generation_++;
+    pool_.clear();
+    
+    levelSizes_.clear();
+    {
+        QMutexLocker locker(&levelMutex_);
+        levels_.clear();
+    }
+    tiles_.clear();
+    pending_.clear();
+    stale_.clear();
+    finestLevel_ = 0;
+    builtLevels_ = 0;
+}
+
+/**
+ * @brief Swap in a same-sized image, rebuilding only what changed
+ * @param image New image
+ * @param changed Area that differs from the current image, in image pixels
+ * @return false if the pyramid cannot be patched (no image, another size,
+ *         a pyramid still missing its finest levels, or levels still
+ *         building); the caller should use setImage()
+ *
+ * Level 0 is replaced at once. Changed areas of the coarser levels are
+ * rescaled in the background, and every cached tile over the changed area
+ * is marked stale: it is still drawn, and replaced the next time it is
+ * asked for once its level is ready.
+ */
+bool TilePyramid::updateImage(const QImage &image, const QRegion &changed) {
+    if (isNull() || image.size() != imageSize() || finestLevel_ > 0 ||
+        builtLevels_ < levelCount()) {
+        return false;
+    }
+    
+    update_++;
+    QVector<QImage> levels;
+    {
+        QMutexLocker locker(&levelMutex_);
+        levels_[0] = image;
+        if (changed.isEmpty()) {
+            return true;
+        }
+        // Coarser levels are unavailable until patched; their tiles wait
+        levels = levels_;
+        for (int level = 1; level < levels_.size(); level++) {
+            levels_[level] = QImage();
+        }
+    }
+    builtLevels_ = 1;
+    
+    QVector<QRect> rects;
+    for (const QRect &rect : changed) {
+        rects.append(rect.intersected(QRect(QPoint(0, 0), imageSize())));
+    }
+    
+    // Mark every cached or in-flight tile over the changed area
+    for (int level = 0; level < levelCount(); level++) {
+        for (const QRect &rect : rects) {
+            const int firstColumn = (rect.left() >> level) / TileSize;
+            const int lastColumn = (rect.right() >> level) / TileSize;
+            const int firstRow = (rect.top() >> level) / TileSize;
+            const int lastRow = (rect.bottom() >> level) / TileSize;
+            for (int row = firstRow; row <= lastRow; row++) {
+                for (int column = firstColumn; column <= lastColumn; column++) {
+                    const quint64 key = tileKey(level, column, row);
+                    if (tiles_.contains(key) || pending_.contains(key)) {
+                        stale_.insert(key, update_);
+                    }
+                }
+            }
+        }
+    }
+    
+    if (levelCount() > 1) {
+        const quint64 generation = generation_;
+        pool_.start([this, generation, levels, rects]() { patchLevels(generation, levels, rects); });
+    }
+    return true;
+}
+
+/**
+ * @brief Pick the level to draw at a display scale
+ * @param scale Display pixels per image pixel
+ * @return Coarsest level that still has at least one pixel per display pixel,
+ *         but no finer than the finest level known
+ */
+int TilePyramid::levelForScale(double scale) const {
+    if (isNull() || scale >= 1.0) {
+        return finestLevel_;
+    }
+    int level = static_cast<int>(qFloor(std::log2(1.0 / scale)));
+    return qBound(finestLevel_, level, levelCount() - 1);
+}
+
+/**
+ * @brief Area a tile covers
+ * @param level Pyramid level
+ * @param column Tile column
+ * @param row Tile row
+ * @return Rectangle in the level's pixel coordinates, clipped to the level
+ */
+QRect TilePyramid::tileRect(int level, int column, int row) const {
+    QRect rect(column * TileSize, row * TileSize, TileSize, TileSize);
+    return rect.intersected(QRect(QPoint(0, 0), levelSize(level)));
+}
+
+/**
+ * @brief Get a tile, scheduling it if it is not ready
+ * @param level Pyramid level
+ * @param column Tile column
+ * @param row Tile row
+ * @return Tile pixmap, or a null pixmap until tileReady() is emitted for it
+ */
+QPixmap TilePyramid::tile(int level, int column, int row) {
+    if (level < 0 || level >= levelCount() || tileRect(level, column, row).isEmpty()) {
+        return QPixmap();
+    }
+    
+    const quint64 key = tileKey(level, column, row);
+    if (QPixmap *cached = tiles_.object(key)) {
+        // A stale tile is shown until its replacement arrives
+        if (stale_.contains(key)) {
+            requestTile(key, level, column, row);
+        }
+        return *cached;
+    }
+    
+    requestTile(key, level, column, row);
+    return QPixmap();
+}
+
+/**
+ * @brief Get a tile only if it is already cached
+ * @param level Pyramid level
+ * @param column Tile column
+ * @param row Tile row
+ * @return Tile pixmap or a null pixmap; never schedules work
+ */
+QPixmap TilePyramid::cachedTile(int level, int column, int row) const {
+    QPixmap *cached = tiles_.object(tileKey(level, column, row));
+    return cached ? *cached : QPixmap();
+}
+
+/**
+ * @brief Cache key of a tile
+ */
+quint64 TilePyramid::tileKey(int level, int column, int row) {
+    return (static_cast<quint64>(level) << 48) | (static_cast<quint64>(row) << 24) |
+           static_cast<quint64>(column);
+}
+
+/**
+ * @brief Thread-safe access to a level
+ * @param level Pyramid level
+ * @return Level image, null while it is still being built
+ */
+QImage TilePyramid::levelImage(int level) const {
+    QMutexLocker locker(&levelMutex_);
+    return levels_.value(level);
+}
+
+/**
+ * @brief Queue a tile unless it is already on its way
+ */
+void TilePyramid::requestTile(quint64 key, int level, int column, int row) {
+    if (pending_.contains(key)) {
+        return;
+    }
+    
+    // Tiles of levels still being built wait for onLevelBuilt()
+    const bool ready = !levelImage(level).isNull();
+    pending_.insert(key, ready);
+    if (ready) {
+        startTileJob(key, level, column, row);
+    }
+}
+
+/**
+ * @brief Cut a tile out of its level on the pool
+ */
+void TilePyramid::startTileJob(quint64 key, int level, int column, int row) {
+    const quint64 generation = generation_;
+    const quint64 update = update_;
+    const QImage source = levelImage(level);
+    const QRect rect = tileRect(level, column, row);
+    pool_.start([this, generation, update, key, level, column, row, source, rect]() {
+        if (generation != generation_) {
+            return;
+        }
+        QImage image = source.copy(rect);
+        QMetaObject::invokeMethod(this, [=]() {
+            onTileBuilt(generation, update, key, level, column, row, image);
+        }, Qt::QueuedConnection);
+    });
+}
+
+/**
+ * @brief Build every level coarser than a given one by halving the previous one
+ * @param generation Image generation the work belongs to
+ * @param image Image of the starting level
+ * @param sizes Size of every level
+ * @param first Level of image (0 for a whole image)
+ *
+ * Runs on the pool. Each level is a smooth half-size copy of the one
+ * below, so building the whole pyramid reads the image only once.
+ */
+void TilePyramid::buildLevels(quint64 generation, QImage image, QVector<QSize> sizes, int first) {
+    QImage previous = image;
+    for (int level = first + 1; level < sizes.size(); level++) {
+        if (generation != generation_) {
+            return;
+        }
+        
+        QImage next = previous.scaled(sizes[level], Qt::IgnoreAspectRatio,
+                                      Qt::SmoothTransformation);
+        {
+            QMutexLocker locker(&levelMutex_);
+            if (generation != generation_) {
+                return;
+            }
+            levels_[level] = next;
+        }
+        previous = next;
+        
+        QMetaObject::invokeMethod(this, [this, generation, level]() {
+            onLevelBuilt(generation, level);
+        }, Qt::QueuedConnection);
+    }
+}
+
+/**
+ * @brief Rescale the changed areas of every level above 0
+ * @param generation Image generation the work belongs to
+ * @param levels Levels before the update, level 0 already replaced
+ * @param rects Changed areas in level 0 pixels
+ *
+ * Runs on the pool. Each area is widened to even coordinates so its
+ * half-size copy covers whole pixels of the next level.
+ */
+void TilePyramid::patchLevels(quint64 generation, QVector<QImage> levels, QVector<QRect> rects) {
+    for (int level = 1; level < levels.size(); level++) {
+        if (generation != generation_) {
+            return;
+        }
+    
+        const QImage &previous = levels[level - 1];
+        const QRect bounds(QPoint(0, 0), levels[level].size());
+        QImage next = levels[level];
+        {
+            QPainter painter(&next);
+            painter.setCompositionMode(QPainter::CompositionMode_Source);
+            for (QRect &rect : rects) {
+                if (rect.isEmpty()) {
+                    continue;
+                }
+                QRect source(QPoint(rect.left() & ~1, rect.top() & ~1),
+                             QPoint(rect.right() | 1, rect.bottom() | 1));
+                source = source.intersected(previous.rect());
+                QRect target(source.left() / 2, source.top() / 2,
+                             qMax(1, source.width() / 2), qMax(1, source.height() / 2));
+                target = target.intersected(bounds);
+                if (!target.isEmpty()) {
+                    painter.drawImage(target.topLeft(),
+                                      previous.copy(source).scaled(target.size(),
+                                                                   Qt::IgnoreAspectRatio,
+                                                                   Qt::SmoothTransformation));
+                }
+                rect = target;
+            }
+        }
+        levels[level] = next;
+    
+        {
+            QMutexLocker locker(&levelMutex_);
+            if (generation != generation_) {
+                return;
+            }
+            levels_[level] = next;
+        }
+    
+        QMetaObject::invokeMethod(this, [this, generation, level]() {
+            onLevelBuilt(generation, level);
+        }, Qt::QueuedConnection);
+    }
+}
+
+/**
+ * @brief Start the tiles that were requested before their level existed
+ */
+void TilePyramid::onLevelBuilt(quint64 generation, int level) {
+    if (generation != generation_) {
+        return;
+    }
+    builtLevels_ = qMax(builtLevels_, level + 1);
+    
+    for (auto it = pending_.begin(); it != pending_.end(); ++it) {
+        const quint64 key = it.key();
+        if (!it.value() && static_cast<int>(key >> 48) == level) {
+            it.value() = true;
+            startTileJob(key, level, static_cast<int>(key & 0xFFFFFF),
+                         static_cast<int>((key >> 24) & 0xFFFFFF));
+        }
+    }
+}
+
+/**
+ * @brief Upload a finished tile and announce it
+ */
+void TilePyramid::onTileBuilt(quint64 generation, quint64 update, quint64 key, int level,
+                              int column, int row, const QImage &image) {
+    if (generation != generation_) {
+        return;
+    }
+    
+    // A tile cut before the latest update over it stays stale and is redone
+    pending_.remove(key);
+    if (stale_.value(key, 0) <= update) {
+        stale_.remove(key);
+    }
+    QPixmap *pixmap = new QPixmap(QPixmap::fromImage(image));
+    const int cost = qMax(1, static_cast<int>(image.sizeInBytes() / 1024));
+    tiles_.insert(key, pixmap, cost);
+    
+    emit tileReady(level, column, row);
+}
@@ -0,0 +1,97 @@
+#ifndef TILEPYRAMID_HPP
+#define TILEPYRAMID_HPP
+
+#include <QObject>
+#include <QImage>
+#include <QPixmap>
+#include <QCache>
+#include <QHash>
+#include <QMutex>
+#include <QThreadPool>
+#include <QRegion>
+#include <QVector>
+#include <atomic>
+
+/**
+ * @brief Mip-mapped tile pyramid of one image, built for the viewer
+ *
+ * Level 0 is the image itself (shared, not copied); every further level
+ * halves both dimensions, down to the first level that fits in one tile.
+ * The levels are built once per image on a private thread pool, finest
+ * first. Tiles are cut from the levels on the same pool only when the view
+ * asks for them and arrive through tileReady(); finished tiles are kept as
+ * pixmaps in a bounded cache, so panning back over an area is free.
+ *
+ * updateImage() swaps in a same-sized image and rebuilds only the changed
+ * area: the affected cached tiles are marked stale and keep being drawn
+ * until their replacement arrives, so the swap never flashes.
+ *
+ * A pyramid can also start from a coarse level alone, for results that
+ * arrive in steps of doubling resolution: levels finer than the finest
+ * known one are not drawn, and refineImage() adds a finer level the same
+ * way updateImage() replaces one, with the coarser tiles standing in.
+ *
+ * All public functions must be called from the GUI thread.
+ */
+class TilePyramid : public QObject {
+    Q_OBJECT
+
+public:
+    static constexpr int TileSize = 256;
+    
+    explicit TilePyramid(QObject *parent = nullptr);
+    ~TilePyramid();
+    
+    // Image
+    void setImage(const QImage &image);
+    void setImage(const QImage &image, int level, const QSize &fullSize);
+    bool refineImage(const QImage &image, int level);
+    bool updateImage(const QImage &image, const QRegion &changed);
+    void clear();
+    bool isNull() const { return levelSizes_.isEmpty(); }
+    QSize imageSize() const { return isNull() ? QSize() : levelSizes_.first(); }
+    
+    // Levels and tiles
+    int levelCount() const { return levelSizes_.size(); }
+    int levelForScale(double scale) const;
+    int finestLevel() const { return finestLevel_; }
+    static int levelOf(const QSize &size, const QSize &fullSize);
+    QSize levelSize(int level) const { return levelSizes_.value(level); }
+    QRect tileRect(int level, int column, int row) const;
+    
+    QPixmap tile(int level, int column, int row);
+    QPixmap cachedTile(int level, int column, int row) const;
+    
+    // Pixmap cache
+    void setCacheLimit(int kilobytes) { tiles_.setMaxCost(kilobytes); }
+    int cacheLimit() const { return tiles_.maxCost(); }
+
+signals:
+    void tileReady(int level, int column, int row);
+
+private:
+    QVector<QSize> levelSizes_;
+    QVector<QImage> levels_;             // Null until built; guarded by levelMutex_
+    mutable QMutex levelMutex_;
+    std::atomic<quint64> generation_{0}; // Bumped per image; stale work is dropped
+    
+    QCache<quint64, QPixmap> tiles_;     // Cost in kilobytes
+    QHash<quint64, bool> pending_;       // Requested tiles; true once a job is queued
+    QHash<quint64, quint64> stale_;      // Cached tiles out of date since the given update
+    quint64 update_ = 0;                 // Counts updateImage() calls
+    int finestLevel_ = 0;                // Finer levels are unknown (progressive results)
+    int builtLevels_ = 0;                // Levels [finestLevel_, builtLevels_) are complete
+    QThreadPool pool_;
+    
+    static quint64 tileKey(int level, int column, int row);
+    QImage levelImage(int level) const;
+    void requestTile(quint64 key, int level, int column, int row);
+    void startTileJob(quint64 key, int level, int column, int row);
+    void buildLevels(quint64 generation, QImage image, QVector<QSize> sizes, int level);
+    void patchLevels(quint64 generation, QVector<QImage> levels, QVector<QRect> rects);
+    void onLevelBuilt(quint64 generation, int level);
+    void onTileBuilt(quint64 generation, quint64 update, quint64 key, int level, int column,
+                     int row, const QImage &image);
+};
+
+#endif // TILEPYRAMID_HPP
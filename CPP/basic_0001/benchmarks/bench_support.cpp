@@ -0,0 +1,181 @@
+// benchmarks/bench_support.cpp
+#include "bench_support.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <new>
+#include <sstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+std::atomic<size_t> g_heap_allocs{0};
+std::atomic<size_t> g_heap_bytes{0};
+std::atomic<size_t> g_mat_allocs{0};
+std::atomic<size_t> g_mat_bytes{0};
+
+void* countedAlloc(size_t size) {
+    g_heap_allocs.fetch_add(1, std::memory_order_relaxed);
+    g_heap_bytes.fetch_add(size, std::memory_order_relaxed);
+    void* ptr = std::malloc(size ? size : 1);
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+// Forwards to the allocator that was the default before, counting buffers.
+// The UMatData it returns names the base allocator, so frees bypass this.
+class CountingMatAllocator : public cv::MatAllocator {
+public:
+    explicit CountingMatAllocator(cv::MatAllocator* base) : base_(base) {}
+    
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                           cv::AccessFlag flags, cv::UMatUsageFlags usage) const override {
+        cv::UMatData* u = base_->allocate(dims, sizes, type, data, step, flags, usage);
+        if (u && !data) {
+            g_mat_allocs.fetch_add(1, std::memory_order_relaxed);
+            g_mat_bytes.fetch_add(u->size, std::memory_order_relaxed);
+        }
+        return u;
+    }
+    
+    bool allocate(cv::UMatData* data, cv::AccessFlag flags, cv::UMatUsageFlags usage) const override {
+        return base_->allocate(data, flags, usage);
+    }
+    
+    void deallocate(cv::UMatData* data) const override {
+        base_->deallocate(data);
+    }
+
+private:
+    cv::MatAllocator* base_;
+};
+
+std::string escape(const std::string& text) {
+    std::string out;
+    for (char c : text) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+} // namespace
+
+// ────────────────────────── GLOBAL OPERATOR NEW ──────────────────────────
+void* operator new(size_t size) { return countedAlloc(size); }
+void* operator new[](size_t size) { return countedAlloc(size); }
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { std::free(ptr); }
+
+namespace stencil {
+namespace bench {
+
+void installCountingMatAllocator() {
+    static CountingMatAllocator allocator(cv::Mat::getDefaultAllocator());
+    cv::Mat::setDefaultAllocator(&allocator);
+}
+
+AllocationCounts allocationCounts() {
+    AllocationCounts counts;
+    counts.heap_allocs = g_heap_allocs.load(std::memory_order_relaxed);
+    counts.heap_bytes = g_heap_bytes.load(std::memory_order_relaxed);
+    counts.mat_allocs = g_mat_allocs.load(std::memory_order_relaxed);
+    counts.mat_bytes = g_mat_bytes.load(std::memory_order_relaxed);
+    return counts;
+}
+
+long peakRssKb() {
+#if defined(__unix__) || defined(__APPLE__)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return -1;
+    }
+#if defined(__APPLE__)
+    return usage.ru_maxrss / 1024;  // Bytes on macOS
+#else
+    return usage.ru_maxrss;         // Kilobytes on Linux
+#endif
+#else
+    return -1;
+#endif
+}
+
+cv::Mat syntheticImage(double megapixels, uint64_t seed) {
+    int width = std::max(64, cvRound(std::sqrt(megapixels * 1.0e6 * 4.0 / 3.0)));
+    int height = std::max(48, cvRound(width * 3.0 / 4.0));
+    cv::Mat image(height, width, CV_8UC3);
+    cv::RNG rng(seed);
+    
+    // Diagonal gradient background
+    for (int y = 0; y < height; ++y) {
+        cv::Vec3b* row = image.ptr<cv::Vec3b>(y);
+        for (int x = 0; x < width; ++x) {
+            uchar v = cv::saturate_cast<uchar>(40 + 160.0 * (x + y) / (width + height));
+            row[x] = cv::Vec3b(v, static_cast<uchar>(v / 2 + 60), static_cast<uchar>(255 - v));
+        }
+    }
+    
+    // Shapes: filled discs plus rings whose centres become floating islands
+    const double unit = width / 100.0;
+    const int shapes = std::max(8, cvRound(40 * megapixels));
+    for (int i = 0; i < shapes; ++i) {
+        cv::Point center(rng.uniform(0, width), rng.uniform(0, height));
+        int radius = std::max(2, cvRound(rng.uniform(0.5, 4.0) * unit));
+        cv::Scalar color(rng.uniform(0, 256), rng.uniform(0, 256), rng.uniform(0, 256));
+        if (i % 3 == 0) {
+            cv::circle(image, center, radius, cv::Scalar(0, 0, 0), std::max(2, radius / 4));
+            cv::circle(image, center, radius / 2, cv::Scalar(255, 255, 255), cv::FILLED);
+        } else {
+            cv::circle(image, center, radius, color, cv::FILLED);
+        }
+    }
+    cv::putText(image, "STENCIL", cv::Point(width / 10, height / 2), cv::FONT_HERSHEY_SIMPLEX,
+                width / 200.0, cv::Scalar(10, 10, 10), std::max(1, cvRound(unit)));
+    
+    // Sensor-like noise
+    cv::Mat noise(image.size(), CV_16SC3);
+    rng.fill(noise, cv::RNG::NORMAL, 0, 12);
+    cv::add(image, noise, image, cv::noArray(), CV_8UC3);
+    return image;
+}
+
+std::vector<double> parseSizes(const std::string& list) {
+    std::vector<double> sizes;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            sizes.push_back(std::atof(item.c_str()));
+        }
+    }
+    return sizes;
+}
+
+void writeRecord(std::ostream& out, const Record& record) {
+    double mp_per_s = record.ms_per_call > 0.0 ? record.megapixels * 1000.0 / record.ms_per_call : 0.0;
+    out << "{\"suite\":\"" << escape(record.suite) << "\""
+        << ",\"stage\":\"" << escape(record.stage) << "\""
+        << ",\"megapixels\":" << record.megapixels
+        << ",\"width\":" << record.width
+        << ",\"height\":" << record.height
+        << ",\"iterations\":" << record.iterations
+        << ",\"ms_per_call\":" << record.ms_per_call
+        << ",\"mp_per_s\":" << mp_per_s
+        << ",\"heap_allocs_per_call\":" << record.per_call.heap_allocs
+        << ",\"heap_bytes_per_call\":" << record.per_call.heap_bytes
+        << ",\"mat_allocs_per_call\":" << record.per_call.mat_allocs
+        << ",\"mat_bytes_per_call\":" << record.per_call.mat_bytes
+        << ",\"peak_rss_kb\":" << record.peak_rss_kb
+        << "}" << std::endl;
+}
+
+} // namespace bench
+} // namespace stencil
@@ -0,0 +1,100 @@
+// benchmarks/bench_support.hpp
+#ifndef BENCH_SUPPORT_HPP
+#define BENCH_SUPPORT_HPP
+
+#include <opencv2/opencv.hpp>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace stencil {
+namespace bench {
+
+// ────────────────────────── ALLOCATION COUNTING ──────────────────────────
+// Heap counts come from the replaced global operator new (bench_support.cpp);
+// Mat counts from a counting cv::MatAllocator installed as the default.
+// OpenCV's internal scratch buffers (cv::fastMalloc) are not covered.
+struct AllocationCounts {
+    size_t heap_allocs = 0;
+    size_t heap_bytes = 0;
+    size_t mat_allocs = 0;
+    size_t mat_bytes = 0;
+};
+
+void installCountingMatAllocator();
+AllocationCounts allocationCounts();
+
+// ────────────────────────── PROCESS STATISTICS ──────────────────────────
+long peakRssKb();   // Peak resident set size so far, -1 if unavailable
+
+// ────────────────────────── INPUTS ──────────────────────────
+// Deterministic 4:3 BGR test image with gradients, shapes, text and noise,
+// so every stage (including island bridging) has real work to do
+cv::Mat syntheticImage(double megapixels, uint64_t seed = 42);
+
+// Parses "1,4,16" style lists
+std::vector<double> parseSizes(const std::string& list);
+
+// ────────────────────────── MEASUREMENT ──────────────────────────
+struct Record {
+    std::string suite;
+    std::string stage;
+    double megapixels = 0.0;
+    int width = 0;
+    int height = 0;
+    size_t iterations = 0;
+    double ms_per_call = 0.0;
+    AllocationCounts per_call;
+    long peak_rss_kb = -1;
+};
+
+struct RunOptions {
+    double min_seconds = 0.5;   // Keep calling until this much time has passed...
+    size_t min_iterations = 3;  // ...and at least this many calls were made
+};
+
+// Writes one JSON object per line
+void writeRecord(std::ostream& out, const Record& record);
+
+// Times fn() after one untimed warm-up call; allocation counts are averaged
+// over the timed calls
+template <typename Fn>
+Record measure(const std::string& suite, const std::string& stage, const cv::Size& size,
+               Fn&& fn, const RunOptions& options = RunOptions()) {
+    using Clock = std::chrono::steady_clock;
+    
+    fn();
+    
+    AllocationCounts before = allocationCounts();
+    size_t iterations = 0;
+    auto start = Clock::now();
+    double elapsed = 0.0;
+    do {
+        fn();
+        ++iterations;
+        elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    } while (elapsed < options.min_seconds || iterations < options.min_iterations);
+    AllocationCounts after = allocationCounts();
+    
+    Record record;
+    record.suite = suite;
+    record.stage = stage;
+    record.width = size.width;
+    record.height = size.height;
+    record.megapixels = static_cast<double>(size.area()) / 1.0e6;
+    record.iterations = iterations;
+    record.ms_per_call = elapsed * 1000.0 / iterations;
+    record.per_call.heap_allocs = (after.heap_allocs - before.heap_allocs) / iterations;
+    record.per_call.heap_bytes = (after.heap_bytes - before.heap_bytes) / iterations;
+    record.per_call.mat_allocs = (after.mat_allocs - before.mat_allocs) / iterations;
+    record.per_call.mat_bytes = (after.mat_bytes - before.mat_bytes) / iterations;
+    record.peak_rss_kb = peakRssKb();
+    return record;
+}
+
+} // namespace bench
+} // namespace stencil
+
+#endif // BENCH_SUPPORT_HPP
@@ -0,0 +1,137 @@
+// benchmarks/stencil_bench.cpp
+//
+// Per-stage timings of stencil::StencilGenerator over synthetic images.
+// Prints one JSON object per stage and size (see bench_support.hpp).
+//
+// Usage:
+//   stencil_bench [--sizes 1,4,16,50,100] [--min-seconds 0.5] [--out results.jsonl]
+
+#include "stencil_generator.hpp"
+#include "island_analysis.hpp"
+#include "bench_support.hpp"
+#include <fstream>
+#include <iostream>
+
+using namespace stencil;
+
+namespace {
+
+void runSize(std::ostream& out, double megapixels, const bench::RunOptions& options) {
+    const std::string suite = "cpp";
+    cv::Mat image = bench::syntheticImage(megapixels);
+    const cv::Size size = image.size();
+    
+    StencilGenerator generator;
+    generator.loadImageFromMat(image);
+    
+    Preset simple;
+    Preset multi_layer;
+    multi_layer.stencil_type = "Multi-layer (3 colors)";
+    
+    auto run = [&](const std::string& stage, auto&& fn) {
+        bench::writeRecord(out, bench::measure(suite, stage, size, fn, options));
+    };
+    
+    // Preprocess stages
+    cv::Mat gray = generator.convertToGrayscale(image);
+    cv::Mat contrasted = generator.adjustContrast(gray, simple.contrast);
+    cv::Mat blurred = generator.applyBlur(contrasted, simple.blur_amount);
+    
+    run("grayscale", [&] { return generator.convertToGrayscale(image); });
+    run("contrast", [&] { return generator.adjustContrast(gray, simple.contrast); });
+    run("blur", [&] { return generator.applyBlur(contrasted, simple.blur_amount); });
+    run("edge_enhance", [&] { return generator.enhanceEdges(blurred); });
+    run("threshold", [&] { return generator.applyThreshold(blurred, simple.threshold); });
+    run("preprocess", [&] {
+        cv::Mat result = generator.convertToGrayscale(image);
+        result = generator.adjustContrast(result, simple.contrast);
+        result = generator.applyBlur(result, simple.blur_amount);
+        return generator.enhanceEdges(result);
+    });
+    
+    // Full pipelines
+    run("simple_stencil", [&] { return generator.generateSimpleStencil(simple); });
+    run("simple_stencil_tiled", [&] { return generator.generateSimpleStencilTiled(simple); });
+    run("multi_layer_stencil", [&] { return generator.generateMultiLayerStencil(multi_layer); });
+    
+    // Same pipelines into reused buffers: after the warm-up call the scratch
+    // arenas are sized, so mat_allocs/mat_bytes should read 0
+    cv::Mat output;
+    run("simple_stencil_into", [&] { return generator.generateSimpleStencil(simple, output); });
+    run("simple_stencil_tiled_into", [&] { return generator.generateSimpleStencilTiled(simple, output); });
+    run("multi_layer_stencil_into", [&] {
+        return generator.generateMultiLayerStencil(multi_layer, output);
+    });
+    run("batch_steady_state", [&] {
+        generator.loadImageFromMat(image);
+        return generator.generateStencil(simple, output);
+    });
+    
+    // Islands and bridging
+    cv::Mat stencil = generator.generateSimpleStencil(simple);
+    // Islands are enclosed white material
+    cv::Mat foreground;
+    cv::threshold(stencil, foreground, 127, 1, cv::THRESH_BINARY);
+    IslandTable islands = analyzeIslands(foreground);
+    
+    run("island_analysis", [&] { return analyzeIslands(foreground); });
+    run("detect_floating_islands", [&] { return generator.detectFloatingIslands(stencil); });
+    run("bridge_plan", [&] { return planBridges(islands); });
+    run("auto_bridge", [&] {
+        return generator.autoBridgeIslands(stencil, simple.bridge_width_px, simple.bridge_color);
+    });
+    
+    // The same on runs; their storage shows up in heap_bytes, not mat_bytes
+    RleImage cut = generator.encodeStencil(stencil);
+    RleImage material = cut.complement();
+    RleIslandTable rle_islands = analyzeIslands(material);
+    
+    run("rle_encode", [&] { return generator.encodeStencil(stencil); });
+    run("rle_island_analysis", [&] { return analyzeIslands(material); });
+    run("rle_detect_floating_islands", [&] { return generator.detectFloatingIslands(cut); });
+    run("rle_bridge_plan", [&] { return planBridges(rle_islands); });
+    run("rle_auto_bridge", [&] { return generator.autoBridgeIslands(cut, simple.bridge_width_px); });
+    
+    std::cerr << megapixels << " MP: " << cut.runCount() << " runs, " << (cut.bytes() >> 10)
+              << " KB as runs vs " << ((stencil.total() + islands.labels.total() * sizeof(int)) >> 10)
+              << " KB as stencil + label image" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::vector<double> sizes = {1, 4, 16, 50, 100};
+    bench::RunOptions options;
+    std::string out_path;
+    
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--sizes") {
+            sizes = bench::parseSizes(argv[i + 1]);
+        } else if (arg == "--min-seconds") {
+            options.min_seconds = std::atof(argv[i + 1]);
+        } else if (arg == "--out") {
+            out_path = argv[i + 1];
+        } else {
+            std::cerr << "Unknown option " << arg << std::endl;
+            return 1;
+        }
+    }
+    
+    bench::installCountingMatAllocator();
+    
+    std::ofstream file;
+    if (!out_path.empty()) {
+        file.open(out_path);
+        if (!file.is_open()) {
+            std::cerr << "Cannot write " << out_path << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& out = out_path.empty() ? std::cout : file;
+    
+    for (double megapixels : sizes) {
+        runSize(out, megapixels, options);
+    }
+    return 0;
+}
@@ -0,0 +1,391 @@
+// bridge_planner.cpp
+#include "bridge_planner.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <utility>
+
+namespace stencil {
+
+namespace {
+// Source coordinates are kept as (x, y) in a CV_32SC2 field, so any image
+// size fits; x < 0 marks a pixel without a source yet
+const cv::Vec2i kNoSource(-1, -1);
+constexpr int64_t kFar = std::numeric_limits<int64_t>::max();
+
+inline int64_t squaredDistance(const cv::Vec2i& source, int x, int y) {
+    if (source[0] < 0) {
+        return kFar;
+    }
+    int64_t dx = static_cast<int64_t>(source[0]) - x;
+    int64_t dy = static_cast<int64_t>(source[1]) - y;
+    return dx * dx + dy * dy;
+}
+
+// Keeps whichever of the current and candidate source is closer to (x, y)
+inline void relax(cv::Vec2i& best, int64_t& best_d, const cv::Vec2i& candidate, int x, int y) {
+    int64_t d = squaredDistance(candidate, x, y);
+    if (d < best_d) {
+        best = candidate;
+        best_d = d;
+    }
+}
+
+// Closest pixel pair between run a of row ya and run b of row yb
+inline void closestPair(const Run& a, int ya, const Run& b, int yb, int64_t& best_d,
+                        cv::Point& from, cv::Point& to) {
+    int xa, xb;
+    if (b.x0 > a.x1 - 1) {
+        xa = a.x1 - 1;
+        xb = b.x0;
+    } else if (a.x0 > b.x1 - 1) {
+        xa = a.x0;
+        xb = b.x1 - 1;
+    } else {
+        xa = xb = std::max(a.x0, b.x0);
+    }
+    const int64_t dx = xb - xa;
+    const int64_t dy = yb - ya;
+    const int64_t d = dx * dx + dy * dy;
+    if (d < best_d) {
+        best_d = d;
+        from = cv::Point(xa, ya);
+        to = cv::Point(xb, yb);
+    }
+}
+
+// Pixel-centre span of row y inside the capsule of radius r around a-b,
+// as the union of the two end disks and the slab between them
+bool capsuleSpan(const cv::Point2d& a, const cv::Point2d& b, double r, int y, Run& span) {
+    double lo = std::numeric_limits<double>::infinity();
+    double hi = -lo;
+    
+    for (const cv::Point2d& c : {a, b}) {
+        const double dy = y - c.y;
+        if (std::abs(dy) <= r) {
+            const double half = std::sqrt(r * r - dy * dy);
+            lo = std::min(lo, c.x - half);
+            hi = std::max(hi, c.x + half);
+        }
+    }
+    
+    const double dx = b.x - a.x;
+    const double dy = b.y - a.y;
+    const double length2 = dx * dx + dy * dy;
+    if (length2 > 0.0) {
+        const double ry = y - a.y;
+        const double reach = r * std::sqrt(length2);
+        double s_lo = -std::numeric_limits<double>::infinity();
+        double s_hi = -s_lo;
+        bool inside = true;
+        
+        // Projection onto the segment within [0, 1]: dx * (x - ax) in [-ry dy, length2 - ry dy]
+        if (dx != 0.0) {
+            double p = -ry * dy / dx;
+            double q = (length2 - ry * dy) / dx;
+            if (p > q) std::swap(p, q);
+            s_lo = std::max(s_lo, p);
+            s_hi = std::min(s_hi, q);
+        } else {
+            inside = ry * dy >= 0.0 && ry * dy <= length2;
+        }
+        
+        // Distance from the line: |dx * ry - dy * (x - ax)| <= r * length
+        if (dy != 0.0) {
+            double p = (dx * ry - reach) / dy;
+            double q = (dx * ry + reach) / dy;
+            if (p > q) std::swap(p, q);
+            s_lo = std::max(s_lo, p);
+            s_hi = std::min(s_hi, q);
+        } else {
+            inside = inside && std::abs(dx * ry) <= reach;
+        }
+        
+        if (inside && s_lo <= s_hi) {
+            lo = std::min(lo, a.x + s_lo);
+            hi = std::max(hi, a.x + s_hi);
+        }
+    }
+    
+    if (lo > hi) {
+        return false;
+    }
+    span.x0 = static_cast<int>(std::ceil(lo));
+    span.x1 = static_cast<int>(std::floor(hi)) + 1;
+    return span.x1 > span.x0;
+}
+}
+
+BridgePlan planBridges(const IslandTable& table) {
+    BridgePlan plan;
+    
+    if (table.empty()) {
+        return plan;
+    }
+    
+    const cv::Mat& labels = table.labels;
+    const int w = labels.cols;
+    const int h = labels.rows;
+    
+    // Seed the field with the connected region and the image frame
+    cv::Mat nearest(h, w, CV_32SC2);
+    cv::parallel_for_(cv::Range(0, h), [&](const cv::Range& range) {
+        for (int y = range.start; y < range.end; y++) {
+            const int* label_row = labels.ptr<int>(y);
+            cv::Vec2i* row = nearest.ptr<cv::Vec2i>(y);
+            const bool edge_row = (y == 0 || y == h - 1);
+            for (int x = 0; x < w; x++) {
+                int label = label_row[x];
+                bool source = edge_row || x == 0 || x == w - 1 ||
+                              (label > 0 && table.touches_border[label]);
+                row[x] = source ? cv::Vec2i(x, y) : kNoSource;
+            }
+        }
+    });
+    
+    // Forward and backward sweeps propagate a near source to every pixel.
+    // Two passes over 8 neighbours are a chamfer approximation: some pixels
+    // keep a source slightly farther than their true nearest one.
+    for (int y = 0; y < h; y++) {
+        cv::Vec2i* row = nearest.ptr<cv::Vec2i>(y);
+        const cv::Vec2i* prev = y > 0 ? nearest.ptr<cv::Vec2i>(y - 1) : nullptr;
+        for (int x = 0; x < w; x++) {
+            cv::Vec2i best = row[x];
+            int64_t best_d = squaredDistance(best, x, y);
+            if (best_d == 0) {
+                continue;
+            }
+            if (x > 0) relax(best, best_d, row[x - 1], x, y);
+            if (prev) {
+                if (x > 0) relax(best, best_d, prev[x - 1], x, y);
+                relax(best, best_d, prev[x], x, y);
+                if (x < w - 1) relax(best, best_d, prev[x + 1], x, y);
+            }
+            row[x] = best;
+        }
+    }
+    
+    for (int y = h - 1; y >= 0; y--) {
+        cv::Vec2i* row = nearest.ptr<cv::Vec2i>(y);
+        const cv::Vec2i* next = y < h - 1 ? nearest.ptr<cv::Vec2i>(y + 1) : nullptr;
+        for (int x = w - 1; x >= 0; x--) {
+            cv::Vec2i best = row[x];
+            int64_t best_d = squaredDistance(best, x, y);
+            if (best_d == 0) {
+                continue;
+            }
+            if (x < w - 1) relax(best, best_d, row[x + 1], x, y);
+            if (next) {
+                if (x < w - 1) relax(best, best_d, next[x + 1], x, y);
+                relax(best, best_d, next[x], x, y);
+                if (x > 0) relax(best, best_d, next[x - 1], x, y);
+            }
+            row[x] = best;
+        }
+    }
+    
+    // One shared pass: each island keeps its pixel closest to the region
+    const size_t count = table.islands.size();
+    std::vector<int64_t> best_d(count, kFar);
+    std::vector<cv::Point> best_from(count);
+    std::vector<cv::Vec2i> best_to(count, kNoSource);
+    
+    for (int y = 0; y < h; y++) {
+        const int* label_row = labels.ptr<int>(y);
+        const cv::Vec2i* row = nearest.ptr<cv::Vec2i>(y);
+        for (int x = 0; x < w; x++) {
+            int index = table.label_to_island[label_row[x]];
+            if (index < 0) {
+                continue;
+            }
+            int64_t d = squaredDistance(row[x], x, y);
+            if (d < best_d[index]) {
+                best_d[index] = d;
+                best_from[index] = cv::Point(x, y);
+                best_to[index] = row[x];
+            }
+        }
+    }
+    
+    plan.bridges.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        if (best_to[i][0] < 0) {
+            continue;
+        }
+        Bridge bridge;
+        bridge.island = static_cast<int>(i);
+        bridge.from = best_from[i];
+        bridge.to = cv::Point(best_to[i][0], best_to[i][1]);
+        bridge.length = std::sqrt(static_cast<double>(best_d[i]));
+        plan.total_length += bridge.length;
+        plan.bridges.push_back(bridge);
+    }
+    
+    return plan;
+}
+
+void drawBridges(cv::Mat& stencil, const BridgePlan& plan, int bridge_width, int bridge_color) {
+    for (const auto& bridge : plan.bridges) {
+        cv::line(stencil, bridge.from, bridge.to, cv::Scalar::all(bridge_color),
+                 std::max(1, bridge_width), cv::LINE_AA);
+    }
+}
+
+void drawBridges(cv::Mat& stencil, const BridgePlan& plan, int bridge_width, int bridge_color,
+                 PixelStats& stats) {
+    const int thickness = std::max(1, bridge_width);
+    // Anti-aliased thick lines reach up to 2.55 px past half the thickness
+    const double reach = thickness / 2.0 + 3.0;
+    std::vector<std::pair<int, Run>> footprint;
+    for (const auto& bridge : plan.bridges) {
+        // Only the capsule around the line is recounted, not its bounding box
+        const cv::Point2d a(bridge.from);
+        const cv::Point2d b(bridge.to);
+        const int y0 = std::max(0, static_cast<int>(std::ceil(std::min(a.y, b.y) - reach)));
+        const int y1 = std::min(stencil.rows - 1,
+                                static_cast<int>(std::floor(std::max(a.y, b.y) + reach)));
+        footprint.clear();
+        for (int y = y0; y <= y1; y++) {
+            Run span;
+            if (capsuleSpan(a, b, reach, y, span)) {
+                footprint.emplace_back(y, span);
+            }
+        }
+        
+        for (const auto& row : footprint) {
+            stats.remove(stencil, cv::Rect(row.second.x0, row.first, row.second.length(), 1));
+        }
+        cv::line(stencil, bridge.from, bridge.to, cv::Scalar::all(bridge_color), thickness,
+                 cv::LINE_AA);
+        for (const auto& row : footprint) {
+            stats.add(stencil, cv::Rect(row.second.x0, row.first, row.second.length(), 1));
+        }
+    }
+}
+
+BridgePlan planBridges(const RleIslandTable& table) {
+    BridgePlan plan;
+    
+    if (table.empty()) {
+        return plan;
+    }
+    
+    const RleImage& mask = table.mask;
+    const RleImage& connected = table.connected;
+    const int w = mask.cols();
+    const int h = mask.rows();
+    
+    // Group the island runs by island, keeping their rows
+    const size_t count = table.islands.size();
+    std::vector<size_t> first(count + 1, 0);
+    for (int index : table.mask_island) {
+        first[index + 1]++;
+    }
+    for (size_t i = 0; i < count; i++) {
+        first[i + 1] += first[i];
+    }
+    std::vector<std::pair<int, Run>> island_runs(mask.runCount());
+    std::vector<size_t> fill(first.begin(), first.end() - 1);
+    for (int y = 0; y < h; y++) {
+        for (size_t r = mask.rowStart(y); r < mask.rowStart(y + 1); r++) {
+            island_runs[fill[table.mask_island[r]]++] = {y, mask.runs()[r]};
+        }
+    }
+    
+    std::vector<Bridge> bridges(count);
+    std::vector<uchar> found(count, 0);
+    cv::parallel_for_(cv::Range(0, static_cast<int>(count)), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; i++) {
+            int64_t best_d = kFar;
+            cv::Point from, to;
+            
+            // The frame bounds the search: the nearest edge of any island run
+            for (size_t k = first[i]; k < first[i + 1]; k++) {
+                const int y = island_runs[k].first;
+                const Run& run = island_runs[k].second;
+                const int64_t gaps[4] = {y, h - 1 - y, run.x0, w - run.x1};
+                const cv::Point ends[4] = {{run.x0, 0}, {run.x0, h - 1}, {0, y}, {w - 1, y}};
+                const cv::Point starts[4] = {{run.x0, y}, {run.x0, y}, {run.x0, y}, {run.x1 - 1, y}};
+                for (int e = 0; e < 4; e++) {
+                    if (gaps[e] * gaps[e] < best_d) {
+                        best_d = gaps[e] * gaps[e];
+                        from = starts[e];
+                        to = ends[e];
+                    }
+                }
+            }
+            
+            // Scan connected rows outwards while the row distance can still win
+            for (size_t k = first[i]; k < first[i + 1]; k++) {
+                const int ya = island_runs[k].first;
+                const Run& a = island_runs[k].second;
+                for (int step = 0; static_cast<int64_t>(step) * step < best_d; step++) {
+                    const int rows_at[2] = {ya - step, ya + step};
+                    for (int side = 0; side < (step == 0 ? 1 : 2); side++) {
+                        const int yb = rows_at[side];
+                        if (yb < 0 || yb >= h) {
+                            continue;
+                        }
+                        // Only the first run ending after a.x0 and the one before it can be closest
+                        const Run* begin = connected.rowBegin(yb);
+                        const Run* end = connected.rowEnd(yb);
+                        const Run* it = std::upper_bound(begin, end, a.x0,
+                                                         [](int value, const Run& run) { return value < run.x1; });
+                        if (it != end) {
+                            closestPair(a, ya, *it, yb, best_d, from, to);
+                        }
+                        if (it != begin) {
+                            closestPair(a, ya, *(it - 1), yb, best_d, from, to);
+                        }
+                    }
+                }
+            }
+            
+            if (best_d != kFar) {
+                bridges[i].island = i;
+                bridges[i].from = from;
+                bridges[i].to = to;
+                bridges[i].length = std::sqrt(static_cast<double>(best_d));
+                found[i] = 1;
+            }
+        }
+    });
+    
+    plan.bridges.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        if (found[i]) {
+            plan.total_length += bridges[i].length;
+            plan.bridges.push_back(bridges[i]);
+        }
+    }
+    
+    return plan;
+}
+
+void drawBridges(RleImage& stencil, const BridgePlan& plan, int bridge_width, bool foreground) {
+    if (plan.bridges.empty() || stencil.empty()) {
+        return;
+    }
+    
+    // Same footprint as a cv::line of this thickness, pixel centres included
+    const double r = std::max(1, bridge_width) / 2.0;
+    std::vector<std::vector<Run>> rows(stencil.rows());
+    for (const auto& bridge : plan.bridges) {
+        const cv::Point2d a(bridge.from);
+        const cv::Point2d b(bridge.to);
+        const int y0 = std::max(0, static_cast<int>(std::ceil(std::min(a.y, b.y) - r)));
+        const int y1 = std::min(stencil.rows() - 1, static_cast<int>(std::floor(std::max(a.y, b.y) + r)));
+        for (int y = y0; y <= y1; y++) {
+            Run span;
+            if (capsuleSpan(a, b, r, y, span)) {
+                rows[y].push_back(span);
+            }
+        }
+    }
+    
+    RleImage bridges = RleImage::fromRows(stencil.size(), rows);
+    stencil = foreground ? stencil.unite(bridges) : stencil.subtract(bridges);
+}
+
+} // namespace stencil
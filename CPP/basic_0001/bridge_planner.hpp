@@ -0,0 +1,56 @@
+// bridge_planner.hpp
+#ifndef BRIDGE_PLANNER_HPP
+#define BRIDGE_PLANNER_HPP
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "island_analysis.hpp"
+#include "pixel_stats.hpp"
+
+namespace stencil {
+
+// ────────────────────────── BRIDGE PLANNER ──────────────────────────
+// Routes every island to an approximately nearest pixel of the connected
+// region: the border-touching components plus the image frame itself. A
+// nearest-source field is propagated once from the whole connected region
+// by a two-pass 8-neighbour chamfer sweep (forward, then backward), so a
+// pixel may inherit a source slightly farther than the true nearest one. A
+// single pass over the label image then picks, per island, the pixel with
+// the shortest way out. Each bridge is the straight segment between the
+// two pixels, and its length is exact for the chosen pair.
+struct Bridge {
+    int island = -1;       // Index into IslandTable::islands
+    cv::Point from;        // Island pixel the bridge starts at
+    cv::Point to;          // Approximately nearest connected pixel
+    double length = 0.0;   // Euclidean length in pixels
+};
+
+struct BridgePlan {
+    std::vector<Bridge> bridges;
+    double total_length = 0.0;
+};
+
+BridgePlan planBridges(const IslandTable& islands);
+void drawBridges(cv::Mat& stencil, const BridgePlan& plan, int bridge_width, int bridge_color);
+
+// The same, keeping stats in step: the pixels each bridge can touch (a
+// capsule around the line, anti-aliasing included) are taken out of the
+// statistics before it is drawn and added back after, so the cost follows
+// the bridge area rather than the image or the bridges' bounding boxes
+void drawBridges(cv::Mat& stencil, const BridgePlan& plan, int bridge_width, int bridge_color,
+                 PixelStats& stats);
+
+// ────────────────────────── RUN-LENGTH BRIDGES ──────────────────────────
+// Exact nearest connection for a run-length table. Each island searches the
+// connected runs row by row outwards from its own runs, stopping once the
+// row distance alone exceeds the best found, with the image frame as the
+// starting bound. Islands are planned in parallel.
+BridgePlan planBridges(const RleIslandTable& islands);
+
+// Rasterises each bridge as a capsule of the given width (no anti-aliasing)
+// and adds it to the foreground, or cuts it out when foreground is false.
+void drawBridges(RleImage& stencil, const BridgePlan& plan, int bridge_width, bool foreground);
+
+} // namespace stencil
+
+#endif // BRIDGE_PLANNER_HPP
@@ -0,0 +1,159 @@
+// edge_preserving_filter.cpp
+#include "edge_preserving_filter.hpp"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace stencil {
+
+namespace {
+// Empty cells around the grid; the blur reaches two cells
+constexpr int kPad = 2;
+
+// Grid rows sliced per band
+constexpr int kBandCells = 32;
+
+// Nearest-cell splatting, the 1-4-6-4-1 blur and trilinear slicing together
+// widen a cell's footprint to about 1.1 cells of standard deviation; cells
+// are shrunk by that much so the filter keeps the requested sigmas
+constexpr double kFootprint = 1.1;
+
+// Spatial sigma of cv::bilateralFilter's window: Gaussian weights of
+// sigma_space over a disc of radius diameter / 2. With large sigma_space the
+// disc is nearly flat, and a flat disc of radius r has variance r^2 / 4 per
+// axis; the two variances combine like those of a product of Gaussians.
+double windowSigma(int diameter, double sigma_space) {
+    const double radius = std::max(1, diameter / 2);
+    return 1.0 / std::sqrt(1.0 / (sigma_space * sigma_space) + 4.0 / (radius * radius));
+}
+
+// In-place 1-4-6-4-1 blur of count lines of length n, two floats per cell;
+// stride is the distance between cells of a line, step between lines
+void blurLines(float* data, int n, ptrdiff_t stride, int count, ptrdiff_t step,
+               std::vector<float>& line) {
+    line.assign(2 * (n + 4), 0.0f);
+    for (int l = 0; l < count; l++) {
+        float* base = data + l * step;
+        for (int i = 0; i < n; i++) {
+            line[2 * (i + 2)] = base[i * stride];
+            line[2 * (i + 2) + 1] = base[i * stride + 1];
+        }
+        for (int i = 0; i < n; i++) {
+            const float* t = &line[2 * i];
+            base[i * stride] = (t[0] + 4 * t[2] + 6 * t[4] + 4 * t[6] + t[8]) * (1.0f / 16);
+            base[i * stride + 1] = (t[1] + 4 * t[3] + 6 * t[5] + 4 * t[7] + t[9]) * (1.0f / 16);
+        }
+    }
+}
+}
+
+void bilateralGrid(const cv::Mat& src, cv::Mat& dst, int diameter, double sigma_color,
+                   double sigma_space) {
+    CV_Assert(src.type() == CV_8UC1 && diameter > 0);
+    
+    // Rows outside the band are read for its margin, so never work in place
+    const cv::Mat input = src.data == dst.data ? src.clone() : src;
+    dst.create(input.size(), CV_8UC1);
+    if (input.empty()) {
+        return;
+    }
+    
+    const int rows = input.rows;
+    const int cols = input.cols;
+    const double cell = std::max(1.0, windowSigma(diameter, sigma_space) / kFootprint);
+    const double level = std::max(1.0, sigma_color / kFootprint);
+    const double inv_cell = 1.0 / cell;
+    const double inv_level = 1.0 / level;
+    
+    // Grid extent: slicing reads floor(position) + 1
+    const int width = static_cast<int>((cols - 1) * inv_cell) + 2 + 2 * kPad;
+    const int depth = static_cast<int>(255 * inv_level) + 2 + 2 * kPad;
+    const ptrdiff_t row_stride = static_cast<ptrdiff_t>(width) * depth * 2;
+    
+    const int band_rows = std::max(1, static_cast<int>(std::ceil(kBandCells * cell)));
+    const int bands = (rows + band_rows - 1) / band_rows;
+    
+    cv::parallel_for_(cv::Range(0, bands), [&](const cv::Range& range) {
+        std::vector<float> grid;
+        std::vector<float> line;
+        
+        for (int band = range.start; band < range.end; band++) {
+            const int y0 = band * band_rows;
+            const int y1 = std::min(rows, y0 + band_rows);
+            
+            // Grid rows the band slices from, plus the blur's reach
+            const int g0 = static_cast<int>(y0 * inv_cell) - kPad;
+            const int g1 = static_cast<int>((y1 - 1) * inv_cell) + 1 + kPad;
+            const int height = g1 - g0 + 1;
+            grid.assign(height * row_stride, 0.0f);
+            
+            // Splat every pixel whose nearest grid row is in the window
+            const int s0 = std::max(0, static_cast<int>((g0 - 1) * cell));
+            const int s1 = std::min(rows, static_cast<int>((g1 + 1) * cell) + 1);
+            for (int y = s0; y < s1; y++) {
+                const int gy = static_cast<int>(std::lround(y * inv_cell));
+                if (gy < g0 || gy > g1) {
+                    continue;
+                }
+                const uchar* in = input.ptr<uchar>(y);
+                float* grid_row = grid.data() + (gy - g0) * row_stride;
+                for (int x = 0; x < cols; x++) {
+                    const int gx = static_cast<int>(std::lround(x * inv_cell)) + kPad;
+                    const int gz = static_cast<int>(std::lround(in[x] * inv_level)) + kPad;
+                    float* c = grid_row + (static_cast<ptrdiff_t>(gx) * depth + gz) * 2;
+                    c[0] += in[x];
+                    c[1] += 1.0f;
+                }
+            }
+            
+            // Separable blur: range, then x, then y
+            blurLines(grid.data(), depth, 2, height * width, static_cast<ptrdiff_t>(depth) * 2, line);
+            for (int gy = 0; gy < height; gy++) {
+                blurLines(grid.data() + gy * row_stride, width, static_cast<ptrdiff_t>(depth) * 2,
+                          depth, 2, line);
+            }
+            blurLines(grid.data(), height, row_stride, width * depth, 2, line);
+            
+            // Slice: trilinear read at each pixel's (x, y, value)
+            for (int y = y0; y < y1; y++) {
+                const double fy = y * inv_cell - g0;
+                const int iy = static_cast<int>(fy);
+                const float ay = static_cast<float>(fy - iy);
+                const uchar* in = input.ptr<uchar>(y);
+                uchar* out = dst.ptr<uchar>(y);
+                for (int x = 0; x < cols; x++) {
+                    const double fx = x * inv_cell + kPad;
+                    const double fz = in[x] * inv_level + kPad;
+                    const int ix = static_cast<int>(fx);
+                    const int iz = static_cast<int>(fz);
+                    const float ax = static_cast<float>(fx - ix);
+                    const float az = static_cast<float>(fz - iz);
+                    
+                    float value = 0.0f;
+                    float weight = 0.0f;
+                    for (int dy = 0; dy < 2; dy++) {
+                        const float wy = dy ? ay : 1.0f - ay;
+                        for (int dx = 0; dx < 2; dx++) {
+                            const float wxy = wy * (dx ? ax : 1.0f - ax);
+                            const float* c = grid.data() + (iy + dy) * row_stride +
+                                             (static_cast<ptrdiff_t>(ix + dx) * depth + iz) * 2;
+                            value += wxy * ((1.0f - az) * c[0] + az * c[2]);
+                            weight += wxy * ((1.0f - az) * c[1] + az * c[3]);
+                        }
+                    }
+                    out[x] = weight > 1e-6f ? cv::saturate_cast<uchar>(value / weight) : in[x];
+                }
+            }
+        }
+    });
+}
+
+double bilateralGridPsnr(const cv::Mat& src, int diameter, double sigma_color,
+                         double sigma_space) {
+    cv::Mat exact, approx;
+    cv::bilateralFilter(src, exact, diameter, sigma_color, sigma_space);
+    bilateralGrid(src, approx, diameter, sigma_color, sigma_space);
+    return cv::PSNR(exact, approx);
+}
+
+} // namespace stencil
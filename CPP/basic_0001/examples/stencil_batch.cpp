@@ -0,0 +1,344 @@
+// examples/stencil_batch.cpp
+//
+// Batch driver: stencils every image in a directory (or matching a glob)
+// with one preset. Decoding, processing and encoding run as separate
+// stages joined by bounded queues, so at most a fixed number of images is
+// held in memory while all three overlap. Each processing worker owns its
+// own StencilGenerator. One JSON object per file is appended to the report.
+//
+// Usage:
+//   stencil_batch <input_dir|glob> <output_dir> [options]
+//     --presets <file.json>   PresetManager JSON file
+//     --preset <name>         Preset to use (default: "Default")
+//     --jobs <n>              Processing workers (default: hardware threads)
+//     --queue <n>             Images in flight per queue (default: 2 * jobs)
+//     --report <file.jsonl>   Report path (default: <output_dir>/report.jsonl)
+//     --cache <dir>           Result cache shared by all workers (see result_cache.hpp)
+//     --cache-mb <n>          Cache size limit in MB (default: 512)
+
+#include "stencil_generator.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// ────────────────────────── BOUNDED QUEUE ──────────────────────────
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : capacity_(std::max<size_t>(1, capacity)) {}
+    
+    // Blocks while the queue is full
+    void push(T item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_.wait(lock, [this] { return items_.size() < capacity_; });
+        items_.push_back(std::move(item));
+        not_empty_.notify_one();
+    }
+    
+    // Blocks until an item arrives; empty once closed and drained
+    std::optional<T> pop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [this] { return !items_.empty() || closed_; });
+        if (items_.empty()) {
+            return std::nullopt;
+        }
+        T item = std::move(items_.front());
+        items_.pop_front();
+        not_full_.notify_one();
+        return item;
+    }
+    
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        not_empty_.notify_all();
+    }
+
+private:
+    size_t capacity_;
+    std::deque<T> items_;
+    bool closed_ = false;
+    std::mutex mutex_;
+    std::condition_variable not_full_;
+    std::condition_variable not_empty_;
+};
+
+// ────────────────────────── JOB RECORD ──────────────────────────
+struct Job {
+    std::string input_path;
+    std::string output_path;
+    cv::Mat image;
+    cv::Mat stencil;
+    std::string error;
+    double decode_ms = 0.0;
+    double process_ms = 0.0;
+    double encode_ms = 0.0;
+    size_t islands = 0;
+    double bridge_length = 0.0;
+    bool cache_hit = false;
+};
+
+using Clock = std::chrono::steady_clock;
+
+double elapsedMs(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// ────────────────────────── INPUT DISCOVERY ──────────────────────────
+bool isImageFile(const fs::path& path) {
+    static const char* extensions[] = {".png", ".jpg", ".jpeg", ".bmp", ".tif", ".tiff", ".webp"};
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return std::find(std::begin(extensions), std::end(extensions), ext) != std::end(extensions);
+}
+
+std::vector<std::string> collectInputs(const std::string& input) {
+    std::vector<cv::String> matches;
+    if (fs::is_directory(input)) {
+        cv::glob((fs::path(input) / "*").string(), matches, false);
+    } else {
+        cv::glob(input, matches, false);
+    }
+    
+    std::vector<std::string> files;
+    for (const auto& match : matches) {
+        if (fs::is_regular_file(std::string(match)) && isImageFile(std::string(match))) {
+            files.push_back(match);
+        }
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+json reportLine(const Job& job) {
+    json line = {
+        {"file", job.input_path},
+        {"output", job.output_path},
+        {"ok", job.error.empty()},
+        {"width", job.stencil.cols},
+        {"height", job.stencil.rows},
+        {"decode_ms", job.decode_ms},
+        {"process_ms", job.process_ms},
+        {"encode_ms", job.encode_ms},
+        {"islands", job.islands},
+        {"bridge_length", job.bridge_length},
+        {"cache_hit", job.cache_hit}
+    };
+    if (!job.error.empty()) {
+        line["error"] = job.error;
+    }
+    return line;
+}
+
+void printUsage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " <input_dir|glob> <output_dir>"
+              << " [--presets file.json] [--preset name] [--jobs n] [--queue n]"
+              << " [--report file.jsonl] [--cache dir] [--cache-mb n]" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    
+    std::string input = argv[1];
+    fs::path output_dir = argv[2];
+    std::string presets_file;
+    std::string preset_name = "Default";
+    std::string report_path;
+    int jobs = std::max(1u, std::thread::hardware_concurrency());
+    int queue_size = 0;
+    std::string cache_dir;
+    size_t cache_mb = 512;
+    
+    for (int i = 3; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        if (arg == "--presets") {
+            presets_file = argv[++i];
+        } else if (arg == "--preset") {
+            preset_name = argv[++i];
+        } else if (arg == "--jobs") {
+            jobs = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--queue") {
+            queue_size = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--report") {
+            report_path = argv[++i];
+        } else if (arg == "--cache") {
+            cache_dir = argv[++i];
+        } else if (arg == "--cache-mb") {
+            cache_mb = static_cast<size_t>(std::max(1, std::atoi(argv[++i])));
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (queue_size == 0) {
+        queue_size = 2 * jobs;
+    }
+    
+    // Parallelism comes from the workers; nested OpenCV threads would oversubscribe
+    if (jobs > 1) {
+        cv::setNumThreads(1);
+    }
+    
+    // Preset
+    stencil::PresetManager preset_manager;
+    if (!presets_file.empty() && !preset_manager.loadFromFile(presets_file)) {
+        std::cerr << "Failed to load presets from " << presets_file << std::endl;
+        return 1;
+    }
+    stencil::Preset preset;
+    if (!preset_manager.loadPreset(preset_name, preset)) {
+        std::cerr << "Unknown preset: " << preset_name << std::endl;
+        return 1;
+    }
+    
+    // Inputs and outputs
+    std::vector<std::string> files = collectInputs(input);
+    if (files.empty()) {
+        std::cerr << "No images found for " << input << std::endl;
+        return 1;
+    }
+    std::error_code ec;
+    fs::create_directories(output_dir, ec);
+    if (report_path.empty()) {
+        report_path = (output_dir / "report.jsonl").string();
+    }
+    std::ofstream report(report_path);
+    if (!report.is_open()) {
+        std::cerr << "Cannot write report " << report_path << std::endl;
+        return 1;
+    }
+    
+    // One cache for all workers; it locks internally
+    std::shared_ptr<stencil::ResultCache> cache;
+    if (!cache_dir.empty()) {
+        cache = std::make_shared<stencil::ResultCache>(cache_dir, cache_mb << 20);
+    }
+    
+    BoundedQueue<Job> decoded(queue_size);
+    BoundedQueue<Job> processed(queue_size);
+    std::atomic<size_t> next_file{0};
+    std::atomic<size_t> failures{0};
+    auto batch_start = Clock::now();
+    
+    // ────────────────────────── DECODE STAGE ──────────────────────────
+    const int decoders = std::max(1, std::min(jobs, 2));
+    std::vector<std::thread> decode_threads;
+    for (int d = 0; d < decoders; ++d) {
+        decode_threads.emplace_back([&] {
+            for (size_t i = next_file++; i < files.size(); i = next_file++) {
+                Job job;
+                job.input_path = files[i];
+                job.output_path = (output_dir / fs::path(files[i]).stem()).string() + "_stencil.png";
+                auto start = Clock::now();
+                // Colour decode from the mapped file, as loadImage does: the
+                // codecs' own gray decodes can differ from BGR2GRAY by a level,
+                // which would change the stencils and their cache keys
+                job.image = stencil::loadImageMapped(job.input_path);
+                job.decode_ms = elapsedMs(start);
+                if (job.image.empty()) {
+                    job.error = "decode failed";
+                }
+                decoded.push(std::move(job));
+            }
+        });
+    }
+    
+    // ────────────────────────── PROCESS STAGE ──────────────────────────
+    std::vector<std::thread> workers;
+    for (int w = 0; w < jobs; ++w) {
+        workers.emplace_back([&] {
+            // Per-worker generator: no shared mutable state between threads
+            stencil::StencilGenerator generator;
+            generator.setResultCache(cache);
+            cv::Mat stencil;
+            while (auto job = decoded.pop()) {
+                if (job->error.empty()) {
+                    auto start = Clock::now();
+                    generator.loadImageFromMat(job->image);
+                    job->image.release();
+                    // Bridging copies the stencil, so its buffer is reused by the next job
+                    bool ok = generator.generateStencil(preset, stencil);
+                    job->cache_hit = generator.lastStencilFromCache();
+                    if (!ok) {
+                        job->error = "stencil generation failed";
+                    } else {
+                        stencil::BridgePlan plan;
+                        job->stencil = generator.autoBridgeIslands(stencil, preset.bridge_width_px,
+                                                                   preset.bridge_color, &plan);
+                        job->islands = plan.bridges.size();
+                        job->bridge_length = plan.total_length;
+                    }
+                    job->process_ms = elapsedMs(start);
+                }
+                processed.push(std::move(*job));
+            }
+        });
+    }
+    
+    // ────────────────────────── ENCODE STAGE ──────────────────────────
+    std::mutex report_mutex;
+    std::vector<std::thread> encoders;
+    for (int e = 0; e < decoders; ++e) {
+        encoders.emplace_back([&] {
+            // Stateless save helpers; a private generator keeps threads independent
+            stencil::StencilGenerator writer;
+            while (auto job = processed.pop()) {
+                if (job->error.empty()) {
+                    auto start = Clock::now();
+                    if (!writer.saveStencilAsPNG(job->output_path, job->stencil)) {
+                        job->error = "encode failed";
+                    }
+                    job->encode_ms = elapsedMs(start);
+                }
+                if (!job->error.empty()) {
+                    failures++;
+                }
+                json line = reportLine(*job);
+                std::lock_guard<std::mutex> lock(report_mutex);
+                report << line.dump() << '\n';
+            }
+        });
+    }
+    
+    // Shut the pipeline down stage by stage
+    for (auto& thread : decode_threads) thread.join();
+    decoded.close();
+    for (auto& thread : workers) thread.join();
+    processed.close();
+    for (auto& thread : encoders) thread.join();
+    
+    double total_ms = elapsedMs(batch_start);
+    std::cout << "Processed " << files.size() << " images (" << failures << " failed) in "
+              << total_ms / 1000.0 << " s with " << jobs << " workers" << std::endl;
+    if (cache) {
+        stencil::CacheStats stats = cache->stats();
+        std::cout << "Cache: " << stats.hits << " hits, " << stats.misses << " misses, "
+                  << stats.evictions << " evicted, " << (stats.bytes >> 20) << " MB in "
+                  << stats.entries << " entries" << std::endl;
+    }
+    std::cout << "Report: " << report_path << std::endl;
+    
+    return failures == 0 ? 0 : 2;
+}
@@ -28,11 +28,25 @@ int main() {
         cv::Mat visualization = generator.visualizeIslands(stencil, islands);
         
         // Auto-bridge islands
+        stencil::BridgePlan plan;
         cv::Mat bridged = generator.autoBridgeIslands(stencil, preset.bridge_width_px, 
-                                                     preset.bridge_color);
+                                                     preset.bridge_color, &plan);
+        std::cout << "Added " << plan.bridges.size() << " bridges, total length "
+                  << plan.total_length << " px" << std::endl;
         
         // Save results
         generator.saveStencilAsPNG("stencil.png", bridged);
+        
+        // Toolpaths for a cutter with a 0.2 mm kerf
+        stencil::GcodeOptions gcode;
+        gcode.kerf_mm = 0.2;
+        stencil::GcodeStats gcode_stats;
+        if (generator.saveStencilAsGcode("stencil.gcode", bridged, gcode, &gcode_stats)) {
+            std::cout << "G-code: " << gcode_stats.paths << " paths, travel "
+                      << gcode_stats.travel_length_mm << " mm (was "
+                      << gcode_stats.travel_unoptimized_mm << " mm), est. "
+                      << gcode_stats.total_time_s / 60.0 << " min" << std::endl;
+        }
     } else {
         generator.saveStencilAsPNG("stencil.png", stencil);
     }
@@ -0,0 +1,50 @@
+// fused_preprocess.cpp
+#include "fused_preprocess.hpp"
+#include <algorithm>
+
+namespace stencil {
+
+namespace {
+// Bytes of output per strip; small enough to stay cache resident
+constexpr int kStripBytes = 32 * 1024;
+}
+
+cv::Mat identityLut() {
+    cv::Mat lut(1, 256, CV_8UC1);
+    for (int i = 0; i < 256; i++) {
+        lut.at<uchar>(0, i) = static_cast<uchar>(i);
+    }
+    return lut;
+}
+
+void fusedToneMap(const cv::Mat& src, cv::Mat& dst, const cv::Mat& lut, int gray_code) {
+    CV_Assert(src.depth() == CV_8U);
+    CV_Assert(lut.total() == 256 && lut.type() == CV_8UC1);
+    
+    dst.create(src.size(), CV_8UC1);
+    if (src.empty()) {
+        return;
+    }
+    
+    const int strip_rows = std::max(1, kStripBytes / std::max(1, src.cols));
+    const int strips = (src.rows + strip_rows - 1) / strip_rows;
+    
+    cv::parallel_for_(cv::Range(0, strips), [&](const cv::Range& range) {
+        for (int s = range.start; s < range.end; s++) {
+            const int y0 = s * strip_rows;
+            const int y1 = std::min(src.rows, y0 + strip_rows);
+            cv::Mat out = dst.rowRange(y0, y1);
+            
+            if (src.channels() == 1) {
+                cv::LUT(src.rowRange(y0, y1), lut, out);
+                continue;
+            }
+            
+            // The output strip doubles as the gray scratch: no buffer to allocate
+            cv::cvtColor(src.rowRange(y0, y1), out, gray_code);
+            cv::LUT(out, lut, out);
+        }
+    });
+}
+
+} // namespace stencil
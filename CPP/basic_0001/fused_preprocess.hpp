@@ -0,0 +1,27 @@
+// fused_preprocess.hpp
+#ifndef FUSED_PREPROCESS_HPP
+#define FUSED_PREPROCESS_HPP
+
+#include <opencv2/opencv.hpp>
+
+namespace stencil {
+
+// ────────────────────────── FUSED TONE KERNEL ──────────────────────────
+// Every per-pixel stage between grayscale conversion and the final binary
+// image (contrast/brightness, threshold, invert) is a function of the gray
+// value alone, so the whole chain collapses into one 256-entry table. Build
+// it by running the ordinary stages over identityLut(); the fused kernel then
+// reproduces the staged pipeline bit for bit.
+
+// 1x256 CV_8UC1 ramp 0..255
+cv::Mat identityLut();
+
+// Gray conversion + table lookup in a single streaming pass. Rows are
+// processed in cache-sized strips on OpenCV's thread pool, so the gray
+// intermediate never leaves L1/L2. Single-channel input skips the conversion.
+void fusedToneMap(const cv::Mat& src, cv::Mat& dst, const cv::Mat& lut,
+                  int gray_code = cv::COLOR_BGR2GRAY);
+
+} // namespace stencil
+
+#endif // FUSED_PREPROCESS_HPP
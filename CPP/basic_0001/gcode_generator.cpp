@@ -0,0 +1,615 @@
+// gcode_generator.cpp
+#include "gcode_generator.hpp"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+
+namespace stencil {
+
+namespace {
+constexpr size_t kWriteBufferBytes = 1 << 20;
+// Longest miter relative to the offset distance; sharper corners are clipped
+constexpr double kMinMiterCos = 0.5;
+
+double signedArea(const std::vector<cv::Point2d>& ring) {
+    double area = 0.0;
+    for (size_t i = 0, j = ring.size() - 1; i < ring.size(); j = i++) {
+        area += ring[j].x * ring[i].y - ring[i].x * ring[j].y;
+    }
+    return area * 0.5;
+}
+
+double distance(const cv::Point2d& a, const cv::Point2d& b) {
+    return std::hypot(a.x - b.x, a.y - b.y);
+}
+
+// Moves every vertex along its corner bisector; grow > 0 enlarges the ring.
+// False when the ring collapses (orientation flips or the area vanishes).
+bool offsetRing(std::vector<cv::Point2d>& ring, double grow) {
+    const double area = signedArea(ring);
+    if (std::abs(area) < 1e-12) {
+        return false;
+    }
+    if (grow == 0.0) {
+        return true;
+    }
+    
+    // Outward normal of edge a->b is (dy, -dx) for positive area
+    const double sign = area > 0.0 ? 1.0 : -1.0;
+    auto normal = [&](const cv::Point2d& a, const cv::Point2d& b) {
+        cv::Point2d d = b - a;
+        const double len = std::hypot(d.x, d.y);
+        return len > 0.0 ? cv::Point2d(sign * d.y / len, -sign * d.x / len) : cv::Point2d(0.0, 0.0);
+    };
+    
+    const size_t n = ring.size();
+    std::vector<cv::Point2d> out(n);
+    for (size_t i = 0; i < n; i++) {
+        const cv::Point2d& prev = ring[(i + n - 1) % n];
+        const cv::Point2d& next = ring[(i + 1) % n];
+        const cv::Point2d n1 = normal(prev, ring[i]);
+        const cv::Point2d n2 = normal(ring[i], next);
+        cv::Point2d m = n1 + n2;
+        const double len = std::hypot(m.x, m.y);
+        m = len > 1e-9 ? m * (1.0 / len) : n1;
+        const double cos_half = std::max(kMinMiterCos, m.dot(n1));
+        out[i] = ring[i] + m * (grow / cos_half);
+    }
+    
+    const double new_area = signedArea(out);
+    if (new_area * area <= 0.0 || (grow < 0.0 && std::abs(new_area) >= std::abs(area))) {
+        return false;
+    }
+    ring.swap(out);
+    return true;
+}
+
+cv::Rect2d pathBounds(const ToolPath& path) {
+    double x0 = path.points[0].x, x1 = x0, y0 = path.points[0].y, y1 = y0;
+    for (const cv::Point2d& p : path.points) {
+        x0 = std::min(x0, p.x);
+        x1 = std::max(x1, p.x);
+        y0 = std::min(y0, p.y);
+        y1 = std::max(y1, p.y);
+    }
+    return cv::Rect2d(x0, y0, x1 - x0, y1 - y0);
+}
+
+double distanceToRect(const cv::Point2d& p, const cv::Rect2d& r) {
+    const double dx = std::max({r.x - p.x, 0.0, p.x - (r.x + r.width)});
+    const double dy = std::max({r.y - p.y, 0.0, p.y - (r.y + r.height)});
+    return std::hypot(dx, dy);
+}
+
+size_t nearestVertex(const ToolPath& path, const cv::Point2d& from, double& best) {
+    size_t index = 0;
+    best = std::numeric_limits<double>::max();
+    for (size_t i = 0; i < path.points.size(); i++) {
+        const double d = distance(from, path.points[i]);
+        if (d < best) {
+            best = d;
+            index = i;
+        }
+    }
+    return index;
+}
+
+// Uniform grid over the paths that may be cut next, so each step of the
+// greedy tour only looks at paths near the current position. A path is
+// listed in every cell its bounding box overlaps; paths spanning more than
+// kMaxPathCells cells (frames, large outlines) go on a short list that is
+// checked on every step instead.
+constexpr int kMaxPathCells = 64;
+
+class PathGrid {
+public:
+    PathGrid(const std::vector<cv::Rect2d>& bounds, const cv::Point2d& home)
+        : bounds_(bounds), stamp_(bounds.size(), 0) {
+        // Every query position (home or a path vertex) lies inside the grid
+        double x0 = home.x, y0 = home.y, x1 = home.x, y1 = home.y;
+        for (const cv::Rect2d& r : bounds) {
+            x0 = std::min(x0, r.x);
+            y0 = std::min(y0, r.y);
+            x1 = std::max(x1, r.x + r.width);
+            y1 = std::max(y1, r.y + r.height);
+        }
+        origin_ = cv::Point2d(x0, y0);
+        
+        // About one cell per path
+        const double n = static_cast<double>(std::max<size_t>(1, bounds.size()));
+        const double w = x1 - x0;
+        const double h = y1 - y0;
+        cell_ = std::max({std::sqrt(w * h / n), std::max(w, h) / n, 1e-6});
+        cols_ = static_cast<int>(w / cell_) + 1;
+        rows_ = static_cast<int>(h / cell_) + 1;
+        cells_.resize(static_cast<size_t>(cols_) * rows_);
+    }
+    
+    void insert(int path) {
+        const cv::Rect span = cellSpan(path);
+        if (span.area() > kMaxPathCells) {
+            large_.push_back(path);
+            return;
+        }
+        for (int y = span.y; y < span.y + span.height; y++) {
+            for (int x = span.x; x < span.x + span.width; x++) {
+                cells_[y * cols_ + x].push_back(path);
+            }
+        }
+    }
+    
+    void erase(int path) {
+        auto drop = [path](std::vector<int>& list) {
+            auto it = std::find(list.begin(), list.end(), path);
+            if (it != list.end()) {
+                *it = list.back();
+                list.pop_back();
+            }
+        };
+        const cv::Rect span = cellSpan(path);
+        if (span.area() > kMaxPathCells) {
+            drop(large_);
+            return;
+        }
+        for (int y = span.y; y < span.y + span.height; y++) {
+            for (int x = span.x; x < span.x + span.width; x++) {
+                drop(cells_[y * cols_ + x]);
+            }
+        }
+    }
+    
+    // Listed path with the vertex nearest to from, -1 when none is listed.
+    // Cells are visited in square rings around from's cell; ring r is at
+    // least (r - 1) cells away, so the search stops once that exceeds the
+    // best distance found.
+    int nearest(const std::vector<ToolPath>& paths, const cv::Point2d& from, size_t& vertex) {
+        query_++;
+        int chosen = -1;
+        double best = std::numeric_limits<double>::max();
+        auto consider = [&](int path) {
+            if (stamp_[path] == query_) {
+                return;
+            }
+            stamp_[path] = query_;
+            if (distanceToRect(from, bounds_[path]) >= best) {
+                return;
+            }
+            double d;
+            const size_t v = nearestVertex(paths[path], from, d);
+            if (d < best) {
+                best = d;
+                chosen = path;
+                vertex = v;
+            }
+        };
+        
+        auto visit = [&](int x, int y) {
+            for (int path : cells_[y * cols_ + x]) {
+                consider(path);
+            }
+        };
+        
+        for (int path : large_) {
+            consider(path);
+        }
+        
+        const int cx = cellX(from.x);
+        const int cy = cellY(from.y);
+        const int max_ring = std::max({cx, cy, cols_ - 1 - cx, rows_ - 1 - cy});
+        for (int r = 0; r <= max_ring; r++) {
+            if (chosen >= 0 && (r - 1) * cell_ >= best) {
+                break;
+            }
+            for (int y = std::max(0, cy - r); y <= std::min(rows_ - 1, cy + r); y++) {
+                if (std::abs(y - cy) == r) {
+                    for (int x = std::max(0, cx - r); x <= std::min(cols_ - 1, cx + r); x++) {
+                        visit(x, y);
+                    }
+                    continue;
+                }
+                if (cx - r >= 0) {
+                    visit(cx - r, y);
+                }
+                if (cx + r < cols_) {
+                    visit(cx + r, y);
+                }
+            }
+        }
+        return chosen;
+    }
+
+private:
+    int cellX(double x) const {
+        return std::max(0, std::min(cols_ - 1, static_cast<int>((x - origin_.x) / cell_)));
+    }
+    
+    int cellY(double y) const {
+        return std::max(0, std::min(rows_ - 1, static_cast<int>((y - origin_.y) / cell_)));
+    }
+    
+    cv::Rect cellSpan(int path) const {
+        const cv::Rect2d& r = bounds_[path];
+        const int x0 = cellX(r.x);
+        const int y0 = cellY(r.y);
+        return cv::Rect(x0, y0, cellX(r.x + r.width) - x0 + 1, cellY(r.y + r.height) - y0 + 1);
+    }
+    
+    const std::vector<cv::Rect2d>& bounds_;
+    cv::Point2d origin_;
+    double cell_ = 1.0;
+    int cols_ = 1;
+    int rows_ = 1;
+    std::vector<std::vector<int>> cells_;
+    std::vector<int> large_;
+    std::vector<int> stamp_;          // Query that last looked at each path
+    int query_ = 0;
+};
+
+// Greedy tour over the paths whose children are all cut. Candidates come
+// from the grid around the current position, and the bounding box distance
+// is a lower bound, so most paths are rejected without touching their
+// vertices.
+std::vector<int> nearestNeighbourOrder(std::vector<ToolPath>& paths) {
+    const int n = static_cast<int>(paths.size());
+    std::vector<cv::Rect2d> bounds(n);
+    std::vector<int> pending(n, 0);
+    for (int i = 0; i < n; i++) {
+        bounds[i] = pathBounds(paths[i]);
+        if (paths[i].parent >= 0) {
+            pending[paths[i].parent]++;
+        }
+    }
+    
+    cv::Point2d position(0.0, 0.0);
+    PathGrid available(bounds, position);
+    for (int i = 0; i < n; i++) {
+        if (pending[i] == 0) {
+            available.insert(i);
+        }
+    }
+    
+    std::vector<int> order;
+    order.reserve(n);
+    size_t best_vertex = 0;
+    for (int chosen; (chosen = available.nearest(paths, position, best_vertex)) >= 0;) {
+        available.erase(chosen);
+        
+        ToolPath& path = paths[chosen];
+        std::rotate(path.points.begin(), path.points.begin() + best_vertex, path.points.end());
+        position = path.points[0];
+        order.push_back(chosen);
+        
+        if (path.parent >= 0 && --pending[path.parent] == 0) {
+            available.insert(path.parent);
+        }
+    }
+    return order;
+}
+
+// Segment reversals that shorten travel between fixed entry points. A
+// reversal is rejected if it would put a path after its parent; checking
+// direct parents inside the segment is enough, since any ancestor pair in
+// the segment has the path between them in it too.
+void twoOptImprove(const std::vector<ToolPath>& paths, std::vector<int>& order,
+                   const GcodeOptions& options) {
+    const int n = static_cast<int>(order.size());
+    if (n < 3) {
+        return;
+    }
+    
+    std::vector<int> position(paths.size());
+    for (int k = 0; k < n; k++) {
+        position[order[k]] = k;
+    }
+    const cv::Point2d home(0.0, 0.0);
+    auto entry = [&](int k) { return paths[order[k]].points[0]; };
+    auto keepsPrecedence = [&](int i, int j) {
+        for (int k = i; k <= j; k++) {
+            const int parent = paths[order[k]].parent;
+            if (parent >= 0 && position[parent] >= i && position[parent] <= j) {
+                return false;
+            }
+        }
+        return true;
+    };
+    
+    const int window = std::max(1, options.two_opt_window);
+    for (int pass = 0; pass < options.two_opt_passes; pass++) {
+        bool improved = false;
+        for (int i = 0; i < n - 1; i++) {
+            const cv::Point2d a = i == 0 ? home : entry(i - 1);
+            for (int j = i + 1; j < std::min(n, i + 1 + window); j++) {
+                const cv::Point2d b = entry(i);
+                const cv::Point2d c = entry(j);
+                double delta = distance(a, c) - distance(a, b);
+                if (j + 1 < n) {
+                    const cv::Point2d d = entry(j + 1);
+                    delta += distance(b, d) - distance(c, d);
+                }
+                if (delta < -1e-9 && keepsPrecedence(i, j)) {
+                    std::reverse(order.begin() + i, order.begin() + j + 1);
+                    for (int k = i; k <= j; k++) {
+                        position[order[k]] = k;
+                    }
+                    improved = true;
+                }
+            }
+        }
+        if (!improved) {
+            break;
+        }
+    }
+}
+
+// Re-picks each entry vertex against its actual neighbours in the tour;
+// the current entry is always a candidate, so travel never grows
+void refineEntries(std::vector<ToolPath>& paths, const std::vector<int>& order) {
+    cv::Point2d previous(0.0, 0.0);
+    for (size_t k = 0; k < order.size(); k++) {
+        ToolPath& path = paths[order[k]];
+        const bool has_next = k + 1 < order.size();
+        const cv::Point2d next = has_next ? paths[order[k + 1]].points[0] : cv::Point2d();
+        
+        size_t best_vertex = 0;
+        double best = std::numeric_limits<double>::max();
+        for (size_t v = 0; v < path.points.size(); v++) {
+            const double d = distance(previous, path.points[v]) +
+                             (has_next ? distance(path.points[v], next) : 0.0);
+            if (d < best) {
+                best = d;
+                best_vertex = v;
+            }
+        }
+        std::rotate(path.points.begin(), path.points.begin() + best_vertex, path.points.end());
+        previous = path.points[0];
+    }
+}
+
+double travelLength(const std::vector<ToolPath>& paths) {
+    double length = 0.0;
+    cv::Point2d position(0.0, 0.0);
+    for (const ToolPath& path : paths) {
+        length += distance(position, path.points[0]);
+        position = path.points[0];
+    }
+    return length;
+}
+
+// Trapezoidal profile from standstill to standstill; triangular when the
+// move is too short to reach full speed
+double moveTime(double length, double rate_mm_min, double acceleration) {
+    const double v = rate_mm_min / 60.0;
+    if (length <= 0.0 || v <= 0.0) {
+        return 0.0;
+    }
+    if (acceleration <= 0.0) {
+        return length / v;
+    }
+    if (length >= v * v / acceleration) {
+        return length / v + v / acceleration;
+    }
+    return 2.0 * std::sqrt(length / acceleration);
+}
+}
+
+GcodePlan planToolPaths(const std::vector<std::vector<cv::Point>>& contours,
+                        const std::vector<cv::Vec4i>& hierarchy, const cv::Size& size,
+                        const GcodeOptions& options) {
+    GcodePlan plan;
+    const size_t count = contours.size();
+    const bool has_tree = hierarchy.size() == count;
+    const double px = options.pixel_size_mm;
+    const double half_kerf = options.kerf_mm * 0.5;
+    
+    // Depth of every contour; even depth = outer boundary of a traced region
+    std::vector<int> depth(count, 0);
+    if (has_tree) {
+        for (size_t i = 0; i < count; i++) {
+            for (int p = hierarchy[i][3]; p >= 0; p = hierarchy[p][3]) {
+                depth[i]++;
+            }
+        }
+    }
+    
+    std::vector<int> path_of(count, -1);
+    std::vector<int> contour_of;
+    std::vector<cv::Point> simplified;
+    for (size_t i = 0; i < count; i++) {
+        if (options.min_area > 0.0 && cv::contourArea(contours[i]) < options.min_area) {
+            continue;
+        }
+        if (options.epsilon > 0.0) {
+            cv::approxPolyDP(contours[i], simplified, options.epsilon, true);
+        } else {
+            simplified = contours[i];
+        }
+        if (simplified.size() < 3) {
+            continue;
+        }
+        
+        ToolPath path;
+        path.depth = depth[i];
+        path.points.reserve(simplified.size());
+        for (const cv::Point& p : simplified) {
+            path.points.emplace_back(p.x * px, (size.height - p.y) * px);
+        }
+        
+        // Into the region: outer rings shrink, hole rings grow
+        const double grow = depth[i] % 2 == 0 ? -half_kerf : half_kerf;
+        if (!offsetRing(path.points, grow)) {
+            plan.stats.dropped++;
+            continue;
+        }
+        path_of[i] = static_cast<int>(plan.paths.size());
+        contour_of.push_back(static_cast<int>(i));
+        plan.paths.push_back(std::move(path));
+    }
+    
+    // Parent = nearest enclosing contour that produced a path
+    for (size_t k = 0; k < plan.paths.size(); k++) {
+        int p = has_tree ? hierarchy[contour_of[k]][3] : -1;
+        while (p >= 0 && path_of[p] < 0) {
+            p = hierarchy[p][3];
+        }
+        plan.paths[k].parent = p >= 0 ? path_of[p] : -1;
+    }
+    
+    plan.stats.travel_unoptimized_mm = travelLength(plan.paths);
+    
+    std::vector<int> order;
+    if (options.optimize) {
+        order = nearestNeighbourOrder(plan.paths);
+        twoOptImprove(plan.paths, order, options);
+        refineEntries(plan.paths, order);
+    } else {
+        // Trace order with children moved ahead of their parents
+        for (size_t k = 0; k < plan.paths.size(); k++) {
+            order.push_back(static_cast<int>(k));
+        }
+        std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+            return plan.paths[a].depth > plan.paths[b].depth;
+        });
+    }
+    
+    // Reorder and remap parents to positions in the cutting order
+    std::vector<int> rank(plan.paths.size());
+    for (size_t k = 0; k < order.size(); k++) {
+        rank[order[k]] = static_cast<int>(k);
+    }
+    std::vector<ToolPath> ordered;
+    ordered.reserve(order.size());
+    for (int index : order) {
+        ordered.push_back(std::move(plan.paths[index]));
+        if (ordered.back().parent >= 0) {
+            ordered.back().parent = rank[ordered.back().parent];
+        }
+    }
+    plan.paths.swap(ordered);
+    
+    estimateCutTime(plan.paths, options, plan.stats);
+    return plan;
+}
+
+void estimateCutTime(const std::vector<ToolPath>& paths, const GcodeOptions& options,
+                     GcodeStats& stats) {
+    stats.paths = paths.size();
+    stats.vertices = 0;
+    stats.cut_length_mm = 0.0;
+    stats.travel_length_mm = 0.0;
+    stats.cut_time_s = 0.0;
+    stats.travel_time_s = 0.0;
+    
+    const double z_travel = options.use_z ? std::abs(options.safe_z - options.cut_z) : 0.0;
+    cv::Point2d position(0.0, 0.0);
+    for (const ToolPath& path : paths) {
+        const double rapid = distance(position, path.points[0]);
+        stats.travel_length_mm += rapid;
+        stats.travel_time_s += moveTime(rapid, options.travel_rate, options.acceleration) +
+                               moveTime(z_travel, options.travel_rate, options.acceleration);
+        stats.cut_time_s += moveTime(z_travel, options.plunge_rate, options.acceleration) +
+                            options.pierce_time_s;
+        
+        // Every vertex is a full stop in the estimate: corners of a stencil
+        // are mostly sharp after simplification
+        const size_t n = path.points.size();
+        for (size_t i = 0; i < n; i++) {
+            const double length = distance(path.points[i], path.points[(i + 1) % n]);
+            stats.cut_length_mm += length;
+            stats.cut_time_s += moveTime(length, options.feed_rate, options.acceleration);
+        }
+        stats.vertices += n;
+        position = path.points[0];
+    }
+    stats.total_time_s = stats.cut_time_s + stats.travel_time_s;
+}
+
+bool writeGcode(const std::string& filepath, const GcodePlan& plan, const GcodeOptions& options) {
+    std::vector<char> buffer(kWriteBufferBytes);
+    std::ofstream out;
+    out.rdbuf()->pubsetbuf(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    out.open(filepath, std::ios::out | std::ios::trunc);
+    if (!out.is_open()) {
+        return false;
+    }
+    
+    const GcodeStats& stats = plan.stats;
+    out << std::fixed << std::setprecision(3);
+    out << "; Stencil toolpaths: " << stats.paths << " paths, "
+        << stats.cut_length_mm << " mm cut, " << stats.travel_length_mm << " mm travel\n"
+        << "; Estimated time: " << stats.total_time_s / 60.0 << " min\n"
+        << "G21\nG90\n";
+    if (options.use_z) {
+        out << "G0 Z" << options.safe_z << "\n";
+    }
+    
+    for (const ToolPath& path : plan.paths) {
+        out << "G0 X" << path.points[0].x << " Y" << path.points[0].y << "\n";
+        if (options.use_z) {
+            out << "G1 Z" << options.cut_z << " F" << options.plunge_rate << "\n";
+        }
+        if (!options.tool_on.empty()) {
+            out << options.tool_on << "\n";
+        }
+        if (options.pierce_time_s > 0.0) {
+            out << "G4 P" << options.pierce_time_s << "\n";
+        }
+        
+        // Feed is modal: set once per path, then close the loop on the entry
+        out << "G1 X" << path.points[1].x << " Y" << path.points[1].y
+            << " F" << options.feed_rate << "\n";
+        for (size_t i = 2; i < path.points.size(); i++) {
+            out << "G1 X" << path.points[i].x << " Y" << path.points[i].y << "\n";
+        }
+        out << "G1 X" << path.points[0].x << " Y" << path.points[0].y << "\n";
+        
+        if (!options.tool_off.empty()) {
+            out << options.tool_off << "\n";
+        }
+        if (options.use_z) {
+            out << "G0 Z" << options.safe_z << "\n";
+        }
+    }
+    out << "G0 X0 Y0\nM2\n";
+    
+    out.flush();
+    return out.good();
+}
+
+bool exportGcode(const std::string& filepath, const cv::Mat& binary,
+                 const GcodeOptions& options, GcodeStats* stats) {
+    if (binary.empty() || binary.type() != CV_8UC1) {
+        return false;
+    }
+    
+    // Full tree: inside-before-outside needs every nesting level
+    std::vector<std::vector<cv::Point>> contours;
+    std::vector<cv::Vec4i> hierarchy;
+    cv::findContours(binary, contours, hierarchy, cv::RETR_TREE, cv::CHAIN_APPROX_SIMPLE);
+    
+    GcodePlan plan = planToolPaths(contours, hierarchy, binary.size(), options);
+    if (stats) {
+        *stats = plan.stats;
+    }
+    return writeGcode(filepath, plan, options);
+}
+
+bool exportGcode(const std::string& filepath, const RleImage& image,
+                 const GcodeOptions& options, GcodeStats* stats) {
+    if (image.empty()) {
+        return false;
+    }
+    
+    std::vector<std::vector<cv::Point>> contours;
+    std::vector<cv::Vec4i> hierarchy;
+    traceContours(image, contours, hierarchy);
+    
+    GcodePlan plan = planToolPaths(contours, hierarchy, image.size(), options);
+    if (stats) {
+        *stats = plan.stats;
+    }
+    return writeGcode(filepath, plan, options);
+}
+
+} // namespace stencil
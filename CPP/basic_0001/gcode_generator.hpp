@@ -0,0 +1,95 @@
+// gcode_generator.hpp
+#ifndef GCODE_GENERATOR_HPP
+#define GCODE_GENERATOR_HPP
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+#include "rle_image.hpp"
+
+namespace stencil {
+
+// ────────────────────────── G-CODE GENERATOR ──────────────────────────
+// Turns the regions of a binary stencil into closed toolpaths for a plotter,
+// drag knife or laser. Every ring of a findContours tree (RETR_TREE) becomes
+// one path, offset by half the kerf into the traced region so the material
+// around it keeps its size. Paths are cut inside-before-outside: a contour is
+// only cut once everything nested in it is done, so no loose piece shifts
+// before its inner cuts. Within that constraint the tour is built nearest
+// neighbour first and then improved with 2-opt, since rapid travel between
+// contours dominates job time on long jobs.
+
+struct GcodeOptions {
+    double pixel_size_mm = 0.1;       // Machine millimetres per stencil pixel
+    double kerf_mm = 0.0;             // Cut width; paths move inward by half of it
+    double epsilon = 1.0;             // approxPolyDP tolerance in pixels, 0 keeps every vertex
+    double min_area = 0.0;            // Rings smaller than this (px^2) are skipped
+    
+    double feed_rate = 1000.0;        // Cutting speed, mm/min
+    double travel_rate = 3000.0;      // Rapid speed, mm/min (used for the estimate)
+    double plunge_rate = 300.0;       // Z feed when lowering the tool, mm/min
+    double acceleration = 500.0;      // mm/s^2 for the time estimate, 0 = constant speed
+    double pierce_time_s = 0.0;       // Dwell after the tool goes down (laser pierce)
+    
+    bool use_z = true;                // Lift/lower the tool with Z moves
+    double safe_z = 5.0;
+    double cut_z = -1.0;
+    std::string tool_on = "";         // e.g. "M3 S1000" for a laser, emitted after lowering
+    std::string tool_off = "";        // e.g. "M5", emitted before lifting
+    
+    bool optimize = true;             // Nearest neighbour + 2-opt; false keeps trace order
+    int two_opt_window = 200;         // Segment length limit for 2-opt moves
+    int two_opt_passes = 8;
+};
+
+// Closed path in machine millimetres (y up); the first point is the entry
+struct ToolPath {
+    std::vector<cv::Point2d> points;
+    int parent = -1;                  // Enclosing path, must be cut after this one
+    int depth = 0;
+};
+
+struct GcodeStats {
+    size_t paths = 0;
+    size_t dropped = 0;               // Rings that vanished under the kerf offset
+    size_t vertices = 0;
+    double cut_length_mm = 0.0;
+    double travel_length_mm = 0.0;
+    double travel_unoptimized_mm = 0.0; // Travel in trace order, for comparison
+    double cut_time_s = 0.0;
+    double travel_time_s = 0.0;
+    double total_time_s = 0.0;
+};
+
+struct GcodePlan {
+    std::vector<ToolPath> paths;      // In cutting order
+    GcodeStats stats;
+};
+
+// Builds and orders toolpaths from a contour tree; size is the raster size
+// the contours came from
+GcodePlan planToolPaths(const std::vector<std::vector<cv::Point>>& contours,
+                        const std::vector<cv::Vec4i>& hierarchy, const cv::Size& size,
+                        const GcodeOptions& options = GcodeOptions());
+
+// Fills the length and time fields of stats for paths in the given order
+void estimateCutTime(const std::vector<ToolPath>& paths, const GcodeOptions& options,
+                     GcodeStats& stats);
+
+// Writes the plan as G-code (G21/G90, absolute millimetres)
+bool writeGcode(const std::string& filepath, const GcodePlan& plan,
+                const GcodeOptions& options = GcodeOptions());
+
+// Traces the non-zero pixels of a CV_8UC1 image, plans and writes the job
+bool exportGcode(const std::string& filepath, const cv::Mat& binary,
+                 const GcodeOptions& options = GcodeOptions(),
+                 GcodeStats* stats = nullptr);
+
+// Same for the foreground of a run-length image, traced along pixel edges
+bool exportGcode(const std::string& filepath, const RleImage& image,
+                 const GcodeOptions& options = GcodeOptions(),
+                 GcodeStats* stats = nullptr);
+
+} // namespace stencil
+
+#endif // GCODE_GENERATOR_HPP
@@ -0,0 +1,338 @@
+// image_ingest.cpp
+#include "image_ingest.hpp"
+#include "mapped_file.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <vector>
+
+#ifdef STENCIL_HAVE_LIBPNG
+#include <png.h>
+#include <csetjmp>
+#endif
+
+#ifdef STENCIL_HAVE_LIBTIFF
+#include <tiffio.h>
+#include <fstream>
+#endif
+
+namespace stencil {
+
+namespace {
+uint32_t readBE16(const uchar* p) {
+    return (uint32_t(p[0]) << 8) | p[1];
+}
+
+uint32_t readBE32(const uchar* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+bool probeJpeg(const uchar* data, size_t size, ImageInfo& info) {
+    size_t pos = 2;
+    while (pos + 4 <= size) {
+        if (data[pos] != 0xFF) {
+            return false;
+        }
+        // Markers may be preceded by any number of fill bytes
+        while (pos < size && data[pos] == 0xFF) {
+            pos++;
+        }
+        if (pos >= size) {
+            return false;
+        }
+        const uchar marker = data[pos++];
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8)) {
+            continue;  // Standalone markers carry no length
+        }
+        if (pos + 2 > size) {
+            return false;
+        }
+        const size_t length = readBE16(data + pos);
+        
+        // SOF0..SOF15, except DHT (C4), JPG (C8) and DAC (CC)
+        if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            if (pos + 7 > size) {
+                return false;
+            }
+            info.format = "jpeg";
+            info.size = cv::Size(static_cast<int>(readBE16(data + pos + 5)),
+                                 static_cast<int>(readBE16(data + pos + 3)));
+            return info.size.area() > 0;
+        }
+        pos += length;
+    }
+    return false;
+}
+
+int reducedFlag(int factor, bool grayscale) {
+    switch (factor) {
+    case 8: return grayscale ? cv::IMREAD_REDUCED_GRAYSCALE_8 : cv::IMREAD_REDUCED_COLOR_8;
+    case 4: return grayscale ? cv::IMREAD_REDUCED_GRAYSCALE_4 : cv::IMREAD_REDUCED_COLOR_4;
+    case 2: return grayscale ? cv::IMREAD_REDUCED_GRAYSCALE_2 : cv::IMREAD_REDUCED_COLOR_2;
+    default: return grayscale ? cv::IMREAD_GRAYSCALE : cv::IMREAD_COLOR;
+    }
+}
+
+// Packed 8-bit pixels of one row -> gray, with the same weights as the
+// BGR2GRAY conversion the pipelines use
+void rowToGray(const uchar* src, int channels, bool rgb_order, uchar* dst, int width) {
+    if (channels == 1) {
+        std::memcpy(dst, src, width);
+        return;
+    }
+    cv::Mat in(1, width, CV_8UC(channels), const_cast<uchar*>(src));
+    cv::Mat out(1, width, CV_8UC1, dst);
+    if (channels == 2) {
+        // Gray + alpha: alpha is dropped like IMREAD_COLOR does
+        cv::extractChannel(in, out, 0);
+    } else if (channels == 3) {
+        cv::cvtColor(in, out, rgb_order ? cv::COLOR_RGB2GRAY : cv::COLOR_BGR2GRAY);
+    } else {
+        cv::cvtColor(in, out, rgb_order ? cv::COLOR_RGBA2GRAY : cv::COLOR_BGRA2GRAY);
+    }
+}
+
+#ifdef STENCIL_HAVE_LIBPNG
+// ────────────────────────── PNG STRIPS ──────────────────────────
+// libpng reads the mapped file through a cursor; one decoded row is alive
+// at a time.
+class PngStripReader : public StripReader {
+public:
+    ~PngStripReader() override {
+        if (png_) {
+            png_destroy_read_struct(&png_, info_ ? &info_ : nullptr, nullptr);
+        }
+    }
+    
+    bool open(const std::string& filepath) {
+        if (!file_.open(filepath) || file_.size() < 8 || png_sig_cmp(file_.data(), 0, 8) != 0) {
+            return false;
+        }
+        png_ = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+        info_ = png_ ? png_create_info_struct(png_) : nullptr;
+        if (!info_) {
+            return false;
+        }
+        if (setjmp(png_jmpbuf(png_))) {
+            return false;
+        }
+        png_set_read_fn(png_, this, &PngStripReader::readData);
+        png_read_info(png_, info_);
+        
+        if (png_get_interlace_type(png_, info_) != PNG_INTERLACE_NONE) {
+            return false;  // Adam7 needs every pass before any row is final
+        }
+        // Same reductions as OpenCV's decoder: 8-bit, palette/low-bit expanded
+        png_set_expand(png_);
+        png_set_strip_16(png_);
+        png_read_update_info(png_, info_);
+        
+        size_ = cv::Size(static_cast<int>(png_get_image_width(png_, info_)),
+                         static_cast<int>(png_get_image_height(png_, info_)));
+        channels_ = png_get_channels(png_, info_);
+        row_.resize(png_get_rowbytes(png_, info_));
+        return size_.area() > 0 && channels_ >= 1 && channels_ <= 4;
+    }
+    
+    cv::Size size() const override { return size_; }
+    
+    bool read(cv::Mat& rows) override {
+        CV_Assert(rows.type() == CV_8UC1 && rows.cols == size_.width);
+        if (setjmp(png_jmpbuf(png_))) {
+            return false;
+        }
+        for (int y = 0; y < rows.rows; y++) {
+            png_read_row(png_, row_.data(), nullptr);
+            rowToGray(row_.data(), channels_, true, rows.ptr<uchar>(y), size_.width);
+        }
+        return true;
+    }
+
+private:
+    static void readData(png_structp png, png_bytep out, png_size_t length) {
+        auto* self = static_cast<PngStripReader*>(png_get_io_ptr(png));
+        if (self->offset_ + length > self->file_.size()) {
+            png_error(png, "truncated PNG");
+        }
+        std::memcpy(out, self->file_.data() + self->offset_, length);
+        self->offset_ += length;
+    }
+    
+    MappedFile file_;
+    size_t offset_ = 0;
+    png_structp png_ = nullptr;
+    png_infop info_ = nullptr;
+    cv::Size size_;
+    int channels_ = 0;
+    std::vector<uchar> row_;
+};
+#endif
+
+#ifdef STENCIL_HAVE_LIBTIFF
+// ────────────────────────── TIFF STRIPS ──────────────────────────
+// Scanline access to striped TIFFs; libtiff maps the file itself.
+class TiffStripReader : public StripReader {
+public:
+    ~TiffStripReader() override {
+        if (tiff_) {
+            TIFFClose(tiff_);
+        }
+    }
+    
+    bool open(const std::string& filepath) {
+        // Check the byte-order mark first so other formats never reach libtiff
+        char magic[4] = {};
+        std::ifstream probe(filepath, std::ios::binary);
+        if (!probe.read(magic, 4) ||
+            (std::memcmp(magic, "II*\0", 4) != 0 && std::memcmp(magic, "MM\0*", 4) != 0)) {
+            return false;
+        }
+        tiff_ = TIFFOpen(filepath.c_str(), "r");
+        if (!tiff_ || TIFFIsTiled(tiff_)) {
+            return false;
+        }
+        
+        uint32_t width = 0, height = 0;
+        uint16_t bits = 8, samples = 1, planar = PLANARCONFIG_CONTIG, photometric = PHOTOMETRIC_MINISBLACK;
+        TIFFGetField(tiff_, TIFFTAG_IMAGEWIDTH, &width);
+        TIFFGetField(tiff_, TIFFTAG_IMAGELENGTH, &height);
+        TIFFGetFieldDefaulted(tiff_, TIFFTAG_BITSPERSAMPLE, &bits);
+        TIFFGetFieldDefaulted(tiff_, TIFFTAG_SAMPLESPERPIXEL, &samples);
+        TIFFGetFieldDefaulted(tiff_, TIFFTAG_PLANARCONFIG, &planar);
+        TIFFGetField(tiff_, TIFFTAG_PHOTOMETRIC, &photometric);
+        
+        const bool supported_photometric = photometric == PHOTOMETRIC_MINISBLACK ||
+                                           photometric == PHOTOMETRIC_MINISWHITE ||
+                                           photometric == PHOTOMETRIC_RGB;
+        if ((bits != 8 && bits != 16) || samples < 1 || samples > 4 ||
+            planar != PLANARCONFIG_CONTIG || !supported_photometric ||
+            width == 0 || height == 0 || width > INT_MAX || height > INT_MAX) {
+            return false;
+        }
+        
+        size_ = cv::Size(static_cast<int>(width), static_cast<int>(height));
+        bits_ = bits;
+        channels_ = samples;
+        min_is_white_ = photometric == PHOTOMETRIC_MINISWHITE;
+        scanline_.resize(static_cast<size_t>(TIFFScanlineSize(tiff_)));
+        packed_.resize(static_cast<size_t>(width) * samples);
+        return true;
+    }
+    
+    cv::Size size() const override { return size_; }
+    
+    bool read(cv::Mat& rows) override {
+        CV_Assert(rows.type() == CV_8UC1 && rows.cols == size_.width);
+        for (int y = 0; y < rows.rows; y++) {
+            if (TIFFReadScanline(tiff_, scanline_.data(), next_row_++) < 0) {
+                return false;
+            }
+            const uchar* src = scanline_.data();
+            if (bits_ == 16) {
+                // High byte, as OpenCV's 16 -> 8 bit decode does
+                const uint16_t* wide = reinterpret_cast<const uint16_t*>(scanline_.data());
+                for (size_t i = 0; i < packed_.size(); i++) {
+                    packed_[i] = static_cast<uchar>(wide[i] >> 8);
+                }
+                src = packed_.data();
+            }
+            uchar* dst = rows.ptr<uchar>(y);
+            rowToGray(src, channels_, true, dst, size_.width);
+            if (min_is_white_) {
+                for (int x = 0; x < size_.width; x++) {
+                    dst[x] = static_cast<uchar>(255 - dst[x]);
+                }
+            }
+        }
+        return true;
+    }
+
+private:
+    TIFF* tiff_ = nullptr;
+    cv::Size size_;
+    int bits_ = 8;
+    int channels_ = 1;
+    bool min_is_white_ = false;
+    uint32_t next_row_ = 0;
+    std::vector<uchar> scanline_;
+    std::vector<uchar> packed_;
+};
+#endif
+}
+
+bool probeImage(const uchar* data, size_t size, ImageInfo& info) {
+    info = ImageInfo();
+    if (!data || size < 24) {
+        return false;
+    }
+    if (data[0] == 0xFF && data[1] == 0xD8) {
+        return probeJpeg(data, size, info);
+    }
+    static const uchar png_signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    if (std::memcmp(data, png_signature, 8) == 0 && std::memcmp(data + 12, "IHDR", 4) == 0) {
+        info.format = "png";
+        info.size = cv::Size(static_cast<int>(readBE32(data + 16)), static_cast<int>(readBE32(data + 20)));
+        return info.size.area() > 0;
+    }
+    return false;
+}
+
+int reductionFactor(const cv::Size& size, int max_dimension) {
+    if (max_dimension <= 0) {
+        return 1;
+    }
+    const int longer = std::max(size.width, size.height);
+    for (int factor = 8; factor > 1; factor /= 2) {
+        if (longer / factor >= max_dimension) {
+            return factor;
+        }
+    }
+    return 1;
+}
+
+cv::Mat decodeImage(const uchar* data, size_t size, const IngestOptions& options) {
+    if (!data || size == 0 || size > static_cast<size_t>(INT_MAX)) {
+        return cv::Mat();
+    }
+    
+    int factor = 1;
+    ImageInfo info;
+    if (options.max_dimension > 0 && probeImage(data, size, info)) {
+        factor = reductionFactor(info.size, options.max_dimension);
+    }
+    
+    // Header over the caller's bytes: imdecode reads them in place
+    const cv::Mat encoded(1, static_cast<int>(size), CV_8UC1, const_cast<uchar*>(data));
+    return cv::imdecode(encoded, reducedFlag(factor, options.grayscale));
+}
+
+cv::Mat loadImageMapped(const std::string& filepath, const IngestOptions& options) {
+    MappedFile file(filepath);
+    if (!file.isOpen()) {
+        return cv::Mat();
+    }
+    return decodeImage(file.data(), file.size(), options);
+}
+
+std::unique_ptr<StripReader> openStripReader(const std::string& filepath) {
+#ifdef STENCIL_HAVE_LIBPNG
+    {
+        auto reader = std::make_unique<PngStripReader>();
+        if (reader->open(filepath)) {
+            return reader;
+        }
+    }
+#endif
+#ifdef STENCIL_HAVE_LIBTIFF
+    {
+        auto reader = std::make_unique<TiffStripReader>();
+        if (reader->open(filepath)) {
+            return reader;
+        }
+    }
+#endif
+    (void)filepath;
+    return nullptr;
+}
+
+} // namespace stencil
@@ -0,0 +1,66 @@
+// image_ingest.hpp
+#ifndef IMAGE_INGEST_HPP
+#define IMAGE_INGEST_HPP
+
+#include <opencv2/opencv.hpp>
+#include <memory>
+#include <string>
+
+namespace stencil {
+
+// ────────────────────────── IMAGE INGEST ──────────────────────────
+// Loads source images without holding the encoded file and a full colour
+// decode side by side. Files are memory-mapped and handed to cv::imdecode
+// in place. Both stencil pipelines start with a grayscale conversion, so
+// decoding straight to gray loses nothing they use. JPEG sources can also
+// be decoded at 1/2, 1/4 or 1/8 scale in the DCT domain when the output
+// does not need full resolution.
+//
+// Large PNG and TIFF scans can instead be read in row strips (StripReader)
+// and fed to the tiled pipeline band by band, so the full image never exists
+// in memory. Strip decoding needs libpng/libtiff at build time
+// (STENCIL_HAVE_LIBPNG / STENCIL_HAVE_LIBTIFF); without them openStripReader
+// returns null and callers fall back to a whole-image decode.
+
+struct IngestOptions {
+    bool grayscale = false;      // Decode to CV_8UC1 instead of BGR
+    int max_dimension = 0;       // > 0: reduce while the longer side stays >= this
+};
+
+struct ImageInfo {
+    std::string format;          // "jpeg", "png" or empty when unknown
+    cv::Size size;
+};
+
+// Reads the image size from a JPEG SOF or PNG IHDR header without decoding
+bool probeImage(const uchar* data, size_t size, ImageInfo& info);
+
+// Largest of 1, 2, 4, 8 that keeps the longer side >= max_dimension
+int reductionFactor(const cv::Size& size, int max_dimension);
+
+// Decodes an in-memory encoded image without copying it
+cv::Mat decodeImage(const uchar* data, size_t size, const IngestOptions& options = IngestOptions());
+
+// Memory-maps the file and decodes it in place
+cv::Mat loadImageMapped(const std::string& filepath, const IngestOptions& options = IngestOptions());
+
+// ────────────────────────── STRIP READER ──────────────────────────
+// Sequential top-to-bottom 8-bit gray decoder. Gray values match a BGR
+// decode followed by COLOR_BGR2GRAY, as in the in-memory pipeline.
+class StripReader {
+public:
+    virtual ~StripReader() = default;
+
+    virtual cv::Size size() const = 0;
+
+    // Decodes the next rows.rows rows into rows (CV_8UC1, size().width wide)
+    virtual bool read(cv::Mat& rows) = 0;
+};
+
+// Null when the file is not a strip-decodable PNG (non-interlaced) or TIFF
+// (striped, 8/16-bit, contiguous), or the decoder library is not built in
+std::unique_ptr<StripReader> openStripReader(const std::string& filepath);
+
+} // namespace stencil
+
+#endif // IMAGE_INGEST_HPP
@@ -0,0 +1,165 @@
+// island_analysis.cpp
+#include "island_analysis.hpp"
+#include <algorithm>
+#include <climits>
+
+namespace stencil {
+
+cv::Mat IslandTable::islandMask(int index) const {
+    if (index < 0 || index >= static_cast<int>(islands.size())) {
+        return cv::Mat();
+    }
+    const Island& island = islands[index];
+    return labels(island.bounding_box) == island.label;
+}
+
+IslandTable analyzeIslands(const cv::Mat& foreground, int min_area, int connectivity) {
+    IslandTable table;
+    
+    if (foreground.empty()) {
+        return table;
+    }
+    CV_Assert(foreground.type() == CV_8UC1);
+    
+    cv::Mat stats, centroids;
+    table.num_labels = cv::connectedComponentsWithStats(foreground, table.labels, stats,
+                                                        centroids, connectivity, CV_32S);
+    
+    // Border contact: only the four edges need to be looked at
+    std::vector<uchar>& touches_border = table.touches_border;
+    touches_border.assign(table.num_labels, 0);
+    const cv::Mat& labels = table.labels;
+    const int last_row = labels.rows - 1;
+    const int last_col = labels.cols - 1;
+    
+    const int* top = labels.ptr<int>(0);
+    const int* bottom = labels.ptr<int>(last_row);
+    for (int x = 0; x <= last_col; x++) {
+        touches_border[top[x]] = 1;
+        touches_border[bottom[x]] = 1;
+    }
+    for (int y = 0; y <= last_row; y++) {
+        const int* row = labels.ptr<int>(y);
+        touches_border[row[0]] = 1;
+        touches_border[row[last_col]] = 1;
+    }
+    
+    // Classify from the component statistics
+    table.label_to_island.assign(table.num_labels, -1);
+    for (int label = 1; label < table.num_labels; label++) {
+        int area = stats.at<int>(label, cv::CC_STAT_AREA);
+        if (touches_border[label] || area <= min_area) {
+            continue;
+        }
+        
+        Island island;
+        island.label = label;
+        island.area = area;
+        island.bounding_box = cv::Rect(stats.at<int>(label, cv::CC_STAT_LEFT),
+                                       stats.at<int>(label, cv::CC_STAT_TOP),
+                                       stats.at<int>(label, cv::CC_STAT_WIDTH),
+                                       stats.at<int>(label, cv::CC_STAT_HEIGHT));
+        island.centroid = cv::Point2d(centroids.at<double>(label, 0),
+                                      centroids.at<double>(label, 1));
+        
+        table.label_to_island[label] = static_cast<int>(table.islands.size());
+        table.islands.push_back(island);
+    }
+    
+    // One pass over the labels writes the mask for every island at once
+    table.mask.create(labels.size(), CV_8UC1);
+    std::vector<uchar> keep(table.num_labels, 0);
+    for (int label = 0; label < table.num_labels; label++) {
+        keep[label] = table.label_to_island[label] >= 0 ? 255 : 0;
+    }
+    
+    cv::parallel_for_(cv::Range(0, labels.rows), [&](const cv::Range& range) {
+        for (int y = range.start; y < range.end; y++) {
+            const int* row = labels.ptr<int>(y);
+            uchar* out = table.mask.ptr<uchar>(y);
+            for (int x = 0; x < labels.cols; x++) {
+                out[x] = keep[row[x]];
+            }
+        }
+    });
+    
+    return table;
+}
+
+RleIslandTable analyzeIslands(const RleImage& foreground, int min_area, int connectivity) {
+    RleIslandTable table;
+    
+    if (foreground.empty()) {
+        return table;
+    }
+    
+    table.run_labels = labelRuns(foreground, connectivity);
+    table.num_labels = table.run_labels.count;
+    const std::vector<int>& labels = table.run_labels.labels;
+    const std::vector<Run>& runs = foreground.runs();
+    
+    // Area, extent and coordinate sums per label, one run at a time
+    struct Stats {
+        int64_t area = 0;
+        int left = INT_MAX, top = INT_MAX, right = -1, bottom = -1;
+        double sum_x = 0.0, sum_y = 0.0;
+    };
+    std::vector<Stats> stats(table.num_labels);
+    table.touches_border.assign(table.num_labels, 0);
+    const int last_row = foreground.rows() - 1;
+    
+    for (int y = 0; y <= last_row; y++) {
+        for (size_t i = foreground.rowStart(y); i < foreground.rowStart(y + 1); i++) {
+            const Run& run = runs[i];
+            Stats& s = stats[labels[i]];
+            const int64_t length = run.length();
+            s.area += length;
+            s.left = std::min(s.left, run.x0);
+            s.right = std::max(s.right, run.x1 - 1);
+            s.top = std::min(s.top, y);
+            s.bottom = std::max(s.bottom, y);
+            s.sum_x += 0.5 * static_cast<double>(length) * (run.x0 + run.x1 - 1);
+            s.sum_y += static_cast<double>(length) * y;
+            
+            if (y == 0 || y == last_row || run.x0 == 0 || run.x1 == foreground.cols()) {
+                table.touches_border[labels[i]] = 1;
+            }
+        }
+    }
+    
+    // Classify from the component statistics
+    table.label_to_island.assign(table.num_labels, -1);
+    for (int label = 1; label < table.num_labels; label++) {
+        const Stats& s = stats[label];
+        if (table.touches_border[label] || s.area <= min_area) {
+            continue;
+        }
+        
+        Island island;
+        island.label = label;
+        island.area = static_cast<int>(std::min<int64_t>(s.area, INT_MAX));
+        island.bounding_box = cv::Rect(s.left, s.top, s.right - s.left + 1, s.bottom - s.top + 1);
+        island.centroid = cv::Point2d(s.sum_x / s.area, s.sum_y / s.area);
+        
+        table.label_to_island[label] = static_cast<int>(table.islands.size());
+        table.islands.push_back(island);
+    }
+    
+    // Split the runs into islands and the connected region
+    std::vector<uchar> is_island(runs.size());
+    std::vector<uchar> is_connected(runs.size());
+    for (size_t i = 0; i < runs.size(); i++) {
+        const int index = table.label_to_island[labels[i]];
+        is_island[i] = index >= 0;
+        is_connected[i] = table.touches_border[labels[i]];
+        if (index >= 0) {
+            table.mask_island.push_back(index);
+        }
+    }
+    table.mask = foreground.selectRuns(is_island);
+    table.connected = foreground.selectRuns(is_connected);
+    
+    return table;
+}
+
+} // namespace stencil
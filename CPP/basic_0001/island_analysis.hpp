@@ -0,0 +1,69 @@
+// island_analysis.hpp
+#ifndef ISLAND_ANALYSIS_HPP
+#define ISLAND_ANALYSIS_HPP
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "rle_image.hpp"
+
+namespace stencil {
+
+// ────────────────────────── ISLAND TABLE ──────────────────────────
+// An island is a foreground component that does not touch the image border
+// and is larger than the minimum area. The table keeps the label image so
+// later stages (bridging, visualisation, export) can look islands up without
+// re-labelling.
+struct Island {
+    int label = 0;
+    int area = 0;
+    cv::Rect bounding_box;
+    cv::Point2d centroid;
+};
+
+struct IslandTable {
+    cv::Mat labels;                   // CV_32S component labels, 0 = background
+    cv::Mat mask;                     // CV_8U, 255 on every island pixel
+    std::vector<int> label_to_island; // Island index per label, -1 if not an island
+    std::vector<uchar> touches_border; // Non-zero for labels reaching the image edge
+    std::vector<Island> islands;
+    int num_labels = 0;
+    
+    bool empty() const { return islands.empty(); }
+    int islandOfLabel(int label) const {
+        return (label >= 0 && label < num_labels) ? label_to_island[label] : -1;
+    }
+    
+    // Mask of a single island, cropped to its bounding box
+    cv::Mat islandMask(int index) const;
+};
+
+// Labels the non-zero pixels of a single-channel 8-bit image and classifies
+// each component. Border contact is collected from the four edges only and
+// the island mask is written in one pass over the label image.
+IslandTable analyzeIslands(const cv::Mat& foreground, int min_area = 50, int connectivity = 8);
+
+// ────────────────────────── RUN-LENGTH ISLAND TABLE ──────────────────────────
+// The same classification for a run-length encoded foreground. Labels live
+// on the runs instead of in a label image, and Island::label is the run
+// label. Statistics are summed per run, so the cost follows the run count.
+struct RleIslandTable {
+    RunLabels run_labels;             // Component label of every foreground run
+    RleImage mask;                    // Runs of every island
+    RleImage connected;               // Runs of the border-touching components
+    std::vector<int> mask_island;     // Island index of every mask run
+    std::vector<int> label_to_island; // Island index per label, -1 if not an island
+    std::vector<uchar> touches_border; // Non-zero for labels reaching the image edge
+    std::vector<Island> islands;
+    int num_labels = 0;
+    
+    bool empty() const { return islands.empty(); }
+    int islandOfLabel(int label) const {
+        return (label >= 0 && label < num_labels) ? label_to_island[label] : -1;
+    }
+};
+
+RleIslandTable analyzeIslands(const RleImage& foreground, int min_area = 50, int connectivity = 8);
+
+} // namespace stencil
+
+#endif // ISLAND_ANALYSIS_HPP
@@ -0,0 +1,131 @@
+// layer_quantizer.cpp
+#include "layer_quantizer.hpp"
+#include <algorithm>
+
+namespace stencil {
+
+namespace {
+// Rows per strip are sized like the fused tone kernel: the strip stays in
+// cache while its masks are written
+constexpr int kStripBytes = 32 * 1024;
+
+std::vector<uchar> evenTones(int layer_count) {
+    std::vector<uchar> tones(layer_count, 255);
+    for (int i = 0; i < layer_count && layer_count > 1; i++) {
+        tones[i] = cv::saturate_cast<uchar>(255.0 * i / (layer_count - 1));
+    }
+    return tones;
+}
+}
+
+LayerSpec uniformLayers(int layer_count) {
+    layer_count = std::max(1, std::min(256, layer_count));
+    
+    // Same cuts as the fixed thresholds this replaced: 64/128/192 for four
+    // layers, each bound belonging to the darker layer
+    LayerSpec spec;
+    for (int i = 1; i < layer_count; i++) {
+        spec.boundaries.push_back(i * 256 / layer_count);
+    }
+    spec.tones = evenTones(layer_count);
+    return spec;
+}
+
+LayerSpec equalizedLayers(const cv::Mat& gray, int layer_count) {
+    CV_Assert(gray.type() == CV_8UC1);
+    layer_count = std::max(1, std::min(256, layer_count));
+    
+    int channels[] = {0};
+    int hist_size[] = {256};
+    float range[] = {0.0f, 256.0f};
+    const float* ranges[] = {range};
+    cv::Mat hist;
+    cv::calcHist(&gray, 1, channels, cv::Mat(), hist, 1, hist_size, ranges);
+    
+    // Each boundary is the first gray value whose cumulative count reaches
+    // its share of the image
+    LayerSpec spec;
+    const double total = static_cast<double>(gray.total());
+    double cumulative = 0.0;
+    int value = 0;
+    for (int k = 1; k < layer_count; k++) {
+        const double target = total * k / layer_count;
+        while (value < 255 && cumulative + hist.at<float>(value) < target) {
+            cumulative += hist.at<float>(value);
+            value++;
+        }
+        spec.boundaries.push_back(value);
+    }
+    spec.tones = evenTones(layer_count);
+    return spec;
+}
+
+cv::Mat buildLayerLut(const LayerSpec& spec) {
+    CV_Assert(spec.layerCount() >= 1 &&
+              spec.boundaries.size() == static_cast<size_t>(spec.layerCount() - 1));
+    
+    cv::Mat lut(1, 256, CV_8UC1);
+    int layer = 0;
+    for (int v = 0; v < 256; v++) {
+        while (layer < spec.layerCount() - 1 && v > spec.boundaries[layer]) {
+            layer++;
+        }
+        lut.at<uchar>(0, v) = spec.tones[layer];
+    }
+    return lut;
+}
+
+void quantizeLayers(const cv::Mat& gray, cv::Mat& dst, const LayerSpec& spec,
+                    std::vector<cv::Mat>* masks) {
+    CV_Assert(gray.type() == CV_8UC1);
+    const cv::Mat lut = buildLayerLut(spec);
+    
+    if (!masks) {
+        cv::LUT(gray, lut, dst);
+        return;
+    }
+    
+    // Inclusive gray range of every layer
+    const int layers = spec.layerCount();
+    std::vector<int> lo(layers), hi(layers);
+    for (int k = 0; k < layers; k++) {
+        lo[k] = k == 0 ? 0 : spec.boundaries[k - 1] + 1;
+        hi[k] = k == layers - 1 ? 255 : spec.boundaries[k];
+    }
+    
+    dst.create(gray.size(), CV_8UC1);
+    masks->resize(layers);
+    for (cv::Mat& mask : *masks) {
+        mask.create(gray.size(), CV_8UC1);
+    }
+    if (gray.empty()) {
+        return;
+    }
+    
+    const int strip_rows = std::max(1, kStripBytes / std::max(1, gray.cols));
+    const int strips = (gray.rows + strip_rows - 1) / strip_rows;
+    
+    cv::parallel_for_(cv::Range(0, strips), [&](const cv::Range& range) {
+        for (int s = range.start; s < range.end; s++) {
+            const int y0 = s * strip_rows;
+            const int y1 = std::min(gray.rows, y0 + strip_rows);
+            cv::Mat out = dst.rowRange(y0, y1);
+            cv::LUT(gray.rowRange(y0, y1), lut, out);
+            
+            // Range compares vectorize; the strip is still cache resident
+            for (int y = y0; y < y1; y++) {
+                const uchar* src = gray.ptr<uchar>(y);
+                for (int k = 0; k < layers; k++) {
+                    uchar* mask = (*masks)[k].ptr<uchar>(y);
+                    const int low = lo[k];
+                    const int high = hi[k];
+                    for (int x = 0; x < gray.cols; x++) {
+                        mask[x] = (src[x] >= low && src[x] <= high) ? 255 : 0;
+                    }
+                }
+            }
+        }
+    });
+}
+
+} // namespace stencil
@@ -0,0 +1,39 @@
+// layer_quantizer.hpp
+#ifndef LAYER_QUANTIZER_HPP
+#define LAYER_QUANTIZER_HPP
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+namespace stencil {
+
+// ────────────────────────── LAYER QUANTIZER ──────────────────────────
+// Maps every gray value to one of N layers through a 256-entry table, so a
+// multi-layer stencil costs one sweep regardless of the layer count. Layer i
+// covers the gray values in (boundaries[i-1], boundaries[i]]; the last layer
+// runs up to 255. Every value belongs to exactly one layer.
+
+struct LayerSpec {
+    std::vector<int> boundaries;   // Ascending inclusive upper bounds, layers - 1 entries
+    std::vector<uchar> tones;      // Output gray per layer, layers entries
+
+    int layerCount() const { return static_cast<int>(tones.size()); }
+};
+
+// Equal-width bands; tones spread evenly from 0 (darkest layer) to 255
+LayerSpec uniformLayers(int layer_count);
+
+// Bands holding equal pixel counts (histogram-equalized); same tones as above
+LayerSpec equalizedLayers(const cv::Mat& gray, int layer_count);
+
+// Gray value -> tone (1x256 CV_8UC1)
+cv::Mat buildLayerLut(const LayerSpec& spec);
+
+// Quantizes CV_8UC1 input in one parallel pass. When masks is given it
+// receives one 0/255 mask per layer, written in the same pass.
+void quantizeLayers(const cv::Mat& gray, cv::Mat& dst, const LayerSpec& spec,
+                    std::vector<cv::Mat>* masks = nullptr);
+
+} // namespace stencil
+
+#endif // LAYER_QUANTIZER_HPP
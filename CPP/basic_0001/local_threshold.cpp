@@ -0,0 +1,101 @@
+// local_threshold.cpp
+#include "local_threshold.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace stencil {
+
+namespace {
+// Rows per band at least; a band also spans one block so that priming its
+// column sums (one block of rows) stays a fraction of the band's work
+constexpr int kMinBandRows = 64;
+
+inline void addRow(const uchar* row, int cols, int64_t* sum, int64_t* sq, int sign) {
+    for (int x = 0; x < cols; x++) {
+        const int v = row[x];
+        sum[x] += sign * v;
+        sq[x] += sign * v * v;
+    }
+}
+}
+
+void localThreshold(const cv::Mat& src, cv::Mat& dst, const LocalThresholdParams& params) {
+    CV_Assert(src.type() == CV_8UC1);
+    
+    // Rows below the current one are still read, so never work in place
+    const cv::Mat input = src.data == dst.data ? src.clone() : src;
+    dst.create(input.size(), CV_8UC1);
+    if (input.empty()) {
+        return;
+    }
+    
+    const int rows = input.rows;
+    const int cols = input.cols;
+    const int radius = std::max(1, params.block_size / 2);
+    const int band_rows = std::max(kMinBandRows, 2 * radius + 1);
+    const int bands = (rows + band_rows - 1) / band_rows;
+    const bool need_deviation = params.method != LocalMethod::MEAN;
+    const double inv_range = 1.0 / std::max(1e-6, params.range);
+    
+    cv::parallel_for_(cv::Range(0, bands), [&](const cv::Range& range) {
+        // Column sums of the block's rows, then their prefix sums along the row
+        std::vector<int64_t> col_sum(cols), col_sq(cols);
+        std::vector<int64_t> prefix(cols + 1), prefix_sq(cols + 1);
+        
+        for (int band = range.start; band < range.end; band++) {
+            const int y0 = band * band_rows;
+            const int y1 = std::min(rows, y0 + band_rows);
+            
+            std::fill(col_sum.begin(), col_sum.end(), 0);
+            std::fill(col_sq.begin(), col_sq.end(), 0);
+            for (int y = std::max(0, y0 - radius); y <= std::min(rows - 1, y0 + radius); y++) {
+                addRow(input.ptr<uchar>(y), cols, col_sum.data(), col_sq.data(), 1);
+            }
+            
+            for (int y = y0; y < y1; y++) {
+                if (y > y0) {
+                    if (y + radius < rows) {
+                        addRow(input.ptr<uchar>(y + radius), cols, col_sum.data(), col_sq.data(), 1);
+                    }
+                    if (y - radius - 1 >= 0) {
+                        addRow(input.ptr<uchar>(y - radius - 1), cols, col_sum.data(),
+                               col_sq.data(), -1);
+                    }
+                }
+                
+                for (int x = 0; x < cols; x++) {
+                    prefix[x + 1] = prefix[x] + col_sum[x];
+                }
+                if (need_deviation) {
+                    for (int x = 0; x < cols; x++) {
+                        prefix_sq[x + 1] = prefix_sq[x] + col_sq[x];
+                    }
+                }
+                
+                const int height = std::min(rows - 1, y + radius) - std::max(0, y - radius) + 1;
+                const uchar* in = input.ptr<uchar>(y);
+                uchar* out = dst.ptr<uchar>(y);
+                for (int x = 0; x < cols; x++) {
+                    const int left = std::max(0, x - radius);
+                    const int right = std::min(cols - 1, x + radius);
+                    const double inv_n = 1.0 / ((right - left + 1) * height);
+                    const double mean = (prefix[right + 1] - prefix[left]) * inv_n;
+                    
+                    double t = mean;
+                    if (need_deviation) {
+                        const double mean_sq = (prefix_sq[right + 1] - prefix_sq[left]) * inv_n;
+                        const double dev = std::sqrt(std::max(0.0, mean_sq - mean * mean));
+                        t = params.method == LocalMethod::NIBLACK
+                                ? mean + params.k * dev
+                                : mean * (1.0 + params.k * (dev * inv_range - 1.0));
+                    }
+                    out[x] = in[x] > t - params.offset ? 255 : 0;
+                }
+            }
+        }
+    });
+}
+
+} // namespace stencil
@@ -0,0 +1,39 @@
+// local_threshold.hpp
+#ifndef LOCAL_THRESHOLD_HPP
+#define LOCAL_THRESHOLD_HPP
+
+#include <opencv2/opencv.hpp>
+
+namespace stencil {
+
+// ────────────────────────── LOCAL THRESHOLD ──────────────────────────
+// Thresholds every pixel against the mean and deviation of the block around
+// it. The block statistics come from running sums: per-column sums of the
+// block's rows slide down one row at a time, and a prefix sum over them
+// turns any block sum into two lookups. A pixel therefore costs the same for
+// a 501 px block as for an 11 px one, where cv::adaptiveThreshold's blur
+// grows with the block. Blocks are clipped at the image border and average
+// only the pixels inside. Sums are exact integers, so the output does not
+// depend on how the rows are split between threads.
+
+enum class LocalMethod {
+    MEAN,       // T = m - offset (cv::ADAPTIVE_THRESH_MEAN_C)
+    NIBLACK,    // T = m + k * s - offset; k < 0 keeps dark strokes thin
+    SAUVOLA     // T = m * (1 + k * (s / range - 1)) - offset; robust on paper texture
+};
+
+struct LocalThresholdParams {
+    LocalMethod method = LocalMethod::SAUVOLA;
+    int block_size = 51;              // Block edge in pixels; made odd
+    double k = 0.2;                   // Weight of the deviation (NIBLACK, SAUVOLA)
+    double offset = 0.0;              // Subtracted from every threshold
+    double range = 128.0;             // Deviation range R (SAUVOLA)
+};
+
+// dst = 255 where src > T(x, y), else 0 (cv::THRESH_BINARY polarity). src must
+// be CV_8UC1; rows are processed in bands on OpenCV's thread pool.
+void localThreshold(const cv::Mat& src, cv::Mat& dst, const LocalThresholdParams& params);
+
+} // namespace stencil
+
+#endif // LOCAL_THRESHOLD_HPP
@@ -0,0 +1,42 @@
+// mapped_file.hpp
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace stencil {
+
+// ────────────────────────── MAPPED FILE ──────────────────────────
+// Read-only view of a whole file. On POSIX systems the file is mmap'ed, so
+// decoding reads straight from the page cache and nothing is copied into a
+// heap buffer first. Elsewhere the file is read into memory once.
+class MappedFile {
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string& filepath) { open(filepath); }
+    ~MappedFile() { close(); }
+    
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    
+    bool open(const std::string& filepath);
+    void close();
+    
+    const unsigned char* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool isOpen() const { return data_ != nullptr; }
+    
+private:
+    const unsigned char* data_ = nullptr;
+    size_t size_ = 0;
+    bool mapped_ = false;
+    std::vector<unsigned char> fallback_;
+};
+
+} // namespace stencil
+
+#endif // MAPPED_FILE_HPP
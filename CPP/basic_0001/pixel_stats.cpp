@@ -0,0 +1,120 @@
+// pixel_stats.cpp
+#include "pixel_stats.hpp"
+#include <algorithm>
+#include <mutex>
+
+namespace stencil {
+
+namespace {
+constexpr int kBlackMax = 127;
+
+// Rows per band; bands merge their column counts once each
+constexpr int kBandRows = 64;
+
+void scanArea(const cv::Mat& image, const cv::Rect& area, PixelStats& stats, int sign) {
+    const cv::Rect clipped = area & cv::Rect(0, 0, image.cols, image.rows);
+    for (int y = clipped.y; y < clipped.y + clipped.height; y++) {
+        const uchar* row = image.ptr<uchar>(y);
+        for (int x = clipped.x; x < clipped.x + clipped.width; x++) {
+            const int v = row[x];
+            stats.histogram[v] += sign;
+            if (v <= kBlackMax) {
+                stats.row_black[y] += sign;
+                stats.col_black[x] += sign;
+            }
+        }
+    }
+}
+}
+
+int64_t PixelStats::black() const {
+    int64_t count = 0;
+    for (int v = 0; v <= kBlackMax; v++) {
+        count += histogram[v];
+    }
+    return count;
+}
+
+int64_t PixelStats::white() const {
+    int64_t count = 0;
+    for (int v = kBlackMax + 1; v < 256; v++) {
+        count += histogram[v];
+    }
+    return count;
+}
+
+cv::Rect PixelStats::blackBounds() const {
+    auto nonzero = [](int count) { return count != 0; };
+    auto top = std::find_if(row_black.begin(), row_black.end(), nonzero);
+    if (top == row_black.end()) {
+        return cv::Rect();
+    }
+    auto bottom = std::find_if(row_black.rbegin(), row_black.rend(), nonzero);
+    auto left = std::find_if(col_black.begin(), col_black.end(), nonzero);
+    auto right = std::find_if(col_black.rbegin(), col_black.rend(), nonzero);
+    
+    const int y0 = static_cast<int>(top - row_black.begin());
+    const int y1 = static_cast<int>(row_black.rend() - bottom);
+    const int x0 = static_cast<int>(left - col_black.begin());
+    const int x1 = static_cast<int>(col_black.rend() - right);
+    return cv::Rect(x0, y0, x1 - x0, y1 - y0);
+}
+
+void PixelStats::add(const cv::Mat& image, const cv::Rect& area) {
+    scanArea(image, area, *this, 1);
+}
+
+void PixelStats::remove(const cv::Mat& image, const cv::Rect& area) {
+    scanArea(image, area, *this, -1);
+}
+
+void writeWithStats(const cv::Mat& src, cv::Mat& dst, bool invert, PixelStats& stats) {
+    CV_Assert(src.type() == CV_8UC1);
+    
+    const bool in_place = src.data == dst.data;
+    if (!in_place) {
+        dst.create(src.size(), CV_8UC1);
+    }
+    const bool write = invert || !in_place;
+    
+    const int rows = src.rows;
+    const int cols = src.cols;
+    stats.histogram.fill(0);
+    stats.row_black.assign(rows, 0);
+    stats.col_black.assign(cols, 0);
+    
+    std::mutex merge_mutex;
+    const int bands = (rows + kBandRows - 1) / kBandRows;
+    cv::parallel_for_(cv::Range(0, bands), [&](const cv::Range& range) {
+        std::array<int64_t, 256> histogram{};
+        std::vector<int> col_black(cols, 0);
+        
+        for (int y = range.start * kBandRows; y < std::min(rows, range.end * kBandRows); y++) {
+            const uchar* in = src.ptr<uchar>(y);
+            uchar* out = write ? dst.ptr<uchar>(y) : nullptr;
+            int row_black = 0;
+            for (int x = 0; x < cols; x++) {
+                const uchar v = invert ? static_cast<uchar>(255 - in[x]) : in[x];
+                if (out) {
+                    out[x] = v;
+                }
+                histogram[v]++;
+                const int is_black = v <= kBlackMax;
+                row_black += is_black;
+                col_black[x] += is_black;
+            }
+            // Rows belong to one band, so no lock is needed here
+            stats.row_black[y] = row_black;
+        }
+        
+        std::lock_guard<std::mutex> lock(merge_mutex);
+        for (int v = 0; v < 256; v++) {
+            stats.histogram[v] += histogram[v];
+        }
+        for (int x = 0; x < cols; x++) {
+            stats.col_black[x] += col_black[x];
+        }
+    });
+}
+
+} // namespace stencil
@@ -0,0 +1,41 @@
+// pixel_stats.hpp
+#ifndef PIXEL_STATS_HPP
+#define PIXEL_STATS_HPP
+
+#include <opencv2/opencv.hpp>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace stencil {
+
+// ────────────────────────── PIXEL STATISTICS ──────────────────────────
+// Statistics of a finished stencil, gathered by the pass that writes it
+// instead of by extra passes afterwards. Pixels up to 127 count as black (the
+// cut-outs), the rest as white. Black pixels are also counted per row and per
+// column, which is all the bounding box needs and lets a later write to a
+// small area update the statistics by rescanning just that area.
+struct PixelStats {
+    std::array<int64_t, 256> histogram{};
+    std::vector<int> row_black;       // Black pixels in each row
+    std::vector<int> col_black;       // Black pixels in each column
+    int islands = 0;                  // Floating islands, set by the bridging stage
+    
+    int64_t black() const;
+    int64_t white() const;
+    cv::Rect blackBounds() const;     // Empty when there are no black pixels
+    
+    // Add or take away the pixels of one area of image, on the calling thread
+    void add(const cv::Mat& image, const cv::Rect& area);
+    void remove(const cv::Mat& image, const cv::Rect& area);
+};
+
+// dst = src, or 255 - src when invert is set, written in row bands on OpenCV's
+// thread pool with the statistics of dst gathered in the same pass. dst may be
+// src; without inversion that pass then only reads. The pixel statistics are
+// replaced, islands is left as it is. src must be CV_8UC1.
+void writeWithStats(const cv::Mat& src, cv::Mat& dst, bool invert, PixelStats& stats);
+
+} // namespace stencil
+
+#endif // PIXEL_STATS_HPP
@@ -0,0 +1,472 @@
+// result_cache.cpp
+#include "result_cache.hpp"
+#include "mapped_file.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace stencil {
+
+namespace {
+// xxHash64 constants and rounds
+constexpr uint64_t kPrime1 = 11400714785074694791ULL;
+constexpr uint64_t kPrime2 = 14029467366897019727ULL;
+constexpr uint64_t kPrime3 = 1609587929392839161ULL;
+constexpr uint64_t kPrime4 = 9650029242287828579ULL;
+constexpr uint64_t kPrime5 = 2870177450012600261ULL;
+
+// Bytes per independently hashed band of rows
+constexpr size_t kHashBandBytes = size_t(1) << 20;
+
+constexpr char kMagic[8] = {'S', 'T', 'N', 'C', 'A', 'C', 'H', 'E'};
+constexpr uint32_t kVersion = 1;
+constexpr size_t kDataAlignment = 64;
+constexpr const char* kExtension = ".stc";
+
+inline uint64_t rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t read64(const uchar* p) {
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+    return v;
+}
+
+inline uint32_t read32(const uchar* p) {
+    uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
+}
+
+inline uint64_t hashRound(uint64_t acc, uint64_t input) {
+    acc += input * kPrime2;
+    acc = rotl(acc, 31);
+    return acc * kPrime1;
+}
+
+inline uint64_t mergeRound(uint64_t acc, uint64_t value) {
+    acc ^= hashRound(0, value);
+    return acc * kPrime1 + kPrime4;
+}
+
+int64_t now() {
+    return fs::file_time_type::clock::now().time_since_epoch().count();
+}
+
+// ────────────────────────── ENTRY FILE FORMAT ──────────────────────────
+// magic[8] version:u32 images:u32 values:u32 reserved:u32
+// values: name_len:u32 name double
+// images: name_len:u32 name rows:i32 cols:i32 type:i32, zero padding to the
+//         next 64-byte offset, then rows * cols * elemSize bytes
+class EntryReader {
+public:
+    EntryReader(const uchar* data, size_t size) : data_(data), size_(size) {}
+    
+    bool readU32(uint32_t& v) { return readRaw(&v, 4); }
+    bool readI32(int32_t& v) { return readRaw(&v, 4); }
+    bool readDouble(double& v) { return readRaw(&v, 8); }
+    bool readName(std::string& name) {
+        uint32_t length;
+        if (!readU32(length) || length > size_ - pos_) {
+            return false;
+        }
+        name.assign(reinterpret_cast<const char*>(data_ + pos_), length);
+        pos_ += length;
+        return true;
+    }
+    const uchar* take(size_t bytes) {
+        if (bytes > size_ - pos_) {
+            return nullptr;
+        }
+        const uchar* p = data_ + pos_;
+        pos_ += bytes;
+        return p;
+    }
+    void align() { pos_ = std::min(size_, (pos_ + kDataAlignment - 1) / kDataAlignment * kDataAlignment); }
+
+private:
+    bool readRaw(void* out, size_t bytes) {
+        const uchar* p = take(bytes);
+        if (!p) {
+            return false;
+        }
+        std::memcpy(out, p, bytes);
+        return true;
+    }
+    
+    const uchar* data_;
+    size_t size_;
+    size_t pos_ = 0;
+};
+
+class EntryWriter {
+public:
+    explicit EntryWriter(std::ostream& out) : out_(out) {}
+    
+    void raw(const void* data, size_t bytes) {
+        out_.write(static_cast<const char*>(data), static_cast<std::streamsize>(bytes));
+        pos_ += bytes;
+    }
+    void u32(uint32_t v) { raw(&v, 4); }
+    void i32(int32_t v) { raw(&v, 4); }
+    void name(const std::string& s) {
+        u32(static_cast<uint32_t>(s.size()));
+        raw(s.data(), s.size());
+    }
+    void align() {
+        static const char zeros[kDataAlignment] = {};
+        const size_t pad = (kDataAlignment - pos_ % kDataAlignment) % kDataAlignment;
+        raw(zeros, pad);
+    }
+
+private:
+    std::ostream& out_;
+    size_t pos_ = 0;
+};
+}
+
+// ────────────────────────── HASHING ──────────────────────────
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed) {
+    const uchar* p = static_cast<const uchar*>(data);
+    const uchar* const end = p + size;
+    uint64_t h;
+    
+    if (size >= 32) {
+        uint64_t v1 = seed + kPrime1 + kPrime2;
+        uint64_t v2 = seed + kPrime2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - kPrime1;
+        const uchar* const limit = end - 32;
+        do {
+            v1 = hashRound(v1, read64(p));
+            v2 = hashRound(v2, read64(p + 8));
+            v3 = hashRound(v3, read64(p + 16));
+            v4 = hashRound(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = mergeRound(h, v1);
+        h = mergeRound(h, v2);
+        h = mergeRound(h, v3);
+        h = mergeRound(h, v4);
+    } else {
+        h = seed + kPrime5;
+    }
+    h += static_cast<uint64_t>(size);
+    
+    for (; p + 8 <= end; p += 8) {
+        h ^= hashRound(0, read64(p));
+        h = rotl(h, 27) * kPrime1 + kPrime4;
+    }
+    if (p + 4 <= end) {
+        h ^= static_cast<uint64_t>(read32(p)) * kPrime1;
+        h = rotl(h, 23) * kPrime2 + kPrime3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        h ^= static_cast<uint64_t>(*p) * kPrime5;
+        h = rotl(h, 11) * kPrime1;
+    }
+    
+    h ^= h >> 33;
+    h *= kPrime2;
+    h ^= h >> 29;
+    h *= kPrime3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t hashImage(const cv::Mat& image) {
+    const int32_t header[3] = {image.rows, image.cols, image.type()};
+    const uint64_t seed = hashBytes(header, sizeof(header));
+    if (image.empty()) {
+        return seed;
+    }
+    
+    const size_t row_bytes = image.cols * image.elemSize();
+    const int band_rows = static_cast<int>(std::max<size_t>(1, kHashBandBytes / row_bytes));
+    const int bands = (image.rows + band_rows - 1) / band_rows;
+    
+    // Band hashes are combined in order, so the split is fixed by the image
+    // size alone and the thread count never changes the result
+    std::vector<uint64_t> band_hashes(bands);
+    cv::parallel_for_(cv::Range(0, bands), [&](const cv::Range& range) {
+        for (int b = range.start; b < range.end; b++) {
+            const int y0 = b * band_rows;
+            const int y1 = std::min(image.rows, y0 + band_rows);
+            uint64_t h = seed;
+            if (image.isContinuous()) {
+                h = hashBytes(image.ptr(y0), row_bytes * (y1 - y0), h);
+            } else {
+                for (int y = y0; y < y1; y++) {
+                    h = hashBytes(image.ptr(y), row_bytes, h);
+                }
+            }
+            band_hashes[b] = h;
+        }
+    });
+    return hashBytes(band_hashes.data(), band_hashes.size() * sizeof(uint64_t), seed);
+}
+
+// ────────────────────────── CACHE ENTRY ──────────────────────────
+cv::Mat CacheEntry::image(const std::string& name) const {
+    for (const auto& item : images) {
+        if (item.first == name) {
+            return item.second;
+        }
+    }
+    return cv::Mat();
+}
+
+double CacheEntry::value(const std::string& name, double fallback) const {
+    for (const auto& item : values) {
+        if (item.first == name) {
+            return item.second;
+        }
+    }
+    return fallback;
+}
+
+// ────────────────────────── RESULT CACHE ──────────────────────────
+ResultCache::ResultCache(const std::string& directory, size_t max_bytes)
+    : directory_(directory), max_bytes_(max_bytes) {
+    std::error_code ec;
+    fs::create_directories(directory_, ec);
+    scanDirectory();
+}
+
+std::string ResultCache::makeKey(uint64_t image_hash, const std::string& canonical_params) {
+    const uint64_t params_hash = hashBytes(canonical_params.data(), canonical_params.size(), image_hash);
+    char key[33];
+    std::snprintf(key, sizeof(key), "%016llx%016llx",
+                  static_cast<unsigned long long>(image_hash),
+                  static_cast<unsigned long long>(params_hash));
+    return key;
+}
+
+std::string ResultCache::makeKey(const cv::Mat& image, const std::string& canonical_params) {
+    return makeKey(hashImage(image), canonical_params);
+}
+
+std::string ResultCache::pathFor(const std::string& key) const {
+    return (fs::path(directory_) / (key + kExtension)).string();
+}
+
+void ResultCache::scanDirectory() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    index_.clear();
+    stats_.entries = 0;
+    stats_.bytes = 0;
+    
+    std::error_code ec;
+    for (fs::directory_iterator it(directory_, ec), end; !ec && it != end; it.increment(ec)) {
+        if (!it->is_regular_file(ec) || it->path().extension() != kExtension) {
+            continue;
+        }
+        IndexEntry entry;
+        entry.bytes = static_cast<size_t>(it->file_size(ec));
+        entry.last_use = it->last_write_time(ec).time_since_epoch().count();
+        index_[it->path().stem().string()] = entry;
+        stats_.bytes += entry.bytes;
+    }
+    stats_.entries = index_.size();
+    evictLocked(std::string());
+}
+
+bool ResultCache::load(const std::string& key, CacheEntry& entry) {
+    auto mapping = std::make_shared<MappedFile>();
+    if (!mapping->open(pathFor(key))) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.misses++;
+        forgetLocked(key);  // Removed behind our back (another process evicted it)
+        return false;
+    }
+    
+    EntryReader reader(mapping->data(), mapping->size());
+    const uchar* magic = reader.take(sizeof(kMagic));
+    uint32_t version = 0, image_count = 0, value_count = 0, reserved = 0;
+    bool ok = magic && std::memcmp(magic, kMagic, sizeof(kMagic)) == 0 &&
+              reader.readU32(version) && version == kVersion &&
+              reader.readU32(image_count) && reader.readU32(value_count) && reader.readU32(reserved);
+    
+    CacheEntry loaded;
+    for (uint32_t i = 0; ok && i < value_count; i++) {
+        std::string name;
+        double value = 0.0;
+        ok = reader.readName(name) && reader.readDouble(value);
+        if (ok) {
+            loaded.addValue(name, value);
+        }
+    }
+    for (uint32_t i = 0; ok && i < image_count; i++) {
+        std::string name;
+        int32_t rows = 0, cols = 0, type = 0;
+        ok = reader.readName(name) && reader.readI32(rows) && reader.readI32(cols) && reader.readI32(type) &&
+             rows >= 0 && cols >= 0 && type >= 0 && type < CV_MAKETYPE(CV_DEPTH_MAX, CV_CN_MAX);
+        if (!ok) {
+            break;
+        }
+        reader.align();
+        const size_t bytes = size_t(rows) * size_t(cols) * CV_ELEM_SIZE(type);
+        const uchar* pixels = reader.take(bytes);
+        ok = pixels != nullptr;
+        if (ok) {
+            // Read-only view into the mapping (PROT_READ): clone before writing
+            loaded.addImage(name, cv::Mat(rows, cols, type, const_cast<uchar*>(pixels)));
+        }
+    }
+    
+    const size_t bytes = mapping->size();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!ok) {
+        // Truncated or from another format version: drop it
+        stats_.misses++;
+        mapping.reset();
+        std::error_code ec;
+        fs::remove(pathFor(key), ec);
+        forgetLocked(key);
+        return false;
+    }
+    stats_.hits++;
+    loaded.mapping = std::move(mapping);
+    entry = std::move(loaded);
+    touchLocked(key, bytes);
+    return true;
+}
+
+void ResultCache::touchLocked(const std::string& key, size_t bytes) {
+    const int64_t t = now();
+    IndexEntry& indexed = index_[key];
+    stats_.bytes = stats_.bytes - indexed.bytes + bytes;
+    indexed.bytes = bytes;
+    indexed.last_use = t;
+    stats_.entries = index_.size();
+    // Persist recency for the next process that scans the directory
+    std::error_code ec;
+    fs::last_write_time(pathFor(key), fs::file_time_type(fs::file_time_type::duration(t)), ec);
+}
+
+bool ResultCache::store(const std::string& key, const CacheEntry& entry) {
+    const std::string path = pathFor(key);
+    static std::atomic<unsigned> sequence{0};
+    const std::string temp = path + ".tmp" +
+                             std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) +
+                             "_" + std::to_string(sequence++);
+    
+    // Write under a temporary name and rename: readers never see half a file
+    size_t bytes = 0;
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            return false;
+        }
+        EntryWriter writer(out);
+        writer.raw(kMagic, sizeof(kMagic));
+        writer.u32(kVersion);
+        writer.u32(static_cast<uint32_t>(entry.images.size()));
+        writer.u32(static_cast<uint32_t>(entry.values.size()));
+        writer.u32(0);
+        for (const auto& item : entry.values) {
+            writer.name(item.first);
+            writer.raw(&item.second, sizeof(double));
+        }
+        for (const auto& item : entry.images) {
+            const cv::Mat& image = item.second;
+            writer.name(item.first);
+            writer.i32(image.rows);
+            writer.i32(image.cols);
+            writer.i32(image.type());
+            writer.align();
+            const size_t row_bytes = image.cols * image.elemSize();
+            if (image.isContinuous()) {
+                writer.raw(image.data, row_bytes * image.rows);
+            } else {
+                for (int y = 0; y < image.rows; y++) {
+                    writer.raw(image.ptr(y), row_bytes);
+                }
+            }
+        }
+        out.flush();
+        if (!out.good()) {
+            out.close();
+            std::error_code ec;
+            fs::remove(temp, ec);
+            return false;
+        }
+        bytes = static_cast<size_t>(out.tellp());
+    }
+    
+    std::error_code ec;
+    fs::rename(temp, path, ec);
+    if (ec) {
+        fs::remove(temp, ec);
+        return false;
+    }
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    touchLocked(key, bytes);
+    stats_.stores++;
+    evictLocked(key);
+    return true;
+}
+
+void ResultCache::forgetLocked(const std::string& key) {
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        stats_.bytes -= it->second.bytes;
+        index_.erase(it);
+        stats_.entries = index_.size();
+    }
+}
+
+void ResultCache::evictLocked(const std::string& keep) {
+    while (stats_.bytes > max_bytes_ && !index_.empty()) {
+        // Oldest first; the entry just stored goes last
+        auto oldest = index_.end();
+        for (auto it = index_.begin(); it != index_.end(); ++it) {
+            if (it->first == keep && index_.size() > 1) {
+                continue;
+            }
+            if (oldest == index_.end() || it->second.last_use < oldest->second.last_use) {
+                oldest = it;
+            }
+        }
+        std::error_code ec;
+        fs::remove(pathFor(oldest->first), ec);
+        stats_.bytes -= oldest->second.bytes;
+        stats_.evictions++;
+        index_.erase(oldest);
+    }
+    stats_.entries = index_.size();
+}
+
+void ResultCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& item : index_) {
+        std::error_code ec;
+        fs::remove(pathFor(item.first), ec);
+    }
+    index_.clear();
+    stats_.entries = 0;
+    stats_.bytes = 0;
+}
+
+CacheStats ResultCache::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void ResultCache::setMaxBytes(size_t max_bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    max_bytes_ = max_bytes;
+    evictLocked(std::string());
+}
+
+} // namespace stencil
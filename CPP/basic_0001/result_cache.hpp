@@ -0,0 +1,101 @@
+// result_cache.hpp
+#ifndef RESULT_CACHE_HPP
+#define RESULT_CACHE_HPP
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace stencil {
+
+class MappedFile;
+
+// ────────────────────────── RESULT CACHE ──────────────────────────
+// On-disk cache of finished stencils and intermediate stages, addressed by
+// the content of the input pixels plus a canonical serialization of the
+// parameters that produced them. Resubmitting the same artwork with the same
+// preset is a file map instead of a pipeline run.
+//
+// Each entry is one file: a small header, named scalar values and named
+// images stored raw and 64-byte aligned. Loads map the file and hand out
+// cv::Mat headers over the mapping, so a hit costs page faults rather than a
+// decode. The directory is kept under a byte budget by evicting the least
+// recently used entries; file modification times carry the recency across
+// runs. Safe to share between threads.
+
+struct CacheEntry {
+    std::vector<std::pair<std::string, cv::Mat>> images;
+    std::vector<std::pair<std::string, double>> values;
+
+    // Set by ResultCache::load: the images view this mapping and stay valid
+    // as long as the entry (or a copy of it) lives. Clone what must outlive it.
+    std::shared_ptr<const MappedFile> mapping;
+
+    cv::Mat image(const std::string& name) const;         // Empty if absent
+    double value(const std::string& name, double fallback = 0.0) const;
+    void addImage(const std::string& name, const cv::Mat& image) { images.emplace_back(name, image); }
+    void addValue(const std::string& name, double value) { values.emplace_back(name, value); }
+};
+
+struct CacheStats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t stores = 0;
+    size_t evictions = 0;
+    size_t entries = 0;
+    size_t bytes = 0;
+
+    double hitRate() const { return hits + misses ? double(hits) / double(hits + misses) : 0.0; }
+};
+
+// 64-bit content hash of the pixels, dimensions and type. Large images are
+// hashed in fixed bands in parallel; the result does not depend on threads.
+uint64_t hashImage(const cv::Mat& image);
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0);
+
+class ResultCache {
+public:
+    explicit ResultCache(const std::string& directory, size_t max_bytes = size_t(512) << 20);
+
+    // Hex key from the image hash and the canonical parameter string. The
+    // parameter string should name the producer (e.g. "cpp/simple/...") so
+    // different pipelines never share entries.
+    static std::string makeKey(uint64_t image_hash, const std::string& canonical_params);
+    static std::string makeKey(const cv::Mat& image, const std::string& canonical_params);
+
+    bool load(const std::string& key, CacheEntry& entry);
+    bool store(const std::string& key, const CacheEntry& entry);
+    void clear();
+
+    CacheStats stats() const;
+    const std::string& directory() const { return directory_; }
+    size_t maxBytes() const { return max_bytes_; }
+    void setMaxBytes(size_t max_bytes);
+
+private:
+    struct IndexEntry {
+        size_t bytes = 0;
+        int64_t last_use = 0;
+    };
+
+    std::string pathFor(const std::string& key) const;
+    void scanDirectory();
+    void touchLocked(const std::string& key, size_t bytes);
+    void forgetLocked(const std::string& key);
+    void evictLocked(const std::string& keep);
+
+    std::string directory_;
+    size_t max_bytes_;
+    mutable std::mutex mutex_;
+    std::map<std::string, IndexEntry> index_;
+    CacheStats stats_;
+};
+
+} // namespace stencil
+
+#endif // RESULT_CACHE_HPP
@@ -0,0 +1,534 @@
+// rle_image.cpp
+#include "rle_image.hpp"
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+namespace stencil {
+
+namespace {
+// Union-find over indices; the root of a set is its smallest member, so
+// roots come first in raster order
+struct DisjointSets {
+    std::vector<int> parent;
+    
+    explicit DisjointSets(size_t count) : parent(count) {
+        std::iota(parent.begin(), parent.end(), 0);
+    }
+    
+    int find(int i) {
+        while (parent[i] != i) {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
+        }
+        return i;
+    }
+    
+    void unite(int a, int b) {
+        a = find(a);
+        b = find(b);
+        if (a < b) {
+            parent[b] = a;
+        } else if (b < a) {
+            parent[a] = b;
+        }
+    }
+};
+
+// Appends run to the row that starts at row_begin, merging touching runs
+inline void appendMerged(std::vector<Run>& out, size_t row_begin, const Run& run) {
+    if (out.size() > row_begin && run.x0 <= out.back().x1) {
+        out.back().x1 = std::max(out.back().x1, run.x1);
+    } else {
+        out.push_back(run);
+    }
+}
+
+enum Direction { NORTH, EAST, SOUTH, WEST };
+
+// Foreground state of the four pixels around a pixel corner
+struct Corner {
+    bool nw, ne, sw, se;
+};
+
+// Outline edges keep the foreground on their right; true if one leaves the
+// corner in direction dir
+inline bool hasEdge(const Corner& c, int dir) {
+    switch (dir) {
+        case NORTH: return c.ne && !c.nw;
+        case EAST: return c.se && !c.ne;
+        case SOUTH: return c.sw && !c.se;
+        default: return c.nw && !c.sw;
+    }
+}
+
+// Background between the runs of row y: gap j precedes run j, the last gap
+// follows the last run. Gap ids are rowStart(y) + y + j, so the gap before
+// run r of row y has id r + y.
+struct Gap {
+    int x0, x1, id;
+};
+
+void rowGaps(const RleImage& image, int y, std::vector<Gap>& gaps) {
+    gaps.clear();
+    const Run* begin = image.rowBegin(y);
+    const Run* end = image.rowEnd(y);
+    const int base = static_cast<int>(image.rowStart(y)) + y;
+    int x = 0;
+    for (const Run* run = begin; run != end; ++run) {
+        if (run->x0 > x) {
+            gaps.push_back({x, run->x0, base + static_cast<int>(run - begin)});
+        }
+        x = run->x1;
+    }
+    if (x < image.cols()) {
+        gaps.push_back({x, image.cols(), base + static_cast<int>(end - begin)});
+    }
+}
+}
+
+// ────────────────────────── RLE IMAGE ──────────────────────────
+RleImage::RleImage(const cv::Size& size)
+    : rows_(size.height), cols_(size.width), row_start_(size.height + 1, 0) {
+}
+
+RleImage RleImage::encode(const cv::Mat& image, int threshold, bool invert) {
+    CV_Assert(image.type() == CV_8UC1);
+    RleImage rle(image.size());
+    
+    bool is_foreground[256];
+    for (int v = 0; v < 256; v++) {
+        is_foreground[v] = (v > threshold) != invert;
+    }
+    
+    // Count the runs of every row in parallel, then fill each row at its offset
+    std::vector<size_t>& start = rle.row_start_;
+    cv::parallel_for_(cv::Range(0, image.rows), [&](const cv::Range& range) {
+        for (int y = range.start; y < range.end; y++) {
+            const uchar* row = image.ptr<uchar>(y);
+            size_t count = 0;
+            bool previous = false;
+            for (int x = 0; x < image.cols; x++) {
+                const bool current = is_foreground[row[x]];
+                count += current && !previous;
+                previous = current;
+            }
+            start[y + 1] = count;
+        }
+    });
+    
+    for (int y = 0; y < image.rows; y++) {
+        start[y + 1] += start[y];
+    }
+    rle.runs_.resize(start[image.rows]);
+    
+    cv::parallel_for_(cv::Range(0, image.rows), [&](const cv::Range& range) {
+        for (int y = range.start; y < range.end; y++) {
+            const uchar* row = image.ptr<uchar>(y);
+            Run* out = rle.runs_.data() + start[y];
+            int x = 0;
+            while (x < image.cols) {
+                while (x < image.cols && !is_foreground[row[x]]) {
+                    x++;
+                }
+                if (x == image.cols) {
+                    break;
+                }
+                out->x0 = x;
+                while (x < image.cols && is_foreground[row[x]]) {
+                    x++;
+                }
+                out->x1 = x;
+                ++out;
+            }
+        }
+    });
+    
+    return rle;
+}
+
+RleImage RleImage::fromRows(const cv::Size& size, std::vector<std::vector<Run>>& rows) {
+    CV_Assert(static_cast<int>(rows.size()) == size.height);
+    RleImage rle(size);
+    
+    for (int y = 0; y < size.height; y++) {
+        std::vector<Run>& row = rows[y];
+        std::sort(row.begin(), row.end(), [](const Run& a, const Run& b) { return a.x0 < b.x0; });
+        
+        const size_t row_begin = rle.runs_.size();
+        for (Run run : row) {
+            run.x0 = std::max(run.x0, 0);
+            run.x1 = std::min(run.x1, size.width);
+            if (run.x1 > run.x0) {
+                appendMerged(rle.runs_, row_begin, run);
+            }
+        }
+        rle.row_start_[y + 1] = rle.runs_.size();
+    }
+    
+    return rle;
+}
+
+void RleImage::decode(cv::Mat& dst, uchar foreground, uchar background) const {
+    dst.create(size(), CV_8UC1);
+    
+    cv::parallel_for_(cv::Range(0, rows_), [&](const cv::Range& range) {
+        for (int y = range.start; y < range.end; y++) {
+            uchar* row = dst.ptr<uchar>(y);
+            std::memset(row, background, cols_);
+            for (const Run* run = rowBegin(y); run != rowEnd(y); ++run) {
+                std::memset(row + run->x0, foreground, run->length());
+            }
+        }
+    });
+}
+
+cv::Mat RleImage::decode(uchar foreground, uchar background) const {
+    cv::Mat dst;
+    decode(dst, foreground, background);
+    return dst;
+}
+
+const Run* RleImage::findRun(int x, int y) const {
+    if (x < 0 || y < 0 || x >= cols_ || y >= rows_) {
+        return nullptr;
+    }
+    
+    // The last run starting at or before x is the only candidate
+    const Run* begin = rowBegin(y);
+    const Run* it = std::upper_bound(begin, rowEnd(y), x,
+                                     [](int value, const Run& run) { return value < run.x0; });
+    if (it == begin) {
+        return nullptr;
+    }
+    --it;
+    return x < it->x1 ? it : nullptr;
+}
+
+bool RleImage::at(int x, int y) const {
+    return findRun(x, y) != nullptr;
+}
+
+int64_t RleImage::area() const {
+    int64_t total = 0;
+    for (const Run& run : runs_) {
+        total += run.length();
+    }
+    return total;
+}
+
+size_t RleImage::bytes() const {
+    return runs_.capacity() * sizeof(Run) + row_start_.capacity() * sizeof(size_t);
+}
+
+RleImage RleImage::unite(const RleImage& other) const {
+    CV_Assert(size() == other.size());
+    RleImage result(size());
+    result.runs_.reserve(runs_.size() + other.runs_.size());
+    
+    for (int y = 0; y < rows_; y++) {
+        const size_t row_begin = result.runs_.size();
+        const Run* a = rowBegin(y);
+        const Run* b = other.rowBegin(y);
+        while (a != rowEnd(y) || b != other.rowEnd(y)) {
+            if (b == other.rowEnd(y) || (a != rowEnd(y) && a->x0 <= b->x0)) {
+                appendMerged(result.runs_, row_begin, *a++);
+            } else {
+                appendMerged(result.runs_, row_begin, *b++);
+            }
+        }
+        result.row_start_[y + 1] = result.runs_.size();
+    }
+    
+    return result;
+}
+
+RleImage RleImage::subtract(const RleImage& other) const {
+    CV_Assert(size() == other.size());
+    RleImage result(size());
+    result.runs_.reserve(runs_.size());
+    
+    for (int y = 0; y < rows_; y++) {
+        const Run* b = other.rowBegin(y);
+        const Run* b_end = other.rowEnd(y);
+        for (const Run* a = rowBegin(y); a != rowEnd(y); ++a) {
+            while (b != b_end && b->x1 <= a->x0) {
+                ++b;
+            }
+            
+            // Cut every overlapping run of other out of a
+            int x = a->x0;
+            for (const Run* cut = b; cut != b_end && cut->x0 < a->x1; ++cut) {
+                if (cut->x0 > x) {
+                    result.runs_.push_back({x, cut->x0});
+                }
+                x = std::max(x, cut->x1);
+            }
+            if (x < a->x1) {
+                result.runs_.push_back({x, a->x1});
+            }
+        }
+        result.row_start_[y + 1] = result.runs_.size();
+    }
+    
+    return result;
+}
+
+RleImage RleImage::complement() const {
+    RleImage result(size());
+    result.runs_.reserve(runs_.size() + rows_);
+    
+    for (int y = 0; y < rows_; y++) {
+        int x = 0;
+        for (const Run* run = rowBegin(y); run != rowEnd(y); ++run) {
+            if (run->x0 > x) {
+                result.runs_.push_back({x, run->x0});
+            }
+            x = run->x1;
+        }
+        if (x < cols_) {
+            result.runs_.push_back({x, cols_});
+        }
+        result.row_start_[y + 1] = result.runs_.size();
+    }
+    
+    return result;
+}
+
+RleImage RleImage::selectRuns(const std::vector<uchar>& keep) const {
+    CV_Assert(keep.size() == runs_.size());
+    RleImage result(size());
+    
+    for (int y = 0; y < rows_; y++) {
+        for (size_t i = row_start_[y]; i < row_start_[y + 1]; i++) {
+            if (keep[i]) {
+                result.runs_.push_back(runs_[i]);
+            }
+        }
+        result.row_start_[y + 1] = result.runs_.size();
+    }
+    
+    return result;
+}
+
+// ────────────────────────── RUN LABELLING ──────────────────────────
+RunLabels labelRuns(const RleImage& image, int connectivity) {
+    RunLabels result;
+    const std::vector<Run>& runs = image.runs();
+    DisjointSets sets(runs.size());
+    
+    // Runs of adjacent rows touch when their columns overlap; with
+    // 8-connectivity diagonal neighbours (one column of slack) count too
+    const int slack = connectivity == 4 ? 0 : 1;
+    for (int y = 1; y < image.rows(); y++) {
+        size_t i = image.rowStart(y - 1);
+        size_t j = image.rowStart(y);
+        const size_t i_end = image.rowStart(y);
+        const size_t j_end = image.rowStart(y + 1);
+        while (i < i_end && j < j_end) {
+            if (runs[i].x0 < runs[j].x1 + slack && runs[j].x0 < runs[i].x1 + slack) {
+                sets.unite(static_cast<int>(i), static_cast<int>(j));
+            }
+            if (runs[i].x1 < runs[j].x1) {
+                i++;
+            } else {
+                j++;
+            }
+        }
+    }
+    
+    // Roots are the first run of their component, so numbering them in
+    // run order gives raster order
+    result.labels.resize(runs.size());
+    for (size_t i = 0; i < runs.size(); i++) {
+        const int root = sets.find(static_cast<int>(i));
+        result.labels[i] = root == static_cast<int>(i) ? result.count++ : result.labels[root];
+    }
+    
+    return result;
+}
+
+// ────────────────────────── CONTOUR TRACING ──────────────────────────
+void traceContours(const RleImage& image, std::vector<std::vector<cv::Point>>& contours,
+                   std::vector<cv::Vec4i>& hierarchy, std::vector<int>* component,
+                   int connectivity) {
+    contours.clear();
+    hierarchy.clear();
+    if (component) {
+        component->clear();
+    }
+    if (image.empty() || image.runCount() == 0) {
+        return;
+    }
+    
+    const std::vector<Run>& runs = image.runs();
+    const int rows = image.rows();
+    const bool eight = connectivity != 4;
+    const RunLabels foreground = labelRuns(image, connectivity);
+    
+    // Background components use the complementary connectivity. Gaps on the
+    // image edge join the outside, which has the last id.
+    const int outside = static_cast<int>(runs.size()) + rows;
+    DisjointSets background(outside + 1);
+    const int slack = eight ? 0 : 1;
+    std::vector<Gap> previous, current;
+    for (int y = 0; y < rows; y++) {
+        rowGaps(image, y, current);
+        for (const Gap& gap : current) {
+            if (y == 0 || y == rows - 1 || gap.x0 == 0 || gap.x1 == image.cols()) {
+                background.unite(gap.id, outside);
+            }
+        }
+        
+        size_t i = 0;
+        size_t j = 0;
+        while (i < previous.size() && j < current.size()) {
+            if (previous[i].x0 < current[j].x1 + slack && current[j].x0 < previous[i].x1 + slack) {
+                background.unite(previous[i].id, current[j].id);
+            }
+            if (previous[i].x1 < current[j].x1) {
+                i++;
+            } else {
+                j++;
+            }
+        }
+        std::swap(previous, current);
+    }
+    
+    auto corner = [&](int x, int y) {
+        return Corner{image.at(x - 1, y - 1), image.at(x, y - 1), image.at(x - 1, y), image.at(x, y)};
+    };
+    
+    // Every outline has at least one northward edge, and those are exactly
+    // the left ends of runs: start a walk at each one not yet traced
+    std::vector<uchar> traced(runs.size(), 0);
+    std::vector<int64_t> areas;
+    std::vector<int> labels;
+    std::vector<int> outer_gaps;
+    
+    for (int y = 0; y < rows; y++) {
+        for (size_t r = image.rowStart(y); r < image.rowStart(y + 1); r++) {
+            if (traced[r]) {
+                continue;
+            }
+            
+            const cv::Point start(runs[r].x0, y + 1);
+            cv::Point p = start;
+            int dir = NORTH;
+            std::vector<cv::Point> contour;
+            
+            do {
+                // Follow the edge to the next corner where the outline may turn
+                switch (dir) {
+                    case NORTH:
+                        traced[image.findRun(p.x, p.y - 1) - runs.data()] = 1;
+                        p.y--;
+                        break;
+                    case SOUTH:
+                        p.y++;
+                        break;
+                    case EAST: {
+                        // Foreground below, background above: stop where either changes
+                        int stop = image.findRun(p.x, p.y)->x1;
+                        if (p.y > 0) {
+                            const Run* above = std::upper_bound(
+                                image.rowBegin(p.y - 1), image.rowEnd(p.y - 1), p.x,
+                                [](int value, const Run& run) { return value < run.x0; });
+                            if (above != image.rowEnd(p.y - 1)) {
+                                stop = std::min(stop, above->x0);
+                            }
+                        }
+                        p.x = stop;
+                        break;
+                    }
+                    default: {
+                        // Foreground above, background below
+                        int stop = image.findRun(p.x - 1, p.y - 1)->x0;
+                        if (p.y < rows) {
+                            const Run* below = std::lower_bound(
+                                image.rowBegin(p.y), image.rowEnd(p.y), p.x,
+                                [](const Run& run, int value) { return run.x0 < value; });
+                            if (below != image.rowBegin(p.y)) {
+                                stop = std::max(stop, (below - 1)->x1);
+                            }
+                        }
+                        p.x = stop;
+                        break;
+                    }
+                }
+                
+                // Where two outlines meet diagonally, 8-connectivity turns
+                // left to keep the pixels together and 4-connectivity right
+                const Corner c = corner(p.x, p.y);
+                const int left = (dir + 3) % 4;
+                const int right = (dir + 1) % 4;
+                int next;
+                if (eight) {
+                    next = hasEdge(c, left) ? left : hasEdge(c, dir) ? dir : right;
+                } else {
+                    next = hasEdge(c, right) ? right : hasEdge(c, dir) ? dir : left;
+                }
+                if (next != dir) {
+                    contour.push_back(p);
+                }
+                dir = next;
+            } while (p != start || dir != NORTH);
+            
+            // Twice the signed area: positive for outer boundaries
+            int64_t area = 0;
+            for (size_t k = 0; k < contour.size(); k++) {
+                const cv::Point& a = contour[k];
+                const cv::Point& b = contour[(k + 1) % contour.size()];
+                area += static_cast<int64_t>(a.x) * b.y - static_cast<int64_t>(b.x) * a.y;
+            }
+            
+            contours.push_back(std::move(contour));
+            areas.push_back(area);
+            labels.push_back(foreground.labels[r]);
+            outer_gaps.push_back(background.find(static_cast<int>(r) + y));
+        }
+    }
+    
+    // An outer boundary's parent is the hole of the background component
+    // around it; a hole's parent is the outer boundary of its component
+    const size_t count = contours.size();
+    std::vector<int> outer_of(foreground.count, -1);
+    std::vector<int> hole_of(outside + 1, -1);
+    for (size_t i = 0; i < count; i++) {
+        if (areas[i] > 0) {
+            outer_of[labels[i]] = static_cast<int>(i);
+        } else {
+            hole_of[outer_gaps[i]] = static_cast<int>(i);
+        }
+    }
+    
+    const int outside_root = background.find(outside);
+    hierarchy.assign(count, cv::Vec4i(-1, -1, -1, -1));
+    std::vector<int> last_child(count, -1);
+    int last_top = -1;
+    for (size_t i = 0; i < count; i++) {
+        int parent;
+        if (areas[i] > 0) {
+            parent = outer_gaps[i] == outside_root ? -1 : hole_of[outer_gaps[i]];
+        } else {
+            parent = outer_of[labels[i]];
+        }
+        
+        const int index = static_cast<int>(i);
+        int& last = parent < 0 ? last_top : last_child[parent];
+        if (last >= 0) {
+            hierarchy[last][0] = index;
+            hierarchy[index][1] = last;
+        } else if (parent >= 0) {
+            hierarchy[parent][2] = index;
+        }
+        hierarchy[index][3] = parent;
+        last = index;
+    }
+    
+    if (component) {
+        *component = std::move(labels);
+    }
+}
+
+} // namespace stencil
@@ -0,0 +1,99 @@
+// rle_image.hpp
+#ifndef RLE_IMAGE_HPP
+#define RLE_IMAGE_HPP
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <vector>
+
+namespace stencil {
+
+// ────────────────────────── RUN-LENGTH IMAGE ──────────────────────────
+// Binary image stored as the horizontal runs of its foreground pixels, row
+// by row. A stencil is mostly long flat stretches, so a 100 MP image that
+// needs 100 MB as CV_8U (and 400 MB as a CV_32S label image) typically fits
+// in a few megabytes of runs. Labelling, island analysis, bridging and
+// contour tracing all work on the runs directly, so their cost follows the
+// number of edges rather than the number of pixels.
+
+struct Run {
+    int x0 = 0;                       // First foreground pixel
+    int x1 = 0;                       // One past the last one
+    
+    int length() const { return x1 - x0; }
+};
+
+class RleImage {
+public:
+    RleImage() = default;
+    explicit RleImage(const cv::Size& size);    // All background
+    
+    // Foreground is value > threshold, or value <= threshold with invert
+    static RleImage encode(const cv::Mat& image, int threshold = 0, bool invert = false);
+    
+    // Rows of possibly overlapping, unsorted runs; rows.size() == size.height
+    static RleImage fromRows(const cv::Size& size, std::vector<std::vector<Run>>& rows);
+    
+    void decode(cv::Mat& dst, uchar foreground = 255, uchar background = 0) const;
+    cv::Mat decode(uchar foreground = 255, uchar background = 0) const;
+    
+    cv::Size size() const { return cv::Size(cols_, rows_); }
+    int rows() const { return rows_; }
+    int cols() const { return cols_; }
+    bool empty() const { return rows_ == 0 || cols_ == 0; }
+    
+    // Runs of all rows in raster order; row y owns [rowStart(y), rowStart(y + 1))
+    const std::vector<Run>& runs() const { return runs_; }
+    size_t runCount() const { return runs_.size(); }
+    size_t rowStart(int y) const { return row_start_[y]; }
+    const Run* rowBegin(int y) const { return runs_.data() + row_start_[y]; }
+    const Run* rowEnd(int y) const { return runs_.data() + row_start_[y + 1]; }
+    
+    bool at(int x, int y) const;      // Out of range reads as background
+    const Run* findRun(int x, int y) const;    // Run covering (x, y), null if none
+    int64_t area() const;             // Foreground pixel count
+    size_t bytes() const;             // Memory held by the runs and row index
+    
+    // Set operations with an image of the same size
+    RleImage unite(const RleImage& other) const;
+    RleImage subtract(const RleImage& other) const;
+    RleImage complement() const;      // Background runs as foreground
+    
+    // Runs i with keep[i] != 0, in the same places; keep.size() == runCount()
+    RleImage selectRuns(const std::vector<uchar>& keep) const;
+
+private:
+    int rows_ = 0;
+    int cols_ = 0;
+    std::vector<Run> runs_;
+    std::vector<size_t> row_start_ = {0};
+};
+
+// ────────────────────────── RUN LABELLING ──────────────────────────
+// Connected components of the foreground, found by union-find over runs
+// that touch in adjacent rows. Labels start at 1 and follow the raster order
+// of each component's first pixel; count includes the unused label 0, as
+// cv::connectedComponents does.
+struct RunLabels {
+    std::vector<int> labels;          // Label of every run, parallel to RleImage::runs()
+    int count = 1;
+};
+
+RunLabels labelRuns(const RleImage& image, int connectivity = 8);
+
+// ────────────────────────── CONTOUR TRACING ──────────────────────────
+// Outlines of the foreground along pixel edges: vertices lie on pixel
+// corners, so a contour encloses exactly the pixels of its component
+// (cv::findContours traces pixel centres instead). Only corners are kept,
+// as with CHAIN_APPROX_SIMPLE. The result is a full tree in findContours
+// form: outer boundaries and holes alternate with depth, and hierarchy
+// entries are [next, previous, first child, parent]. Outer boundaries run
+// clockwise on screen. component, if given, receives the labelRuns label of
+// each contour's component.
+void traceContours(const RleImage& image, std::vector<std::vector<cv::Point>>& contours,
+                   std::vector<cv::Vec4i>& hierarchy, std::vector<int>* component = nullptr,
+                   int connectivity = 8);
+
+} // namespace stencil
+
+#endif // RLE_IMAGE_HPP
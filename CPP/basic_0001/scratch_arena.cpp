@@ -0,0 +1,41 @@
+// scratch_arena.cpp
+#include "scratch_arena.hpp"
+#include <climits>
+
+namespace stencil {
+
+cv::Mat ScratchArena::view(Slot slot, const cv::Size& size, int type) {
+    CV_Assert(slot >= 0 && slot < SLOT_COUNT);
+    
+    const size_t needed = static_cast<size_t>(size.width) * size.height * CV_ELEM_SIZE(type);
+    cv::Mat& buffer = buffers_[slot];
+    if (needed > buffer.total()) {
+        CV_Assert(needed <= static_cast<size_t>(INT_MAX));
+        // Grow to exactly the request: a pipeline asks each slot for the
+        // same few sizes over and over, so the first large one settles it
+        buffer.release();
+        buffer.create(1, static_cast<int>(needed), CV_8UC1);
+        allocations_++;
+    }
+    
+    if (needed == 0) {
+        return cv::Mat(size, type);
+    }
+    return cv::Mat(size, type, buffer.data);
+}
+
+size_t ScratchArena::bytes() const {
+    size_t total = 0;
+    for (const cv::Mat& buffer : buffers_) {
+        total += buffer.total();
+    }
+    return total;
+}
+
+void ScratchArena::release() {
+    for (cv::Mat& buffer : buffers_) {
+        buffer.release();
+    }
+}
+
+} // namespace stencil
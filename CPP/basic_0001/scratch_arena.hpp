@@ -0,0 +1,49 @@
+// scratch_arena.hpp
+#ifndef SCRATCH_ARENA_HPP
+#define SCRATCH_ARENA_HPP
+
+#include <opencv2/opencv.hpp>
+#include <cstddef>
+
+namespace stencil {
+
+// ────────────────────────── SCRATCH ARENA ──────────────────────────
+// Reusable working memory for the stencil pipeline. Every stage output has
+// its own slot: a byte buffer that only grows. view() returns a continuous
+// Mat header of the requested size and type over that buffer, so a stage
+// writing into it (cv::Mat::create is a no-op on a matching header) never
+// allocates once the slot is large enough. Processing a run of same-sized
+// images therefore allocates on the first image only; smaller images and
+// edge tiles reuse the memory of larger ones.
+//
+// Views do not own their memory. A view is valid until the next view() of
+// the same slot, or until the arena is released or destroyed. Views are
+// plain headers rather than ROIs of the buffer, so filters see their edges
+// as image borders. One arena per thread.
+
+class ScratchArena {
+public:
+    enum Slot {
+        GRAY,          // Grayscale conversion
+        TONED,         // Contrast adjusted
+        BLURRED,       // Gaussian blur
+        LAPLACIAN,     // CV_16S edge response
+        EDGES,         // Absolute edge response
+        TILE,          // Padded tile output of the tiled paths
+        SLOT_COUNT
+    };
+    
+    cv::Mat view(Slot slot, const cv::Size& size, int type);
+    
+    size_t bytes() const;          // Memory held by all slots
+    size_t allocations() const { return allocations_; }
+    void release();
+    
+private:
+    cv::Mat buffers_[SLOT_COUNT];  // 1 x capacity CV_8UC1
+    size_t allocations_ = 0;
+};
+
+} // namespace stencil
+
+#endif // SCRATCH_ARENA_HPP
@@ -1,6 +1,10 @@
 // stencil_generator.cpp
 #include "stencil_generator.hpp"
+#include "fused_preprocess.hpp"
+#include "island_analysis.hpp"
+#include "layer_quantizer.hpp"
 #include <fstream>
+#include <cstring>
 #include <cmath>
 #include <algorithm>
 
@@ -17,6 +21,8 @@ json Preset::to_json() const {
         {"contrast", contrast},
         {"bridge_width_px", bridge_width_px},
         {"bridge_color", bridge_color},
+        {"layer_count", layer_count},
+        {"equalize_layers", equalize_layers},
         {"size_mode", size_mode},
         {"units", units},
         {"horiz_circ", horiz_circ},
@@ -36,6 +42,8 @@ Preset Preset::from_json(const json& j) {
     if (j.contains("contrast")) preset.contrast = j["contrast"];
     if (j.contains("bridge_width_px")) preset.bridge_width_px = j["bridge_width_px"];
     if (j.contains("bridge_color")) preset.bridge_color = j["bridge_color"];
+    if (j.contains("layer_count")) preset.layer_count = j["layer_count"];
+    if (j.contains("equalize_layers")) preset.equalize_layers = j["equalize_layers"];
     if (j.contains("size_mode")) preset.size_mode = j["size_mode"];
     if (j.contains("units")) preset.units = j["units"];
     if (j.contains("horiz_circ")) preset.horiz_circ = j["horiz_circ"];
@@ -63,7 +71,16 @@ bool StencilGenerator::loadImage(const std::string& filepath) {
 }
 
 bool StencilGenerator::loadImageFromMemory(const std::vector<uchar>& buffer) {
-    original_image_ = cv::imdecode(buffer, cv::IMREAD_COLOR);
+    return loadImageFromMemory(buffer.data(), buffer.size());
+}
+
+bool StencilGenerator::loadImageFromMemory(const uchar* data, size_t size, const IngestOptions& options) {
+    original_image_ = decodeImage(data, size, options);
+    return !original_image_.empty();
+}
+
+bool StencilGenerator::loadImageMapped(const std::string& filepath, const IngestOptions& options) {
+    original_image_ = stencil::loadImageMapped(filepath, options);
     return !original_image_.empty();
 }
 
@@ -74,20 +91,43 @@ bool StencilGenerator::loadImageFromMat(const cv::Mat& image) {
 }
 
 cv::Mat StencilGenerator::convertToGrayscale(const cv::Mat& image) {
+    cv::Mat gray;
+    convertToGrayscale(image, gray);
+    return gray;
+}
+
+void StencilGenerator::convertToGrayscale(const cv::Mat& image, cv::Mat& dst) {
     if (image.channels() == 3) {
-        cv::Mat gray;
-        cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
-        return gray;
+        cv::cvtColor(image, dst, cv::COLOR_BGR2GRAY);
+        return;
     }
-    return image.clone();
+    image.copyTo(dst);
 }
 
 cv::Mat StencilGenerator::adjustContrast(const cv::Mat& image, float contrast) {
     cv::Mat result;
+    adjustContrast(image, result, contrast);
+    return result;
+}
+
+void StencilGenerator::adjustContrast(const cv::Mat& image, cv::Mat& dst, float contrast) {
     if (contrast == 1.0f) {
-        return image.clone();
+        image.copyTo(dst);
+        return;
     }
     
+    // 8-bit input: the float chain below, tabulated once per contrast value
+    if (image.depth() == CV_8U) {
+        cv::LUT(image, contrastLut(contrast), dst);
+        return;
+    }
+    
+    contrastStretch(image, dst, contrast);
+}
+
+void StencilGenerator::contrastStretch(const cv::Mat& image, cv::Mat& dst, float contrast) {
+    const int type = image.type();
+    
     // Convert to float for contrast adjustment
     cv::Mat float_img;
     image.convertTo(float_img, CV_32F);
@@ -99,44 +139,87 @@ cv::Mat StencilGenerator::adjustContrast(const cv::Mat& image, float contrast) {
     cv::threshold(float_img, float_img, 255, 255, cv::THRESH_TRUNC);
     cv::threshold(float_img, float_img, 0, 0, cv::THRESH_TOZERO);
     
-    float_img.convertTo(result, image.type());
-    return result;
+    float_img.convertTo(dst, type);
 }
 
 cv::Mat StencilGenerator::applyBlur(const cv::Mat& image, int blur_amount) {
+    cv::Mat blurred;
+    applyBlur(image, blurred, blur_amount);
+    return blurred;
+}
+
+void StencilGenerator::applyBlur(const cv::Mat& image, cv::Mat& dst, int blur_amount) {
     if (blur_amount <= 0) {
-        return image.clone();
+        image.copyTo(dst);
+        return;
     }
     
-    cv::Mat blurred;
-    cv::GaussianBlur(image, blurred, cv::Size(0, 0), blur_amount);
-    return blurred;
+    cv::GaussianBlur(image, dst, cv::Size(0, 0), blur_amount);
 }
 
 cv::Mat StencilGenerator::enhanceEdges(const cv::Mat& image) {
-    cv::Mat edges, sharpened;
+    cv::Mat sharpened;
+    enhanceEdges(image, sharpened);
+    return sharpened;
+}
+
+void StencilGenerator::enhanceEdges(const cv::Mat& image, cv::Mat& dst) {
+    enhanceEdges(image, dst, scratch_);
+}
+
+void StencilGenerator::enhanceEdges(const cv::Mat& image, cv::Mat& dst, ScratchArena& scratch) {
+    cv::Mat laplacian = scratch.view(ScratchArena::LAPLACIAN, image.size(), CV_16SC(image.channels()));
+    cv::Mat edges = scratch.view(ScratchArena::EDGES, image.size(), CV_8UC(image.channels()));
     
     // Apply edge enhancement using Laplacian
-    cv::Laplacian(image, edges, CV_16S, 3);
-    cv::convertScaleAbs(edges, edges);
+    cv::Laplacian(image, laplacian, CV_16S, 3);
+    cv::convertScaleAbs(laplacian, edges);
     
     // Add edges to original for enhancement
-    cv::addWeighted(image, 1.5, edges, -0.5, 0, sharpened);
-    return sharpened;
+    cv::addWeighted(image, 1.5, edges, -0.5, 0, dst);
 }
 
 cv::Mat StencilGenerator::applyThreshold(const cv::Mat& image, int threshold) {
     cv::Mat binary;
-    cv::threshold(image, binary, threshold, 255, cv::THRESH_BINARY);
+    applyThreshold(image, binary, threshold);
     return binary;
 }
 
+void StencilGenerator::applyThreshold(const cv::Mat& image, cv::Mat& dst, int threshold) {
+    cv::threshold(image, dst, threshold, 255, cv::THRESH_BINARY);
+}
+
 cv::Mat StencilGenerator::invertImage(const cv::Mat& image) {
     cv::Mat inverted;
-    cv::bitwise_not(image, inverted);
+    invertImage(image, inverted);
     return inverted;
 }
 
+void StencilGenerator::invertImage(const cv::Mat& image, cv::Mat& dst) {
+    cv::bitwise_not(image, dst);
+}
+
+size_t StencilGenerator::scratchBytes() const {
+    size_t total = scratch_.bytes();
+    for (const ScratchArena& arena : tile_scratch_) {
+        total += arena.bytes();
+    }
+    return total;
+}
+
+size_t StencilGenerator::scratchAllocations() const {
+    size_t total = scratch_.allocations();
+    for (const ScratchArena& arena : tile_scratch_) {
+        total += arena.allocations();
+    }
+    return total;
+}
+
+void StencilGenerator::releaseScratch() {
+    scratch_.release();
+    tile_scratch_.clear();
+}
+
 cv::Mat StencilGenerator::resizeForDisplay(const cv::Mat& image, int max_width) {
     if (image.cols <= max_width) {
         return image.clone();
@@ -150,155 +233,385 @@ cv::Mat StencilGenerator::resizeForDisplay(const cv::Mat& image, int max_width)
     return resized;
 }
 
-cv::Mat StencilGenerator::preprocessImage(const cv::Mat& image, const Preset& preset) {
-    cv::Mat processed = convertToGrayscale(image);
-    processed = adjustContrast(processed, preset.contrast);
-    return processed;
+void StencilGenerator::preprocessImage(const cv::Mat& image, const Preset& preset, ScratchArena& scratch,
+                                       cv::Mat& toned) {
+    // Gray input is toned straight from the source
+    cv::Mat gray = image;
+    if (image.channels() == 3) {
+        gray = scratch.view(ScratchArena::GRAY, image.size(), CV_MAKETYPE(image.depth(), 1));
+        convertToGrayscale(image, gray);
+    }
+    
+    toned = scratch.view(ScratchArena::TONED, gray.size(), gray.type());
+    adjustContrast(gray, toned, preset.contrast);
 }
 
-cv::Mat StencilGenerator::generateSimpleStencil(const Preset& preset) {
-    if (original_image_.empty()) {
-        return cv::Mat();
+const cv::Mat& StencilGenerator::contrastLut(float contrast) {
+    if (contrast_lut_.empty() || contrast_lut_key_ != contrast) {
+        contrastStretch(identityLut(), contrast_lut_, contrast);
+        contrast_lut_key_ = contrast;
+    }
+    return contrast_lut_;
+}
+
+const cv::Mat& StencilGenerator::toneLut(const Preset& preset) {
+    if (tone_lut_.empty() || tone_lut_key_.contrast != preset.contrast ||
+        tone_lut_key_.threshold != preset.threshold ||
+        tone_lut_key_.invert_colors != preset.invert_colors) {
+        tone_lut_ = buildToneLut(preset);
+        tone_lut_key_ = preset;
+    }
+    return tone_lut_;
+}
+
+cv::Mat StencilGenerator::buildToneLut(const Preset& preset) {
+    cv::Mat lut;
+    contrastStretch(identityLut(), lut, preset.contrast);
+    lut = applyThreshold(lut, preset.threshold);
+    if (preset.invert_colors) {
+        lut = invertImage(lut);
+    }
+    return lut;
+}
+
+void StencilGenerator::runSimplePipeline(const cv::Mat& image, const Preset& preset, ScratchArena& scratch,
+                                         cv::Mat& stencil) {
+    // Without neighbourhood stages the chain is purely per-pixel: one pass.
+    // The fused kernel takes 8-bit gray or BGR; other input keeps its depth
+    // and channels through the staged chain.
+    const bool fusable = image.depth() == CV_8U && (image.channels() == 1 || image.channels() == 3);
+    if (fusable && preset.blur_amount <= 0 && !preset.edge_enhance) {
+        fusedToneMap(image, stencil, toneLut(preset));
+        return;
     }
     
-    cv::Mat processed = preprocessImage(original_image_, preset);
+    cv::Mat processed;
+    preprocessImage(image, preset, scratch, processed);
     
     // Apply blur if needed
     if (preset.blur_amount > 0) {
-        processed = applyBlur(processed, preset.blur_amount);
+        cv::Mat blurred = scratch.view(ScratchArena::BLURRED, processed.size(), processed.type());
+        applyBlur(processed, blurred, preset.blur_amount);
+        processed = blurred;
     }
     
     // Apply edge enhancement if needed
     if (preset.edge_enhance) {
-        processed = enhanceEdges(processed);
+        enhanceEdges(processed, processed, scratch);
     }
     
-    // Apply threshold
-    cv::Mat stencil = applyThreshold(processed, preset.threshold);
+    // Threshold, inverting in the same pass if needed
+    cv::threshold(processed, stencil, preset.threshold, 255,
+                  preset.invert_colors ? cv::THRESH_BINARY_INV : cv::THRESH_BINARY);
+}
+
+cv::Mat StencilGenerator::generateSimpleStencil(const Preset& preset) {
+    cv::Mat stencil;
+    generateSimpleStencil(preset, stencil);
+    return stencil;
+}
+
+bool StencilGenerator::generateSimpleStencil(const Preset& preset, cv::Mat& stencil) {
+    if (original_image_.empty()) {
+        return false;
+    }
     
-    // Invert if needed
-    if (preset.invert_colors) {
-        stencil = invertImage(stencil);
+    runSimplePipeline(original_image_, preset, scratch_, stencil);
+    return true;
+}
+
+int StencilGenerator::pipelineHaloRadius(const Preset& preset) {
+    int halo = 0;
+    
+    if (preset.blur_amount > 0) {
+        // Kernel size cv::GaussianBlur derives for 8-bit input when ksize is (0, 0)
+        int ksize = cvRound(preset.blur_amount * 3 * 2 + 1) | 1;
+        halo += ksize / 2;
+    }
+    
+    if (preset.edge_enhance) {
+        halo += 1; // 3x3 Laplacian
     }
     
+    return halo;
+}
+
+cv::Mat StencilGenerator::generateSimpleStencilTiled(const Preset& preset, const TileOptions& options) {
+    cv::Mat stencil;
+    generateSimpleStencilTiled(preset, stencil, options);
     return stencil;
 }
 
-cv::Mat StencilGenerator::generateMultiLayerStencil(const Preset& preset) {
+bool StencilGenerator::generateSimpleStencilTiled(const Preset& preset, cv::Mat& stencil,
+                                                  const TileOptions& options) {
     if (original_image_.empty()) {
-        return cv::Mat();
+        return false;
     }
     
-    cv::Mat processed = preprocessImage(original_image_, preset);
+    // The tiles write into a CV_8UC1 stencil; BGRA and 16-bit images keep
+    // their type through the single-pass chain instead
+    const int type = original_image_.type();
+    if (type != CV_8UC1 && type != CV_8UC3) {
+        return generateSimpleStencil(preset, stencil);
+    }
     
-    // Apply blur if needed
-    if (preset.blur_amount > 0) {
-        processed = applyBlur(processed, preset.blur_amount);
+    const int tile = std::max(64, options.tile_size);
+    const int halo = pipelineHaloRadius(preset);
+    
+    stencil.create(original_image_.size(), CV_8UC1);
+    runTiles(original_image_, 0, 0, original_image_.rows, tile, halo, preset, stencil);
+    return true;
+}
+
+void StencilGenerator::runTiles(const cv::Mat& window, int window_y, int y0, int y1, int tile, int halo,
+                                const Preset& preset, cv::Mat& stencil) {
+    // Each tile's result must stay in its arena view to land in the stencil
+    CV_Assert(window.type() == CV_8UC1 || window.type() == CV_8UC3);
+    CV_Assert(stencil.type() == CV_8UC1);
+    
+    const cv::Rect bounds(0, 0, stencil.cols, stencil.rows);
+    const cv::Rect band(0, y0, stencil.cols, y1 - y0);
+    const int tiles_x = (band.width + tile - 1) / tile;
+    const int tiles = tiles_x * ((band.height + tile - 1) / tile);
+    if (tiles == 0) {
+        return;
+    }
+    
+    // The workers only read the lookup tables: build them up front
+    toneLut(preset);
+    contrastLut(preset.contrast);
+    
+    // Tiles are dealt round-robin to a fixed set of workers, each with its
+    // own arena, so tile intermediates are allocated once per worker and
+    // reused across tiles and calls.
+    const int workers = std::max(1, std::min(tiles, cv::getNumThreads()));
+    if (tile_scratch_.size() < static_cast<size_t>(workers)) {
+        tile_scratch_.resize(workers);
+    }
+    
+    // Each tile runs the whole chain on its halo-padded window, so only
+    // (tile + 2 * halo)^2 intermediates are alive per worker. Halo pixels that
+    // reach past the image are clipped; there the tile edge is the image edge
+    // and the filters reflect exactly as they do in the single-pass pipeline.
+    cv::parallel_for_(cv::Range(0, workers), [&](const cv::Range& range) {
+        for (int w = range.start; w < range.end; w++) {
+            ScratchArena& scratch = tile_scratch_[w];
+            for (int t = w; t < tiles; t += workers) {
+                cv::Rect core(band.x + (t % tiles_x) * tile, band.y + (t / tiles_x) * tile, tile, tile);
+                core &= band;
+                
+                cv::Rect padded(core.x - halo, core.y - halo,
+                                core.width + 2 * halo, core.height + 2 * halo);
+                padded &= bounds;
+                
+                cv::Mat result = scratch.view(ScratchArena::TILE, padded.size(), CV_8UC1);
+                runSimplePipeline(window(padded - cv::Point(0, window_y)), preset, scratch, result);
+                result(core - padded.tl()).copyTo(stencil(core));
+            }
+        }
+    });
+}
+
+cv::Mat StencilGenerator::generateSimpleStencilStreamed(const std::string& filepath, const Preset& preset,
+                                                        const TileOptions& options) {
+    std::unique_ptr<StripReader> reader = openStripReader(filepath);
+    if (!reader) {
+        // Not strip-decodable: decode whole and tile in memory. A gray decode
+        // would be smaller, but the PNG and JPEG decoders' own gray
+        // conversions can differ from BGR2GRAY by one level.
+        if (!loadImageMapped(filepath)) {
+            return cv::Mat();
+        }
+        return generateSimpleStencilTiled(preset, options);
     }
     
-    // Create multiple layers
-    cv::Mat layer1, layer2, layer3, layer4;
-    cv::threshold(processed, layer1, 192, 255, cv::THRESH_BINARY);
-    cv::threshold(processed, layer2, 128, 170, cv::THRESH_BINARY);
-    cv::threshold(processed, layer3, 64, 85, cv::THRESH_BINARY);
-    cv::threshold(processed, layer4, 64, 0, cv::THRESH_BINARY_INV);
+    const cv::Size size = reader->size();
+    const int tile = std::max(64, options.tile_size);
+    const int halo = pipelineHaloRadius(preset);
     
-    // Combine layers
-    cv::Mat stencil = cv::Mat::zeros(processed.size(), CV_8UC1);
-    stencil = layer1 + layer2 + layer3 + layer4;
+    cv::Mat stencil(size, CV_8UC1);
     
-    // Invert if needed
-    if (preset.invert_colors) {
-        stencil = invertImage(stencil);
+    // Rolling window of decoded gray rows [window_y, window_end). Each band
+    // of tile rows needs its halo above and below; the rows shared with the
+    // next band are moved up instead of being decoded twice.
+    cv::Mat window(std::min(size.height, tile + 2 * halo), size.width, CV_8UC1);
+    int window_y = 0;
+    int window_end = 0;
+    
+    for (int y0 = 0; y0 < size.height; y0 += tile) {
+        const int y1 = std::min(size.height, y0 + tile);
+        const int need_begin = std::max(0, y0 - halo);
+        const int need_end = std::min(size.height, y1 + halo);
+        
+        const int keep = std::max(0, window_end - need_begin);
+        if (keep > 0 && need_begin > window_y) {
+            std::memmove(window.ptr<uchar>(0), window.ptr<uchar>(need_begin - window_y),
+                         static_cast<size_t>(keep) * window.step);
+        }
+        window_y = need_begin;
+        window_end = window_y + keep;
+        
+        if (need_end > window_end) {
+            cv::Mat rows = window.rowRange(window_end - window_y, need_end - window_y);
+            if (!reader->read(rows)) {
+                return cv::Mat();
+            }
+            window_end = need_end;
+        }
+        
+        // Same per-tile windows as generateSimpleStencilTiled, so the output
+        // is identical
+        runTiles(window, window_y, y0, y1, tile, halo, preset, stencil);
     }
     
     return stencil;
 }
 
+cv::Mat StencilGenerator::generateMultiLayerStencil(const Preset& preset, std::vector<cv::Mat>* layer_masks) {
+    cv::Mat stencil;
+    generateMultiLayerStencil(preset, stencil, layer_masks);
+    return stencil;
+}
+
+bool StencilGenerator::generateMultiLayerStencil(const Preset& preset, cv::Mat& stencil,
+                                                 std::vector<cv::Mat>* layer_masks) {
+    if (original_image_.empty()) {
+        return false;
+    }
+    
+    cv::Mat processed;
+    preprocessImage(original_image_, preset, scratch_, processed);
+    
+    // Apply blur if needed
+    if (preset.blur_amount > 0) {
+        cv::Mat blurred = scratch_.view(ScratchArena::BLURRED, processed.size(), processed.type());
+        applyBlur(processed, blurred, preset.blur_amount);
+        processed = blurred;
+    }
+    
+    // One LUT sweep; inversion is folded into the layer tones
+    LayerSpec spec = preset.equalize_layers ? equalizedLayers(processed, preset.layer_count)
+                                            : uniformLayers(preset.layer_count);
+    if (preset.invert_colors) {
+        for (uchar& tone : spec.tones) {
+            tone = static_cast<uchar>(255 - tone);
+        }
+    }
+    
+    quantizeLayers(processed, stencil, spec, layer_masks);
+    return true;
+}
+
+std::string StencilGenerator::canonicalPresetKey(const Preset& preset) {
+    // nlohmann::json objects keep their keys sorted, so dump() is canonical.
+    // Sizing and bridging fields never reach generateStencil: leaving them
+    // out keeps a resized pumpkin from missing the cache.
+    json j = preset.to_json();
+    for (const char* key : {"size_mode", "units", "horiz_circ", "vert_circ", "flat_w", "flat_h",
+                            "bridge_width_px", "bridge_color"}) {
+        j.erase(key);
+    }
+    return "cpp/stencil/" + j.dump();
+}
+
 cv::Mat StencilGenerator::generateStencil(const Preset& preset) {
     cv::Mat stencil;
+    generateStencil(preset, stencil);
+    return stencil;
+}
+
+bool StencilGenerator::generateStencil(const Preset& preset, cv::Mat& stencil) {
+    last_from_cache_ = false;
+    if (original_image_.empty()) {
+        return false;
+    }
+    
+    // Same pixels and preset as a previous job: reuse its stencil
+    std::string cache_key;
+    if (result_cache_) {
+        cache_key = ResultCache::makeKey(original_image_, canonicalPresetKey(preset));
+        CacheEntry entry;
+        if (result_cache_->load(cache_key, entry)) {
+            cv::Mat cached = entry.image("stencil");
+            if (!cached.empty()) {
+                // The entry maps read-only memory: copy out before it goes
+                cached.copyTo(stencil);
+                cached.copyTo(current_stencil_);
+                last_from_cache_ = true;
+                return true;
+            }
+        }
+    }
     
+    bool ok = false;
     if (preset.stencil_type.find("Simple") != std::string::npos) {
-        stencil = generateSimpleStencil(preset);
+        if (original_image_.total() >= tile_options_.min_pixels) {
+            ok = generateSimpleStencilTiled(preset, stencil, tile_options_);
+        } else {
+            ok = generateSimpleStencil(preset, stencil);
+        }
     } else {
-        stencil = generateMultiLayerStencil(preset);
+        ok = generateMultiLayerStencil(preset, stencil);
     }
     
-    if (!stencil.empty()) {
-        current_stencil_ = stencil.clone();
+    if (!ok || stencil.empty()) {
+        return false;
     }
     
-    return stencil;
+    // Private copy, so callers may draw on the returned stencil
+    stencil.copyTo(current_stencil_);
+    if (!cache_key.empty()) {
+        CacheEntry entry;
+        entry.addImage("stencil", stencil);
+        result_cache_->store(cache_key, entry);
+    }
+    
+    return true;
 }
 
 std::vector<StencilGenerator::IslandInfo> StencilGenerator::detectFloatingIslands(const cv::Mat& stencil) {
+    if (stencil.empty()) {
+        return std::vector<IslandInfo>();
+    }
+    return detectFloatingIslands(encodeStencil(stencil));
+}
+
+RleImage StencilGenerator::encodeStencil(const cv::Mat& stencil) {
+    if (stencil.empty()) {
+        return RleImage();
+    }
+    // Black areas are the cut-outs (value <= 127)
+    return RleImage::encode(convertToGrayscale(stencil), 127, true);
+}
+
+std::vector<StencilGenerator::IslandInfo> StencilGenerator::detectFloatingIslands(const RleImage& cut) {
     std::vector<IslandInfo> islands;
     
-    if (stencil.empty()) {
+    // Islands are the enclosed white pieces, so label the material
+    RleIslandTable table = analyzeIslands(cut.complement());
+    if (table.empty()) {
         return islands;
     }
     
-    // Create binary mask (black areas = 1, white areas = 0)
-    cv::Mat binary;
-    cv::threshold(stencil, binary, 128, 1, cv::THRESH_BINARY_INV);
-    
-    // Find connected components
-    cv::Mat labels, stats, centroids;
-    int num_components = cv::connectedComponentsWithStats(binary, labels, stats, centroids, 8);
-    
-    // Create border mask
-    cv::Mat border_mask = cv::Mat::zeros(binary.size(), CV_8UC1);
-    border_mask.row(0).setTo(1);
-    border_mask.row(border_mask.rows - 1).setTo(1);
-    border_mask.col(0).setTo(1);
-    border_mask.col(border_mask.cols - 1).setTo(1);
-    
-    // Collect border component IDs
-    std::vector<int> border_ids;
-    for (int y = 0; y < labels.rows; y++) {
-        for (int x = 0; x < labels.cols; x++) {
-            if (border_mask.at<uchar>(y, x)) {
-                int label = labels.at<int>(y, x);
-                if (std::find(border_ids.begin(), border_ids.end(), label) == border_ids.end()) {
-                    border_ids.push_back(label);
-                }
-            }
-        }
+    islands.resize(table.islands.size());
+    for (size_t i = 0; i < table.islands.size(); i++) {
+        const Island& island = table.islands[i];
+        islands[i].area = island.area;
+        islands[i].bounding_box = island.bounding_box;
+        islands[i].centroid = cv::Point(static_cast<int>(island.centroid.x),
+                                        static_cast<int>(island.centroid.y));
     }
     
-    // Find islands (components not touching border)
-    for (int i = 1; i < num_components; i++) {
-        // Skip components touching border
-        if (std::find(border_ids.begin(), border_ids.end(), i) != border_ids.end()) {
-            continue;
-        }
-        
-        double area = stats.at<int>(i, cv::CC_STAT_AREA);
-        
-        // Filter small islands
-        if (area > 50) {
-            IslandInfo info;
-            info.area = area;
-            info.bounding_box = cv::Rect(
-                stats.at<int>(i, cv::CC_STAT_LEFT),
-                stats.at<int>(i, cv::CC_STAT_TOP),
-                stats.at<int>(i, cv::CC_STAT_WIDTH),
-                stats.at<int>(i, cv::CC_STAT_HEIGHT)
-            );
-            info.centroid = cv::Point(
-                static_cast<int>(centroids.at<double>(i, 0)),
-                static_cast<int>(centroids.at<double>(i, 1))
-            );
-            
-            // Extract contour
-            cv::Mat component_mask = (labels == i);
-            std::vector<std::vector<cv::Point>> contours;
-            cv::findContours(component_mask, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
-            
-            if (!contours.empty()) {
-                info.contour = contours[0];
-                islands.push_back(info);
-            }
+    // Trace all island outlines at once; the mask holds the island runs in
+    // raster order, so its components are the islands in table order
+    std::vector<std::vector<cv::Point>> contours;
+    std::vector<cv::Vec4i> hierarchy;
+    std::vector<int> component;
+    traceContours(table.mask, contours, hierarchy, &component);
+    
+    for (size_t i = 0; i < contours.size(); i++) {
+        if (hierarchy[i][3] < 0) {
+            islands[component[i] - 1].contour = std::move(contours[i]);
         }
     }
     
@@ -317,44 +630,34 @@ cv::Mat StencilGenerator::visualizeIslands(const cv::Mat& stencil, const std::ve
     return visualization;
 }
 
-cv::Mat StencilGenerator::autoBridgeIslands(const cv::Mat& stencil, int bridge_width, int bridge_color) {
+cv::Mat StencilGenerator::autoBridgeIslands(const cv::Mat& stencil, int bridge_width, int bridge_color,
+                                            BridgePlan* plan) {
     if (stencil.empty()) {
         return cv::Mat();
     }
     
+    // Plan on the material runs, draw anti-aliased white lines on the raster
+    BridgePlan bridges = planBridges(analyzeIslands(encodeStencil(stencil).complement()));
+    
     cv::Mat result = stencil.clone();
-    std::vector<IslandInfo> islands = detectFloatingIslands(stencil);
+    drawBridges(result, bridges, bridge_width, bridge_color);
     
-    for (const auto& island : islands) {
-        cv::Point center = island.centroid;
-        int h = stencil.rows;
-        int w = stencil.cols;
-        
-        // Find closest direction to border
-        std::map<std::string, int> distances = {
-            {"up", center.y},
-            {"down", h - 1 - center.y},
-            {"left", center.x},
-            {"right", w - 1 - center.x}
-        };
-        
-        auto min_dir = std::min_element(distances.begin(), distances.end(),
-            [](const auto& a, const auto& b) { return a.second < b.second; });
-        
-        cv::Point end_point;
-        if (min_dir->first == "up") {
-            end_point = cv::Point(center.x, 0);
-        } else if (min_dir->first == "down") {
-            end_point = cv::Point(center.x, h - 1);
-        } else if (min_dir->first == "left") {
-            end_point = cv::Point(0, center.y);
-        } else { // right
-            end_point = cv::Point(w - 1, center.y);
-        }
-        
-        // Draw bridge line
-        cv::line(result, center, end_point, bridge_color, 
-                std::max(1, bridge_width), cv::LINE_AA);
+    if (plan) {
+        *plan = std::move(bridges);
+    }
+    
+    return result;
+}
+
+RleImage StencilGenerator::autoBridgeIslands(const RleImage& cut, int bridge_width, BridgePlan* plan) {
+    BridgePlan bridges = planBridges(analyzeIslands(cut.complement()));
+    
+    // Bridges are material: they come out of the cut
+    RleImage result = cut;
+    drawBridges(result, bridges, bridge_width, false);
+    
+    if (plan) {
+        *plan = std::move(bridges);
     }
     
     return result;
@@ -428,6 +731,44 @@ bool StencilGenerator::saveStencilAsBMP(const std::string& filepath, const cv::M
     return cv::imwrite(filepath, binary);
 }
 
+bool StencilGenerator::saveStencilAsSVG(const std::string& filepath, const cv::Mat& stencil,
+                                        const VectorExportOptions& options) {
+    // Black areas are the cut-outs, as in detectFloatingIslands
+    cv::Mat cut;
+    cv::threshold(convertToGrayscale(stencil), cut, 127, 255, cv::THRESH_BINARY_INV);
+    return exportBinary(filepath, VectorFormat::SVG, cut, options);
+}
+
+bool StencilGenerator::saveStencilAsDXF(const std::string& filepath, const cv::Mat& stencil,
+                                        const VectorExportOptions& options) {
+    cv::Mat cut;
+    cv::threshold(convertToGrayscale(stencil), cut, 127, 255, cv::THRESH_BINARY_INV);
+    return exportBinary(filepath, VectorFormat::DXF, cut, options);
+}
+
+bool StencilGenerator::saveStencilAsGcode(const std::string& filepath, const cv::Mat& stencil,
+                                          const GcodeOptions& options, GcodeStats* stats) {
+    // Toolpaths follow the black cut-outs, offset into them by half the kerf
+    cv::Mat cut;
+    cv::threshold(convertToGrayscale(stencil), cut, 127, 255, cv::THRESH_BINARY_INV);
+    return exportGcode(filepath, cut, options, stats);
+}
+
+bool StencilGenerator::saveStencilAsSVG(const std::string& filepath, const RleImage& cut,
+                                        const VectorExportOptions& options) {
+    return exportRle(filepath, VectorFormat::SVG, cut, options);
+}
+
+bool StencilGenerator::saveStencilAsDXF(const std::string& filepath, const RleImage& cut,
+                                        const VectorExportOptions& options) {
+    return exportRle(filepath, VectorFormat::DXF, cut, options);
+}
+
+bool StencilGenerator::saveStencilAsGcode(const std::string& filepath, const RleImage& cut,
+                                          const GcodeOptions& options, GcodeStats* stats) {
+    return exportGcode(filepath, cut, options, stats);
+}
+
 // ────────────────────────── PRESET MANAGER IMPLEMENTATION ──────────────────────────
 PresetManager::PresetManager() {
     // Add default preset
@@ -569,7 +910,7 @@ cv::Mat SizingCalculator::generateReferenceDiagram(const std::string& mode,
         cv::rectangle(diagram, 
                      cv::Rect(center.x - 30, center.y - ry - 60, 60, 30),
                      cv::Scalar(0, 0, 0), 2);
-        
+    
     } else {
         // Draw flat surface reference
         cv::Point center(diagram.cols / 2, diagram.rows / 2);
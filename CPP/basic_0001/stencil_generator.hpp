@@ -7,6 +7,12 @@
 #include <string>
 #include <memory>
 #include <nlohmann/json.hpp>
+#include "bridge_planner.hpp"
+#include "vector_export.hpp"
+#include "gcode_generator.hpp"
+#include "image_ingest.hpp"
+#include "result_cache.hpp"
+#include "scratch_arena.hpp"
 
 using json = nlohmann::json;
 
@@ -22,6 +28,8 @@ struct Preset {
     float contrast = 1.5f;
     int bridge_width_px = 8;
     int bridge_color = 255;
+    int layer_count = 4;             // Multi-layer stencils only
+    bool equalize_layers = false;    // Equal pixel counts per layer instead of equal-width bands
     std::string size_mode = "Round (pumpkin)";
     std::string units = "in";
     float horiz_circ = 34.0f;
@@ -34,7 +42,18 @@ struct Preset {
     static Preset from_json(const json& j);
 };
 
+// ────────────────────────── TILED EXECUTION OPTIONS ──────────────────────────
+struct TileOptions {
+    int tile_size = 1024;                    // Tile edge length in pixels (halo excluded)
+    size_t min_pixels = 16 * 1000 * 1000;    // generateStencil() tiles images at least this large
+};
+
 // ────────────────────────── MAIN STENCIL GENERATOR ──────────────────────────
+// Intermediates live in per-generator scratch arenas, and every generate
+// call has an overload writing into a caller-provided buffer. Feeding
+// same-sized images through loadImageFromMat and those overloads allocates
+// no frame buffers after the first image. Not thread-safe; use one
+// generator per thread.
 class StencilGenerator {
 public:
     // Constructor/Destructor
@@ -44,12 +63,46 @@ public:
     // Image loading
     bool loadImage(const std::string& filepath);
     bool loadImageFromMemory(const std::vector<uchar>& buffer);
+    bool loadImageFromMemory(const uchar* data, size_t size,
+                             const IngestOptions& options = IngestOptions());
     bool loadImageFromMat(const cv::Mat& image);
     
+    // Memory-mapped decode; grayscale/reduced decodes feed both pipelines as is
+    bool loadImageMapped(const std::string& filepath, const IngestOptions& options = IngestOptions());
+    
     // Stencil generation
     cv::Mat generateStencil(const Preset& preset);
     cv::Mat generateSimpleStencil(const Preset& preset);
-    cv::Mat generateMultiLayerStencil(const Preset& preset);
+    cv::Mat generateMultiLayerStencil(const Preset& preset, std::vector<cv::Mat>* layer_masks = nullptr);
+    
+    // Same, into stencil (reallocated only when its size or type differs);
+    // false when no image is loaded
+    bool generateStencil(const Preset& preset, cv::Mat& stencil);
+    bool generateSimpleStencil(const Preset& preset, cv::Mat& stencil);
+    bool generateMultiLayerStencil(const Preset& preset, cv::Mat& stencil,
+                                   std::vector<cv::Mat>* layer_masks = nullptr);
+    
+    // Tiled execution (bit-exact with the single-pass pipeline). Tiles take
+    // 8-bit gray or BGR; other images run the single-pass pipeline.
+    cv::Mat generateSimpleStencilTiled(const Preset& preset, const TileOptions& options = TileOptions());
+    bool generateSimpleStencilTiled(const Preset& preset, cv::Mat& stencil,
+                                    const TileOptions& options = TileOptions());
+    void setTileOptions(const TileOptions& options) { tile_options_ = options; }
+    const TileOptions& getTileOptions() const { return tile_options_; }
+    static int pipelineHaloRadius(const Preset& preset);
+    
+    // Tiled execution straight from a file, decoded in row bands: the source
+    // image is never fully in memory. Same output as loading the file and
+    // calling generateSimpleStencilTiled. Files without a strip decoder are
+    // loaded whole as the current image and tiled from there.
+    cv::Mat generateSimpleStencilStreamed(const std::string& filepath, const Preset& preset,
+                                          const TileOptions& options = TileOptions());
+    
+    // Result cache: generateStencil looks the image and preset up first
+    void setResultCache(std::shared_ptr<ResultCache> cache) { result_cache_ = std::move(cache); }
+    std::shared_ptr<ResultCache> getResultCache() const { return result_cache_; }
+    bool lastStencilFromCache() const { return last_from_cache_; }
+    static std::string canonicalPresetKey(const Preset& preset);
     
     // Floating islands detection and bridging
     struct IslandInfo {
@@ -61,7 +114,19 @@ public:
     
     std::vector<IslandInfo> detectFloatingIslands(const cv::Mat& stencil);
     cv::Mat visualizeIslands(const cv::Mat& stencil, const std::vector<IslandInfo>& islands);
-    cv::Mat autoBridgeIslands(const cv::Mat& stencil, int bridge_width = 6, int bridge_color = 255);
+    cv::Mat autoBridgeIslands(const cv::Mat& stencil, int bridge_width = 6, int bridge_color = 255,
+                              BridgePlan* plan = nullptr);
+    
+    // Islands are white pieces of material that no cut-out connects to the
+    // border; each bridge is painted white across the black cut to the
+    // approximately nearest connected white (or the image frame).
+    //
+    // Run-length form: the black cut-outs are the foreground runs. Islands
+    // are found on their complement, outlines lie on pixel corners, and
+    // bridges are cut out of the runs.
+    RleImage encodeStencil(const cv::Mat& stencil);
+    std::vector<IslandInfo> detectFloatingIslands(const RleImage& cut);
+    RleImage autoBridgeIslands(const RleImage& cut, int bridge_width = 6, BridgePlan* plan = nullptr);
     
     // Drawing/touch-up
     cv::Mat applyDrawingMask(const cv::Mat& stencil, const cv::Mat& mask, 
@@ -76,15 +141,46 @@ public:
     cv::Mat applyThreshold(const cv::Mat& image, int threshold);
     cv::Mat invertImage(const cv::Mat& image);
     
+    // Stages writing into dst, which is reallocated only when its size or
+    // type differs. dst may be the input for every stage except applyBlur.
+    // Temporaries come from the generator's scratch arena.
+    void convertToGrayscale(const cv::Mat& image, cv::Mat& dst);
+    void adjustContrast(const cv::Mat& image, cv::Mat& dst, float contrast);
+    void applyBlur(const cv::Mat& image, cv::Mat& dst, int blur_amount);
+    void enhanceEdges(const cv::Mat& image, cv::Mat& dst);
+    void applyThreshold(const cv::Mat& image, cv::Mat& dst, int threshold);
+    void invertImage(const cv::Mat& image, cv::Mat& dst);
+    
+    // Working memory held by the scratch arenas, and how often they grew
+    size_t scratchBytes() const;
+    size_t scratchAllocations() const;
+    void releaseScratch();
+    
     // File operations
     bool saveStencil(const std::string& filepath, const cv::Mat& stencil);
     bool saveStencilAsPNG(const std::string& filepath, const cv::Mat& stencil);
     bool saveStencilAsBMP(const std::string& filepath, const cv::Mat& stencil);
+    bool saveStencilAsSVG(const std::string& filepath, const cv::Mat& stencil,
+                          const VectorExportOptions& options = VectorExportOptions());
+    bool saveStencilAsDXF(const std::string& filepath, const cv::Mat& stencil,
+                          const VectorExportOptions& options = VectorExportOptions());
+    bool saveStencilAsGcode(const std::string& filepath, const cv::Mat& stencil,
+                            const GcodeOptions& options = GcodeOptions(),
+                            GcodeStats* stats = nullptr);
+    bool saveStencilAsSVG(const std::string& filepath, const RleImage& cut,
+                          const VectorExportOptions& options = VectorExportOptions());
+    bool saveStencilAsDXF(const std::string& filepath, const RleImage& cut,
+                          const VectorExportOptions& options = VectorExportOptions());
+    bool saveStencilAsGcode(const std::string& filepath, const RleImage& cut,
+                            const GcodeOptions& options = GcodeOptions(),
+                            GcodeStats* stats = nullptr);
     
     // Getter methods
-    cv::Mat getOriginalImage() const { return original_image_; }
-    cv::Mat getProcessedImage() const { return processed_image_; }
-    cv::Mat getCurrentStencil() const { return current_stencil_; }
+    // No copies: loadImageFromMat and the generate calls overwrite these
+    // buffers in place, so clone what must survive the next call
+    const cv::Mat& getOriginalImage() const { return original_image_; }
+    const cv::Mat& getProcessedImage() const { return processed_image_; }
+    const cv::Mat& getCurrentStencil() const { return current_stencil_; }
     bool hasImage() const { return !original_image_.empty(); }
     
 private:
@@ -92,9 +188,33 @@ private:
     cv::Mat original_image_;
     cv::Mat processed_image_;
     cv::Mat current_stencil_;
+    TileOptions tile_options_;
+    std::shared_ptr<ResultCache> result_cache_;
+    bool last_from_cache_ = false;
+    
+    // Scratch arenas: one for single-pass runs, one per tile worker
+    ScratchArena scratch_;
+    std::vector<ScratchArena> tile_scratch_;
+    
+    // Lookup tables of the last preset, rebuilt when its tone fields change.
+    // The tiled paths build them before fanning out; workers only read them.
+    cv::Mat contrast_lut_;
+    float contrast_lut_key_ = 0.0f;
+    cv::Mat tone_lut_;
+    Preset tone_lut_key_;
     
     // Helper methods
-    cv::Mat preprocessImage(const cv::Mat& image, const Preset& preset);
+    void preprocessImage(const cv::Mat& image, const Preset& preset, ScratchArena& scratch,
+                         cv::Mat& toned);
+    void runSimplePipeline(const cv::Mat& image, const Preset& preset, ScratchArena& scratch,
+                           cv::Mat& stencil);
+    void runTiles(const cv::Mat& window, int window_y, int y0, int y1, int tile, int halo,
+                  const Preset& preset, cv::Mat& stencil);
+    void enhanceEdges(const cv::Mat& image, cv::Mat& dst, ScratchArena& scratch);
+    static void contrastStretch(const cv::Mat& image, cv::Mat& dst, float contrast);
+    const cv::Mat& contrastLut(float contrast);
+    const cv::Mat& toneLut(const Preset& preset);
+    cv::Mat buildToneLut(const Preset& preset);
     cv::Mat createContourMask(const cv::Mat& binary_image);
 };
 
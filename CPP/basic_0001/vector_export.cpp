@@ -0,0 +1,255 @@
+// vector_export.cpp
+#include "vector_export.hpp"
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+
+namespace stencil {
+
+namespace {
+// Output is written through one buffer of this size
+constexpr size_t kWriteBufferBytes = 1 << 20;
+
+// ────────────────────────── STREAMING WRITERS ──────────────────────────
+class VectorWriter {
+public:
+    virtual ~VectorWriter() = default;
+    virtual void begin() = 0;
+    virtual void beginShape() = 0;
+    virtual void ring(const std::vector<cv::Point>& points, bool hole) = 0;
+    virtual void endShape() = 0;
+    virtual void end() = 0;
+};
+
+// One <path> per outer ring with its holes as extra subpaths; the even-odd
+// rule cuts the holes out. Coordinates stay in pixels via the viewBox.
+class SvgWriter : public VectorWriter {
+public:
+    SvgWriter(std::ostream& out, const cv::Size& size, const VectorExportOptions& options)
+        : out_(out), size_(size), options_(options) {}
+    
+    void begin() override {
+        out_ << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+             << "<svg xmlns=\"http://www.w3.org/2000/svg\""
+             << " width=\"" << size_.width * options_.scale << options_.units << "\""
+             << " height=\"" << size_.height * options_.scale << options_.units << "\""
+             << " viewBox=\"0 0 " << size_.width << " " << size_.height << "\">\n";
+        if (!options_.background.empty()) {
+            out_ << "<rect width=\"100%\" height=\"100%\" fill=\"" << options_.background << "\"/>\n";
+        }
+        out_ << "<g fill=\"" << options_.fill << "\" fill-rule=\"evenodd\" stroke=\"none\">\n";
+    }
+    
+    void beginShape() override {
+        out_ << "<path d=\"";
+    }
+    
+    void ring(const std::vector<cv::Point>& points, bool) override {
+        out_ << 'M' << points[0].x << ' ' << points[0].y << 'L';
+        for (size_t i = 1; i < points.size(); i++) {
+            out_ << points[i].x << ' ' << points[i].y << (i + 1 < points.size() ? " " : "");
+        }
+        out_ << 'Z';
+    }
+    
+    void endShape() override {
+        out_ << "\"/>\n";
+    }
+    
+    void end() override {
+        out_ << "</g>\n</svg>\n";
+    }
+
+private:
+    std::ostream& out_;
+    cv::Size size_;
+    const VectorExportOptions& options_;
+};
+
+// AutoCAD R12 ASCII: closed POLYLINE entities on layers OUTER and HOLES,
+// y flipped so the drawing is upright in CAD coordinates
+class DxfWriter : public VectorWriter {
+public:
+    DxfWriter(std::ostream& out, const cv::Size& size, const VectorExportOptions& options)
+        : out_(out), size_(size), options_(options) {}
+    
+    void begin() override {
+        out_ << std::fixed << std::setprecision(4);
+        out_ << "0\nSECTION\n2\nHEADER\n"
+             << "9\n$ACADVER\n1\nAC1009\n"
+             << "9\n$EXTMIN\n10\n0.0\n20\n0.0\n"
+             << "9\n$EXTMAX\n10\n" << size_.width * options_.scale
+             << "\n20\n" << size_.height * options_.scale << "\n"
+             << "0\nENDSEC\n"
+             << "0\nSECTION\n2\nENTITIES\n";
+    }
+    
+    void beginShape() override {}
+    
+    void ring(const std::vector<cv::Point>& points, bool hole) override {
+        const char* layer = hole ? "HOLES" : "OUTER";
+        out_ << "0\nPOLYLINE\n8\n" << layer << "\n66\n1\n70\n1\n";
+        for (const cv::Point& p : points) {
+            out_ << "0\nVERTEX\n8\n" << layer
+                 << "\n10\n" << p.x * options_.scale
+                 << "\n20\n" << (size_.height - p.y) * options_.scale << "\n";
+        }
+        out_ << "0\nSEQEND\n8\n" << layer << "\n";
+    }
+    
+    void endShape() override {}
+    
+    void end() override {
+        out_ << "0\nENDSEC\n0\nEOF\n";
+    }
+
+private:
+    std::ostream& out_;
+    cv::Size size_;
+    const VectorExportOptions& options_;
+};
+
+// Nesting depth of every contour; even depth = outer boundary
+std::vector<int> contourDepths(const std::vector<cv::Vec4i>& hierarchy, size_t count) {
+    std::vector<int> depth(count, 0);
+    if (hierarchy.size() != count) {
+        return depth;  // No tree: everything is an outer boundary
+    }
+    
+    std::vector<int> known(count, 0);
+    std::vector<int> chain;
+    for (size_t i = 0; i < count; i++) {
+        // Climb until a contour with known depth (or the root), then unwind
+        chain.clear();
+        int c = static_cast<int>(i);
+        while (c >= 0 && !known[c]) {
+            chain.push_back(c);
+            c = hierarchy[c][3];
+        }
+        int d = c >= 0 ? depth[c] : -1;
+        for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+            depth[*it] = ++d;
+            known[*it] = 1;
+        }
+    }
+    return depth;
+}
+
+std::unique_ptr<VectorWriter> makeWriter(VectorFormat format, std::ostream& out,
+                                         const cv::Size& size, const VectorExportOptions& options) {
+    if (format == VectorFormat::DXF) {
+        return std::make_unique<DxfWriter>(out, size, options);
+    }
+    return std::make_unique<SvgWriter>(out, size, options);
+}
+}
+
+bool exportContours(const std::string& filepath, VectorFormat format,
+                    const std::vector<std::vector<cv::Point>>& contours,
+                    const std::vector<cv::Vec4i>& hierarchy, const cv::Size& size,
+                    const VectorExportOptions& options, VectorExportStats* stats) {
+    std::vector<char> buffer(kWriteBufferBytes);
+    std::ofstream file;
+    file.rdbuf()->pubsetbuf(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    file.open(filepath, std::ios::out | std::ios::trunc);
+    if (!file.is_open()) {
+        return false;
+    }
+    
+    VectorExportStats local;
+    VectorExportStats& counts = stats ? *stats : local;
+    counts = VectorExportStats();
+    
+    std::unique_ptr<VectorWriter> writer = makeWriter(format, file, size, options);
+    const bool has_tree = hierarchy.size() == contours.size();
+    const std::vector<int> depth = contourDepths(hierarchy, contours.size());
+    
+    // Simplifies into one reused scratch ring; false for degenerate rings
+    std::vector<cv::Point> ring;
+    auto simplify = [&](const std::vector<cv::Point>& contour) {
+        if (options.epsilon > 0.0) {
+            cv::approxPolyDP(contour, ring, options.epsilon, true);
+        } else {
+            ring = contour;
+        }
+        return ring.size() >= 3;
+    };
+    
+    writer->begin();
+    for (size_t i = 0; i < contours.size(); i++) {
+        if (depth[i] % 2 != 0) {
+            continue;  // Holes are written with their outer ring
+        }
+        if (options.min_area > 0.0 && cv::contourArea(contours[i]) < options.min_area) {
+            continue;
+        }
+        if (!simplify(contours[i])) {
+            continue;
+        }
+        
+        writer->beginShape();
+        writer->ring(ring, false);
+        counts.shapes++;
+        counts.vertices += ring.size();
+        
+        for (int child = has_tree ? hierarchy[i][2] : -1; child >= 0; child = hierarchy[child][0]) {
+            if (simplify(contours[child])) {
+                writer->ring(ring, true);
+                counts.holes++;
+                counts.vertices += ring.size();
+            }
+        }
+        writer->endShape();
+    }
+    writer->end();
+    
+    file.flush();
+    return file.good();
+}
+
+bool exportBinary(const std::string& filepath, VectorFormat format, const cv::Mat& binary,
+                  const VectorExportOptions& options, VectorExportStats* stats) {
+    if (binary.empty() || binary.type() != CV_8UC1) {
+        return false;
+    }
+    
+    // Two-level tree: outer boundaries and their holes
+    std::vector<std::vector<cv::Point>> contours;
+    std::vector<cv::Vec4i> hierarchy;
+    cv::findContours(binary, contours, hierarchy, cv::RETR_CCOMP, cv::CHAIN_APPROX_SIMPLE);
+    
+    return exportContours(filepath, format, contours, hierarchy, binary.size(), options, stats);
+}
+
+bool exportRle(const std::string& filepath, VectorFormat format, const RleImage& image,
+               const VectorExportOptions& options, VectorExportStats* stats) {
+    if (image.empty()) {
+        return false;
+    }
+    
+    std::vector<std::vector<cv::Point>> contours;
+    std::vector<cv::Vec4i> hierarchy;
+    traceContours(image, contours, hierarchy);
+    
+    return exportContours(filepath, format, contours, hierarchy, image.size(), options, stats);
+}
+
+bool vectorFormatFromPath(const std::string& filepath, VectorFormat& format) {
+    std::string ext = filepath.substr(filepath.find_last_of('.') == std::string::npos
+                                          ? filepath.size() : filepath.find_last_of('.'));
+    std::transform(ext.begin(), ext.end(), ext.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    if (ext == ".svg") {
+        format = VectorFormat::SVG;
+        return true;
+    }
+    if (ext == ".dxf") {
+        format = VectorFormat::DXF;
+        return true;
+    }
+    return false;
+}
+
+} // namespace stencil
@@ -0,0 +1,60 @@
+// vector_export.hpp
+#ifndef VECTOR_EXPORT_HPP
+#define VECTOR_EXPORT_HPP
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+#include "rle_image.hpp"
+
+namespace stencil {
+
+// ────────────────────────── VECTOR EXPORT ──────────────────────────
+// Writes filled regions of a binary stencil as SVG or DXF outlines, straight
+// from a findContours tree (RETR_TREE or RETR_CCOMP). Contours at even depth
+// are outer boundaries and their direct children are holes, so nested
+// islands come out right. Each ring is simplified and written as soon as it
+// is visited; only the contour tree itself is held in memory, never the
+// document.
+
+enum class VectorFormat { SVG, DXF };
+
+struct VectorExportOptions {
+    double epsilon = 2.0;        // approxPolyDP tolerance in pixels, 0 keeps every vertex
+    double min_area = 0.0;       // Outer rings smaller than this (px^2) are dropped with their holes
+    double scale = 1.0;          // Output units per pixel
+    std::string units = "px";    // SVG width/height unit suffix (px, mm, in)
+    std::string fill = "black";        // SVG fill of the exported regions
+    std::string background = "white";  // SVG page colour, empty for none
+};
+
+struct VectorExportStats {
+    size_t shapes = 0;           // Outer rings written
+    size_t holes = 0;            // Hole rings written
+    size_t vertices = 0;
+};
+
+// Exports an existing contour tree; size is the raster size the contours came from
+bool exportContours(const std::string& filepath, VectorFormat format,
+                    const std::vector<std::vector<cv::Point>>& contours,
+                    const std::vector<cv::Vec4i>& hierarchy, const cv::Size& size,
+                    const VectorExportOptions& options = VectorExportOptions(),
+                    VectorExportStats* stats = nullptr);
+
+// Traces the non-zero pixels of a CV_8UC1 image and exports them
+bool exportBinary(const std::string& filepath, VectorFormat format, const cv::Mat& binary,
+                  const VectorExportOptions& options = VectorExportOptions(),
+                  VectorExportStats* stats = nullptr);
+
+// Exports the foreground of a run-length image; outlines follow pixel edges
+// (see traceContours), so shapes keep their exact pixel extent
+bool exportRle(const std::string& filepath, VectorFormat format, const RleImage& image,
+               const VectorExportOptions& options = VectorExportOptions(),
+               VectorExportStats* stats = nullptr);
+
+// Picks the format from the file extension (.svg / .dxf); false if neither
+bool vectorFormatFromPath(const std::string& filepath, VectorFormat& format);
+
+} // namespace stencil
+
+#endif // VECTOR_EXPORT_HPP